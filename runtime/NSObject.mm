@@ -25,6 +25,9 @@
 #include "NSObject.h"
 
 #include "objc-weak.h"
+#if __OBJC2__
+#include "objc-cache.h"
+#endif
 #include "llvm-DenseMap.h"
 #include "NSObject.h"
 
@@ -143,18 +146,29 @@ namespace {
 #define SIDE_TABLE_FLAG_MASK (SIDE_TABLE_RC_ONE-1)
 
 // RefcountMap disguises（伪装） its pointers because we don't want the table to act as a root for `leaks`.
+// Most stripes hold only a handful of objects, so the first buckets 
+// live inside the SideTable itself and such stripes never call malloc.
     
-// DenseMap 模板的三个参数：
+// SmallDenseMap 模板的四个参数：
 //     DisguisedPtr<objc_object> : 稠密图里的 key 的类型，是经过伪装后的 objc_object 指针
 //     size_t : 稠密图里的 value 的类型
+//     8      : 内联在 SideTable 里的 bucket 个数，超出后才在堆上分配
 //     true   : 代表 Zero Values Are Purgeable 看字面意思是零值可以被清除
-typedef objc::DenseMap<DisguisedPtr<objc_object>,size_t,true> RefcountMap;
+typedef objc::SmallDenseMap<DisguisedPtr<objc_object>,size_t,8,true> RefcountMap;
+
+#if SUPPORT_WEAK_CELLS
+// Maps objects of classes that use weak cells to their shared cell.
+typedef objc::DenseMap<DisguisedPtr<objc_object>,weak_cell_t *,true> WeakCellMap;
+#endif
 
 //  SideTable 这个类，它用于管理引用计数表和弱引用表，并使用 spinlock_lock 自旋锁来防止操作表结构时可能的竞态条件。
 struct SideTable {
     spinlock_t slock; // 自旋锁（忙等锁）
     RefcountMap refcnts; // 用来记录引用计数、是否有弱引用、是否在 dealloc 等信息
     weak_table_t weak_table;  // 弱引用表，存了弱引用对象，以及指向它的弱引用们
+#if SUPPORT_WEAK_CELLS
+    WeakCellMap weakCells;
+#endif
 
     SideTable() {
         // 将 weak_table 所在区域的内存清零
@@ -317,6 +331,18 @@ objc_storeStrong(id *location, id obj)
 // 如果 HaveOld 是 true ，表示有旧值，旧值需要被清理
 // 如果 HaveNew 是 true ，表示有新值，location 要指向新值，不过新值可能是 nil
 // 如果 CrashIfDeallocating 是 true，表示如果新值正在被 dealloc，那么进程就直接挂掉；否则就不挂掉，新值替换成 nil
+#if SUPPORT_WEAK_CELLS
+template <bool HaveOld, bool HaveNew, bool CrashIfDeallocating>
+static id 
+storeWeakCell(id *location, objc_object *newObj);
+
+static inline bool 
+usesWeakCells(objc_object *obj)
+{
+    return obj  &&  !obj->isTaggedPointer()  &&  obj->ISA()->usesWeakCells();
+}
+#endif
+
 template <bool HaveOld, bool HaveNew, bool CrashIfDeallocating>
 static id 
 storeWeak(id *location, objc_object *newObj)
@@ -337,9 +363,17 @@ storeWeak(id *location, objc_object *newObj)
     // Order by lock address to prevent lock ordering problems. 
     // Retry if the old value changes underneath us.
  retry:
+    if (HaveOld) oldObj = *location;
+#if SUPPORT_WEAK_CELLS
+    if ((HaveOld  &&  weak_is_cell(oldObj))  ||  
+        (HaveNew  &&  usesWeakCells(newObj))) 
+    {
+        return storeWeakCell<HaveOld, HaveNew, CrashIfDeallocating>
+            (location, newObj);
+    }
+#endif
     // 如果有旧值，找到旧值所对应的 Side Table
     if (HaveOld) {
-        oldObj = *location;
         oldTable = &SideTables()[oldObj]; // [] 是 StripedMap 类中重载了 [] 运算符
     } else {
         oldTable = nil;
@@ -394,6 +428,32 @@ storeWeak(id *location, objc_object *newObj)
         }
     }
 
+#if SUPPORT_WEAK_CELLS
+    // storeWeakCell() swaps cells into and out of weak variables 
+    // without these locks, so *location may change under us. 
+    // Register the new value, swap, and only then unregister the old.
+    if (HaveOld  &&  HaveNew) {
+        newObj = (objc_object *)weak_register_no_lock(&newTable->weak_table, 
+                                                      (id)newObj, location, 
+                                                      CrashIfDeallocating);
+        if (!OSAtomicCompareAndSwapPtrBarrier(oldObj, newObj, 
+                                              (void * volatile *)location)) 
+        {
+            // A cell was stored into a nil variable. Start over.
+            weak_unregister_no_lock(&newTable->weak_table, 
+                                    (id)newObj, location);
+            SideTable::unlockTwo<HaveOld, HaveNew>(oldTable, newTable);
+            goto retry;
+        }
+        if (newObj  &&  !newObj->isTaggedPointer()) {
+            newObj->setWeaklyReferenced_nolock();
+        }
+        weak_unregister_no_lock(&oldTable->weak_table, oldObj, location);
+        SideTable::unlockTwo<HaveOld, HaveNew>(oldTable, newTable);
+        return (id)newObj;
+    }
+#endif
+
     // Clean up old value, if any.
     if (HaveOld) {
         // 解除 weak_table 中，location 对 oldObj 的弱引用
@@ -431,6 +491,191 @@ storeWeak(id *location, objc_object *newObj)
 }
 
 
+#if SUPPORT_WEAK_CELLS
+/***********************************************************************
+* Weak cells
+* Weak variables pointing to an instance of a class that uses weak 
+* cells hold weak_value_for_cell() of one cell per instance instead 
+* of the instance. Only cell->referent is registered in the weak 
+* table, so dealloc clears one referrer, and storing another weak 
+* variable only bumps the cell's refcount.
+*
+* Locking: a cell is found and retained only under the side table 
+* lock of its referent. Dealloc clears cell->referent and removes 
+* the cell from its table under the same lock; after that the last 
+* weak variable holding the cell frees it without locking.
+* Weak variables holding a cell are cleared before the cell is 
+* released, and the release that frees the cell waits out lock-free 
+* readers first.
+**********************************************************************/
+static weak_cell_t *
+weak_cell_retain(objc_object *obj, bool crashIfDeallocating)
+{
+    Class cls = obj->getIsa();
+    if (!((objc_class *)cls)->isInitialized()) {
+        _class_initialize(_class_getNonMetaClass(cls, (id)obj));
+    }
+
+    SideTable& table = SideTables()[obj];
+    table.lock();
+
+    weak_cell_t *cell;
+    WeakCellMap::iterator it = table.weakCells.find(obj);
+    if (it != table.weakCells.end()) {
+        cell = it->second;
+    }
+    else {
+        cell = (weak_cell_t *)malloc(sizeof(weak_cell_t));
+        assert(((uintptr_t)cell & WEAK_CELL_MASK) == 0);
+        cell->referent = nil;
+        cell->refcount = 0;
+        if (!weak_register_no_lock(&table.weak_table, (id)obj, 
+                                   (id *)&cell->referent, 
+                                   crashIfDeallocating)) 
+        {
+            table.unlock();
+            free(cell);
+            return nil;
+        }
+        obj->setWeaklyReferenced_nolock();
+        cell->referent = obj;
+        table.weakCells[obj] = cell;
+    }
+
+    OSAtomicIncrement32Barrier(&cell->refcount);
+    table.unlock();
+    return cell;
+}
+
+
+static void 
+weak_cell_release(weak_cell_t *cell)
+{
+ retry:
+    objc_object *obj = cell->referent;
+    if (!obj) {
+        // The referent is deallocating and the cell is no longer findable.
+        if (OSAtomicDecrement32Barrier(&cell->refcount) == 0) {
+            weak_read_wait_all();
+            free(cell);
+        }
+        return;
+    }
+
+    SideTable& table = SideTables()[obj];
+    table.lock();
+    if (cell->referent != obj) {
+        table.unlock();
+        goto retry;
+    }
+    if (OSAtomicDecrement32Barrier(&cell->refcount) == 0) {
+        table.weakCells.erase(obj);
+        weak_unregister_no_lock(&table.weak_table, (id)obj, 
+                                (id *)&cell->referent);
+        table.unlock();
+        // Lock-free readers may still hold the cell they loaded.
+        weak_read_wait_all();
+        free(cell);
+        return;
+    }
+    table.unlock();
+}
+
+
+// Load and retain through the cell in *location. 
+// The reader section keeps the cell alive only long enough to pin it 
+// with a reference of its own. The load runs outside the section 
+// because a custom -retainWeakReference may release an object whose 
+// dealloc waits out every reader section, including this thread's.
+static id 
+weak_cell_load_retained(id *location)
+{
+    uint32_t token = weak_read_enter(location);
+    id value = *location;
+    if (!weak_is_cell(value)) {
+        weak_read_exit(location, token);
+        return objc_loadWeakRetained(location);
+    }
+
+    weak_cell_t *cell = weak_cell_for_value(value);
+    int32_t refcount;
+    do {
+        refcount = cell->refcount;
+        if (refcount == 0) {
+            // The last weak variable let go after the load above, 
+            // so *location is already nil.
+            weak_read_exit(location, token);
+            return nil;
+        }
+    } while (!OSAtomicCompareAndSwap32Barrier(refcount, refcount + 1, 
+                                             &cell->refcount));
+    weak_read_exit(location, token);
+
+    id result = objc_loadWeakRetained((id *)&cell->referent);
+    weak_cell_release(cell);
+    return result;
+}
+
+
+// storeWeak() for an old value that is a cell 
+// or a new value whose class uses weak cells.
+// Concurrent stores to one location are resolved by compare-and-swap.
+template <bool HaveOld, bool HaveNew, bool CrashIfDeallocating>
+static id 
+storeWeakCell(id *location, objc_object *newObj)
+{
+ retry:
+    if (HaveOld) {
+        id oldValue = *location;
+        if (weak_is_cell(oldValue)) {
+            if (!OSAtomicCompareAndSwapPtrBarrier(oldValue, nil, 
+                                                  (void * volatile *)location))
+            {
+                goto retry;
+            }
+            weak_cell_release(weak_cell_for_value(oldValue));
+        }
+        else if (oldValue) {
+            // Unregister the plain weak reference and nil the storage.
+            storeWeak<true, true, false>(location, nil);
+        }
+    }
+
+    if (!HaveNew) return nil;
+
+    if (!usesWeakCells(newObj)) {
+        if (!newObj) {
+            if (!HaveOld) *location = nil;
+            return nil;
+        }
+        return storeWeak<HaveOld, true, CrashIfDeallocating>
+            (location, newObj);
+    }
+
+    weak_cell_t *cell = weak_cell_retain(newObj, CrashIfDeallocating);
+    if (!cell) {
+        if (!HaveOld) *location = nil;
+        return nil;
+    }
+
+    id value = weak_value_for_cell(cell);
+    if (HaveOld) {
+        if (!OSAtomicCompareAndSwapPtrBarrier(nil, value, 
+                                              (void * volatile *)location)) 
+        {
+            // Another store raced with this one. Start over.
+            weak_cell_release(cell);
+            goto retry;
+        }
+    } else {
+        *location = value;
+    }
+
+    return (id)newObj;
+}
+#endif
+
+
 /** 
  * This function stores a new value into a __weak variable. It would
  * be used anywhere a __weak variable is the target of an assignment.
@@ -542,10 +787,16 @@ objc_loadWeakRetained(id *location)
     id result;
 
     SideTable *table;
+
+    // Default-RR referents are retained without the side table lock.
+    if (weak_read_lock_free(location, &result)) return result;
     
  retry:
     result = *location;
     if (!result) return nil;
+#if SUPPORT_WEAK_CELLS
+    if (weak_is_cell(result)) return weak_cell_load_retained(location);
+#endif
     
     table = &SideTables()[result];
     
@@ -638,6 +889,121 @@ objc_moveWeak(id *dst, id *src)
 }
 
 
+/***********************************************************************
+* objc_moveWeakBatch / objc_copyWeakBatch
+* objc_moveWeak() or objc_copyWeak() on each of count pairs, as done 
+* by a weak-holding collection that resizes. The pairs are sorted by 
+* the side table of their referent and each table is locked once for 
+* its whole run. A move updates the referrer slot of the existing 
+* weak entry in place instead of unregistering and registering.
+* A pair whose source changed after sorting (e.g. cleared by a 
+* concurrent dealloc) falls back to objc_moveWeak()/objc_copyWeak().
+* The destination range is uninitialized and must not overlap the 
+* source range. Same thread-safety as objc_moveWeak().
+* Locking: acquires each side table of the referents, one at a time
+**********************************************************************/
+namespace {
+struct WeakBatchItem {
+    SideTable *table;
+    size_t index;
+
+    bool operator < (const WeakBatchItem& other) const {
+        return table < other.table;
+    }
+};
+}
+
+template <bool Move>
+static void
+weakBatch(id *dst, id *src, size_t count)
+{
+    if (count == 0) return;
+
+    WeakBatchItem *items = 
+        (WeakBatchItem *)malloc(count * sizeof(WeakBatchItem));
+    size_t itemCount = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        id value = src[i];
+        if (!value  ||  ((objc_object *)value)->isTaggedPointer()) {
+            // Not registered in any weak table.
+            dst[i] = value;
+            if (Move) src[i] = nil;
+            continue;
+        }
+#if SUPPORT_WEAK_CELLS
+        if (weak_is_cell(value)) {
+            // The variable owns a reference to the cell, not a registration.
+            dst[i] = value;
+            if (Move) {
+                src[i] = nil;
+            } else {
+                OSAtomicIncrement32Barrier(&weak_cell_for_value(value)->refcount);
+            }
+            continue;
+        }
+#endif
+        items[itemCount].table = &SideTables()[value];
+        items[itemCount].index = i;
+        itemCount++;
+    }
+
+    std::sort(items, items + itemCount);
+
+    size_t deferred = 0;
+    for (size_t i = 0; i < itemCount; ) {
+        SideTable *table = items[i].table;
+        table->lock();
+        for ( ; i < itemCount  &&  items[i].table == table; i++) {
+            size_t k = items[i].index;
+            id value = src[k];
+            if (!value  ||  &SideTables()[value] != table) {
+                items[deferred++] = items[i];
+                continue;
+            }
+            if (Move) {
+                if (!weak_move_no_lock(&table->weak_table, value, 
+                                       &src[k], &dst[k])) 
+                {
+                    items[deferred++] = items[i];
+                    continue;
+                }
+                dst[k] = value;
+                src[k] = nil;
+            } else {
+                dst[k] = weak_register_no_lock(&table->weak_table, value, 
+                                               &dst[k], false);
+            }
+        }
+        table->unlock();
+    }
+
+    // Lock-free loads of the old locations need no wait here: 
+    // a moved referent or cell waits out every reader before it is 
+    // freed, as any other does.
+
+    for (size_t i = 0; i < deferred; i++) {
+        size_t k = items[i].index;
+        if (Move) objc_moveWeak(&dst[k], &src[k]);
+        else objc_copyWeak(&dst[k], &src[k]);
+    }
+
+    free(items);
+}
+
+void
+objc_moveWeakBatch(id *dst, id *src, size_t count)
+{
+    weakBatch<true>(dst, src, count);
+}
+
+void
+objc_copyWeakBatch(id *dst, id *src, size_t count)
+{
+    weakBatch<false>(dst, src, count);
+}
+
+
 /***********************************************************************
    Autorelease pool implementation
 
@@ -657,6 +1023,181 @@ objc_moveWeak(id *dst, id *src)
 
 BREAKPOINT_FUNCTION(void objc_autoreleaseNoPool(id obj));
 
+
+/***********************************************************************
+* Autorelease pool statistics
+* Recorded when OBJC_RECORD_POOL_STATISTICS or OBJC_PRINT_POOL_STATISTICS 
+* is set. Each thread updates its own record without locking. 
+* PoolStatsLock guards the list of live records and the totals of 
+* threads that have exited.
+**********************************************************************/
+
+struct PoolStats {
+    PoolStats *next;
+    PoolStats **prevp;
+    objc_autoreleasePoolStatistics s;
+};
+
+static bool RecordPoolStats;
+static mutex_t PoolStatsLock;
+static PoolStats *LivePoolStats;
+static objc_autoreleasePoolStatistics ExitedPoolStats;
+
+// Returns this thread's statistics record, or nil if not recording.
+// Pops and page frees pass create=false: they only undo what a recorded 
+// push, autorelease or page allocation did.
+// A record is created only before the thread's first pool page. Once 
+// pages exist, a missing record means thread teardown destroyed the 
+// per-thread data first; it is not recreated, so no record ever sees 
+// a pop of pools pushed before it existed.
+static PoolStats *poolStats(bool create = true)
+{
+    if (!RecordPoolStats) return nil;
+
+    if (tls_get_direct(AUTORELEASE_POOL_KEY)) create = false;
+
+    _objc_pthread_data *data = _objc_fetch_pthread_data(create);
+    if (!data) return nil;
+
+    PoolStats *stats = data->poolStats;
+    if (!stats) {
+        if (!create) return nil;
+
+        stats = (PoolStats *)calloc(1, sizeof(PoolStats));
+        pthread_threadid_np(nil, &stats->s.thread);
+        stats->s.threadCount = 1;
+
+        mutex_locker_t lock(PoolStatsLock);
+        stats->next = LivePoolStats;
+        stats->prevp = &LivePoolStats;
+        if (LivePoolStats) LivePoolStats->prevp = &stats->next;
+        LivePoolStats = stats;
+
+        data->poolStats = stats;
+    }
+    return stats;
+}
+
+static unsigned poolStatsBucket(uint64_t released)
+{
+    unsigned bucket = 0;
+    while (released  &&  bucket < OBJC_POOL_STATISTICS_BUCKETS - 1) {
+        released >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void poolStatsAccumulate(objc_autoreleasePoolStatistics& dst, 
+                                const objc_autoreleasePoolStatistics& src)
+{
+    dst.threadCount += src.threadCount;
+    dst.pushes += src.pushes;
+    dst.pops += src.pops;
+    dst.depth += src.depth;
+    dst.pages += src.pages;
+    dst.pending += src.pending;
+    if (src.highWater > dst.highWater) dst.highWater = src.highWater;
+    for (unsigned i = 0; i < OBJC_POOL_STATISTICS_BUCKETS; i++) {
+        dst.releasesPerPop[i] += src.releasesPerPop[i];
+    }
+}
+
+/***********************************************************************
+* _destroyPoolStats
+* Fold an exiting thread's statistics into the exited-thread totals.
+**********************************************************************/
+void _destroyPoolStats(PoolStats *stats)
+{
+    if (!stats) return;
+
+    mutex_locker_t lock(PoolStatsLock);
+    *stats->prevp = stats->next;
+    if (stats->next) stats->next->prevp = stats->prevp;
+    poolStatsAccumulate(ExitedPoolStats, stats->s);
+
+    free(stats);
+}
+
+// Copy every live thread's record, then the exited-thread totals.
+static objc_autoreleasePoolStatistics *
+copyPoolStats(unsigned int *outCount)
+{
+    mutex_locker_t lock(PoolStatsLock);
+
+    unsigned int count = 1;
+    for (PoolStats *stats = LivePoolStats; stats; stats = stats->next) {
+        count++;
+    }
+
+    objc_autoreleasePoolStatistics *result = (objc_autoreleasePoolStatistics *)
+        malloc(count * sizeof(objc_autoreleasePoolStatistics));
+    unsigned int i = 0;
+    for (PoolStats *stats = LivePoolStats; stats; stats = stats->next) {
+        result[i++] = stats->s;
+    }
+    result[i] = ExitedPoolStats;
+
+    *outCount = count;
+    return result;
+}
+
+// Exit-time dump for OBJC_PRINT_POOL_STATISTICS. 
+// Printed as plain JSON, without the objc[pid] prefix, 
+// so the output can be fed straight to other tools.
+static void printPoolStats(void)
+{
+    unsigned int count;
+    objc_autoreleasePoolStatistics *all = copyPoolStats(&count);
+
+    fprintf(stderr, "{\"pid\": %d, \"autorelease_pool_statistics\": [\n", 
+            getpid());
+    for (unsigned int i = 0; i < count; i++) {
+        const objc_autoreleasePoolStatistics& s = all[i];
+        fprintf(stderr, "  {\"thread\": %llu, \"threads\": %llu, "
+                "\"exited\": %s, \"pushes\": %llu, \"pops\": %llu, "
+                "\"depth\": %llu, \"pages\": %llu, \"pending\": %llu, "
+                "\"high_water\": %llu, \"releases_per_pop\": [", 
+                s.thread, s.threadCount, 
+                (i == count-1) ? "true" : "false", s.pushes, s.pops, 
+                s.depth, s.pages, s.pending, s.highWater);
+        for (unsigned b = 0; b < OBJC_POOL_STATISTICS_BUCKETS; b++) {
+            fprintf(stderr, "%s%llu", b ? ", " : "", s.releasesPerPop[b]);
+        }
+        fprintf(stderr, "]}%s\n", (i == count-1) ? "" : ",");
+    }
+    fprintf(stderr, "]}\n");
+
+    free(all);
+}
+
+
+// Retired pool pages cached by one thread, linked through their first 
+// word. Every live thread's cache is on PoolPageCaches so memory 
+// pressure can free the pages of threads that are idle.
+// Locking: PoolPageCachesLock guards the list, then each cache's lock 
+// guards its pages. The owning thread takes only its cache's lock.
+struct PoolPageCache {
+    PoolPageCache *next;
+    PoolPageCache **prevp;
+    spinlock_t lock;
+    void *pages;
+    uint32_t count;
+};
+
+static spinlock_t PoolPageCachesLock;
+static PoolPageCache *PoolPageCaches;
+
+static void freePageList(void *page)
+{
+    while (page) {
+        void *next = *(void **)page;
+        free(page);
+        page = next;
+    }
+}
+
+
 namespace {
 
 struct magic_t {
@@ -710,6 +1251,23 @@ struct magic_t {
 // Set this to 1 to mprotect() autorelease pool contents
 #define PROTECT_AUTORELEASEPOOL 0
 
+#if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
+// A pool entry that holds an object pointer plus the number of extra 
+// consecutive autoreleases of that object. An entry with count 0 is 
+// bitwise identical to the plain object pointer, and POOL_SENTINEL 
+// is still all zero.
+struct AutoreleasePoolEntry {
+    uintptr_t ptr: 48;
+    uintptr_t count: 16;
+
+    static const uintptr_t maxCount = 65535; // 2^16 - 1
+};
+static_assert(sizeof(AutoreleasePoolEntry) == sizeof(id), 
+              "AutoreleasePoolEntry must be pointer-sized");
+static_assert(MACH_VM_MAX_ADDRESS <= (1ULL << 48), 
+              "MACH_VM_MAX_ADDRESS doesn't fit into AutoreleasePoolEntry::ptr");
+#endif
+
 class AutoreleasePoolPage 
 {
     // POOL_SENTINEL 用来分隔每个AutoreleasePool
@@ -752,7 +1310,8 @@ class AutoreleasePoolPage
     // AutoreleasePoolPage每个对象会开辟4096字节内存（也就是虚拟内存一页的大小），除了上面的实例变量所占空间，剩下的空间全部用来储存autorelease对象的地址
     // new 方法也能被重载，也是开了眼界
     static void * operator new(size_t size) {
-        
+        if (void *page = takeCachedPage()) return page;
+
         /* extern void *malloc_zone_memalign(malloc_zone_t *zone, size_t alignment, size_t size) __OSX_AVAILABLE_STARTING(__MAC_10_6, __IPHONE_3_0);
 
          * Allocates a new pointer of size size whose address is an exact multiple of alignment.
@@ -764,9 +1323,93 @@ class AutoreleasePoolPage
     
     // delete方法也重载  丧心病狂
     static void operator delete(void * p) {
+        if (cachePage(p)) return;
         return free(p);
     }
 
+    // Retired pages are kept in a small per-thread cache so a loop that 
+    // pushes and pops a pool across a page boundary doesn't malloc and 
+    // free an aligned page every iteration. The cache is created when 
+    // the thread installs its first page, so freeing pages during 
+    // thread teardown never creates per-thread data. It is freed on 
+    // thread exit and by trimPageCaches(), and is disabled by 
+    // OBJC_DEBUG_POOL_ALLOCATION so heap debuggers still see every page.
+    static uint32_t const CACHE_LIMIT = 4;
+
+    static PoolPageCache *pageCache(bool create)
+    {
+        if (DebugPoolAllocation) return nil;
+
+        _objc_pthread_data *data = _objc_fetch_pthread_data(create);
+        if (!data) return nil;
+        if (!data->poolPageCache  &&  create) {
+            PoolPageCache *cache = 
+                (PoolPageCache *)calloc(1, sizeof(PoolPageCache));
+            new (&cache->lock) spinlock_t();
+            PoolPageCachesLock.lock();
+            cache->next = PoolPageCaches;
+            cache->prevp = &PoolPageCaches;
+            if (PoolPageCaches) PoolPageCaches->prevp = &cache->next;
+            PoolPageCaches = cache;
+            PoolPageCachesLock.unlock();
+            data->poolPageCache = cache;
+
+            watchMemoryPressure();
+        }
+        return data->poolPageCache;
+    }
+
+    static void *takeCachedPage()
+    {
+        PoolPageCache *cache = pageCache(false);
+        if (!cache) return nil;
+
+        cache->lock.lock();
+        void **page = (void **)cache->pages;
+        if (page) {
+            cache->pages = *page;
+            cache->count--;
+        }
+        cache->lock.unlock();
+        return page;
+    }
+
+    static bool cachePage(void *p)
+    {
+        PoolPageCache *cache = pageCache(false);
+        if (!cache) return false;
+
+        bool cached = false;
+        cache->lock.lock();
+        if (cache->count < CACHE_LIMIT) {
+            *(void **)p = cache->pages;
+            cache->pages = p;
+            cache->count++;
+            cached = true;
+        }
+        cache->lock.unlock();
+        return cached;
+    }
+
+    // Install a memory pressure handler the first time any thread 
+    // creates a page cache.
+    static void watchMemoryPressure()
+    {
+        static dispatch_once_t once;
+        dispatch_once(&once, ^{
+            dispatch_source_t source = 
+                dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                       DISPATCH_MEMORYPRESSURE_WARN | 
+                                       DISPATCH_MEMORYPRESSURE_CRITICAL, 
+                                       dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+            if (!source) return;
+            dispatch_source_set_event_handler(source, ^{
+                trimPageCaches();
+            });
+            dispatch_resume(source);
+        });
+    }
+
     // 保护当前对象所在的这片内存，即设置为只读
     inline void protect() {
 #if PROTECT_AUTORELEASEPOOL
@@ -808,6 +1451,8 @@ class AutoreleasePoolPage
         }
         // 自己的内存也保护起来
         protect();
+
+        if (PoolStats *stats = poolStats()) stats->s.pages++;
     }
 
     ~AutoreleasePoolPage() 
@@ -819,6 +1464,8 @@ class AutoreleasePoolPage
         // Not recursive: we don't want to blow out the stack 
         // if a thread accumulates a stupendous amount of garbage
         assert(!child);
+
+        if (PoolStats *stats = poolStats(false)) stats->s.pages--;
     }
 
     // die 参数应该是决定 要不要让进程直接挂掉
@@ -889,23 +1536,64 @@ class AutoreleasePoolPage
         // 满了就不能再添加了
         assert(!full());
         unprotect();
-        id *ret = next;  // faster than `return next-1` because of aliasing
-        // 将obj存储在next的位置
-        *next++ = obj;
+        id *ret;
+#if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
+        // Coalesce with the hottest entry if it holds the same object. 
+        // Pool boundaries are never coalesced, so a pop can't split 
+        // an entry.
+        AutoreleasePoolEntry *topEntry = (AutoreleasePoolEntry *)next - 1;
+        if (!DisableAutoreleaseCoalescing  &&  
+            obj != POOL_SENTINEL  &&  !empty()  &&  
+            topEntry->ptr == (uintptr_t)obj  &&  
+            topEntry->count < AutoreleasePoolEntry::maxCount)
+        {
+            topEntry->count++;
+            ret = (id *)topEntry;
+        }
+        else
+#endif
+        {
+            ret = next;  // faster than `return next-1` because of aliasing
+            // 将obj存储在next的位置
+            *next++ = obj;
+        }
         protect();
         return ret;
     }
 
+    // Object stored in the entry at p, ignoring any coalesced count.
+    static id entryObject(id *p)
+    {
+#if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
+        return (id)((AutoreleasePoolEntry *)p)->ptr;
+#else
+        return *p;
+#endif
+    }
+
+    // Number of releases owed by the entry at p.
+    static size_t entryCount(id *p)
+    {
+#if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
+        return 1 + ((AutoreleasePoolEntry *)p)->count;
+#else
+        return 1;
+#endif
+    }
+
     void releaseAll() 
     {
         releaseUntil(begin());
     }
 
     // 链表从 hotPage 开始往前删autorelease对象（不是page），直到stop对象（包括stop对象）
-    void releaseUntil(id *stop) 
+    // Returns the number of objects released.
+    size_t releaseUntil(id *stop) 
     {
         // Not recursive: we don't want to blow out the stack 
         // if a thread accumulates a stupendous amount of garbage
+        size_t released = 0;
+        size_t pools = 0;
         
         // this->next != stop ，看意思，应该是当stop也删掉了以后，this->next才会指向stop
         // 因为next指向的是最后一个autorelease对象的下一个位置
@@ -924,7 +1612,9 @@ class AutoreleasePoolPage
 
             page->unprotect();
             // 找到page中的最后一个autorelease对象
-            id obj = *--page->next;
+            --page->next;
+            id obj = entryObject(page->next);
+            size_t count = entryCount(page->next);
             // 将page->next后面的内存置为SCRIBBLE，SCRIBBLE 等于 0xA3
             memset((void*)page->next, SCRIBBLE, sizeof(*page->next));
             page->protect();
@@ -932,12 +1622,30 @@ class AutoreleasePoolPage
             // 如果obj不是标记的话，则将它释放
             if (obj != POOL_SENTINEL) {
                 // 里面实际是向 obj 发送了 release 消息
-                objc_release(obj);
+                // A coalesced entry owes one release per autorelease.
+                // Without custom RR they are taken in one go.
+                released += count;
+                if (count > 1  &&  !obj->isTaggedPointer()  &&  
+                    !obj->ISA()->hasCustomRR()) 
+                {
+                    obj->rootReleaseMany(count);
+                } else {
+                    while (count--) {
+                        objc_release(obj);
+                    }
+                }
+            } else {
+                pools++;
             }
         }
 
         setHotPage(this);
 
+        if (PoolStats *stats = poolStats(false)) {
+            stats->s.pending -= released;
+            stats->s.depth -= pools;
+        }
+
 #if DEBUG
         // 循环观察链表中当前page之后的所有page，保证它们全都是空的
         // we expect any children to be completely empty
@@ -945,6 +1653,8 @@ class AutoreleasePoolPage
             assert(page->empty());
         }
 #endif
+
+        return released;
     }
 
     // 删除链表中从当前page（包括当前page）开始的所有page
@@ -983,6 +1693,9 @@ class AutoreleasePoolPage
         // 将该 page 设为hotPage，在 releaseUntil()方法中会取得hotPage
         setHotPage((AutoreleasePoolPage *)p);
 
+        // A parked return value must be released with the rest.
+        flushOptimizedReturn();
+
         // 找到codePage
         if (AutoreleasePoolPage *page = coldPage()) {
             // 如果page不是空的，就将coldPage开始到hotPage之间的所有autorelease对象都pop出去
@@ -997,11 +1710,28 @@ class AutoreleasePoolPage
             }
         }
         
+        // Pages freed above may have gone to the page cache. 
+        // The thread is exiting, so give them back now.
+        if (_objc_pthread_data *data = _objc_fetch_pthread_data(false)) {
+            _destroyPoolPageCache(data);
+        }
+
         // 将hotPage设为nil，作者的意思是防止 TLS 析构死循环，不明白是什么意思
         // clear TLS value so TLS destruction doesn't loop
         setHotPage(nil);
     }
 
+#if SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+    // A return value parked by a thread with no pool left at exit.
+    // The pools are gone, so release it directly.
+    static void tls_dealloc_return(void *p)
+    {
+        tls_set_direct(RETURN_DISPOSITION_KEY, nil);
+        // The instruction check leaves a disposition here, not an object.
+        if ((uintptr_t)p > (uintptr_t)ReturnAtPlus1) objc_release((id)p);
+    }
+#endif
+
     // 得到指定指针所在page
     static AutoreleasePoolPage *pageForPointer(const void *p) 
     {
@@ -1123,6 +1853,10 @@ class AutoreleasePoolPage
             return nil;
         }
 
+        // Set up the page cache here rather than when a page is freed, 
+        // which may happen during thread teardown.
+        pageCache(true);
+
         // Install the first page.
         // 新建一个 page ，这个 page 就是链表的第一个 page 了，因为没有 parent ，所以传 nil
         // new 也是被重载了的，里面实际是调用了 malloc_zone_memalign 函数
@@ -1137,6 +1871,7 @@ class AutoreleasePoolPage
         // 添加一个 POOL_SENTINEL, 这玩意儿是分隔 pool 的标识符，表示从这里开始是一个新 pool
         if (obj != POOL_SENTINEL) {
             page->add(POOL_SENTINEL);
+            if (PoolStats *stats = poolStats()) stats->s.depth++;
         }
 
         // obj 添加进新创建的 page 中
@@ -1172,13 +1907,17 @@ public: // 前面都是私有成员和方法，下面开始是公开的方法
         assert(!obj->isTaggedPointer());
         // 将 obj 添加进 page 中
         id *dest __unused = autoreleaseFast(obj);
-        assert(!dest  ||  *dest == obj);
+        assert(!dest  ||  entryObject(dest) == obj);
+        if (RecordPoolStats  &&  dest) recordAutorelease();
         return obj;
     }
 
 
     static inline void *push() 
     {
+        // A parked return value belongs to the enclosing pool.
+        flushOptimizedReturn();
+
         id *dest;
         if (DebugPoolAllocation) {
             // 如果开启了 DebugPoolAllocation ，则每个 pool 都放入一个新建的 page 中
@@ -1189,15 +1928,32 @@ public: // 前面都是私有成员和方法，下面开始是公开的方法
             dest = autoreleaseFast(POOL_SENTINEL);
         }
         assert(*dest == POOL_SENTINEL);
+        if (PoolStats *stats = poolStats()) {
+            stats->s.pushes++;
+            stats->s.depth++;
+        }
         return dest;
     }
 
+    static __attribute__((noinline))
+    void recordAutorelease()
+    {
+        if (PoolStats *stats = poolStats()) {
+            if (++stats->s.pending > stats->s.highWater) {
+                stats->s.highWater = stats->s.pending;
+            }
+        }
+    }
+
     // 链表从hotPage开始往前，pop出所有autorelease对象，直到token对象（包括token对象）
     static inline void pop(void *token) 
     {
         AutoreleasePoolPage *page;
         id *stop;
 
+        // A parked return value belongs to the pool being popped.
+        flushOptimizedReturn();
+
         // 先找到指定的token指针所在page
         page = pageForPointer(token);
         stop = (id *)token;
@@ -1214,7 +1970,12 @@ public: // 前面都是私有成员和方法，下面开始是公开的方法
         if (PrintPoolHiwat) printHiwat();
 
         // 实际清理对象是在这里面干的
-        page->releaseUntil(stop);
+        size_t released = page->releaseUntil(stop);
+
+        if (PoolStats *stats = poolStats(false)) {
+            stats->s.pops++;
+            stats->s.releasesPerPop[poolStatsBucket(released)]++;
+        }
 
         // 把空的page都删了，清理内存
         // memory: delete empty children
@@ -1257,6 +2018,42 @@ public: // 前面都是私有成员和方法，下面开始是公开的方法
         int r __unused = pthread_key_init_np(AutoreleasePoolPage::key, 
                                              AutoreleasePoolPage::tls_dealloc);
         assert(r == 0);
+
+#if SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+        r = pthread_key_init_np(RETURN_DISPOSITION_KEY, 
+                                AutoreleasePoolPage::tls_dealloc_return);
+        assert(r == 0);
+#endif
+
+        RecordPoolStats = RecordPoolStatistics || PrintPoolStatistics;
+        if (PrintPoolStatistics) atexit(printPoolStats);
+    }
+
+    // Free every thread's cached pages, including the caches of idle 
+    // threads that would otherwise keep them until they exit. 
+    // The pages are freed after the locks are dropped.
+    static void trimPageCaches()
+    {
+        void *pages = nil;
+
+        PoolPageCachesLock.lock();
+        for (PoolPageCache *cache = PoolPageCaches; cache; cache = cache->next) {
+            cache->lock.lock();
+            void *page = cache->pages;
+            cache->pages = nil;
+            cache->count = 0;
+            cache->lock.unlock();
+
+            while (page) {
+                void *next = *(void **)page;
+                *(void **)page = pages;
+                pages = page;
+                page = next;
+            }
+        }
+        PoolPageCachesLock.unlock();
+
+        freePageList(pages);
     }
 
     // 打印当前 page 的信息，
@@ -1276,6 +2073,12 @@ public: // 前面都是私有成员和方法，下面开始是公开的方法
             if (*p == POOL_SENTINEL) {
                 // 如果是 POOL_SENTINEL ，就把它的地址打出来
                 _objc_inform("[%p]  ################  POOL %p", p, p);
+            } else if (entryCount(p) > 1) {
+                // coalesced entry: also print the repeat count
+                id obj = entryObject(p);
+                _objc_inform("[%p]  %#16lx  %s  autorelease count %zu", 
+                             p, (unsigned long)obj, object_getClassName(obj), 
+                             entryCount(p));
             } else {
                 // 如果是普通对象，就打印出地址和它的类型
                 _objc_inform("[%p]  %#16lx  %s", 
@@ -1298,7 +2101,9 @@ public: // 前面都是私有成员和方法，下面开始是公开的方法
         
         // 循环遍历每个page，统计一共存了多少 autorelease 对象
         for (page = coldPage(); page /* page != nil */; page = page->child) {
-            objects += page->next - page->begin();
+            for (id *p = page->begin(); p < page->next; p++) {
+                objects += entryCount(p);
+            }
         }
         _objc_inform("%llu releases pending.", (unsigned long long)objects);
 
@@ -1351,6 +2156,29 @@ public: // 前面都是私有成员和方法，下面开始是公开的方法
 };
 
 
+/***********************************************************************
+* _destroyPoolPageCache
+* Free this thread's cached autorelease pool pages and its cache. 
+* Pages the thread frees afterwards go straight to free().
+* Called on thread exit.
+* Locking: acquires PoolPageCachesLock
+**********************************************************************/
+void _destroyPoolPageCache(_objc_pthread_data *data)
+{
+    PoolPageCache *cache = data->poolPageCache;
+    if (!cache) return;
+    data->poolPageCache = nil;
+
+    PoolPageCachesLock.lock();
+    *cache->prevp = cache->next;
+    if (cache->next) cache->next->prevp = cache->prevp;
+    PoolPageCachesLock.unlock();
+
+    freePageList(cache->pages);
+    free(cache);
+}
+
+
 /***********************************************************************
 * Slow paths for inline control
 **********************************************************************/
@@ -1399,12 +2227,19 @@ objc_object::clearDeallocating_slow()
         // 将 weak table 中该对象的所有记录都删除，
         // 并且会做将__weak pointer置为 nil 的重要操作
         weak_clear_no_lock(&table.weak_table, (id)this);
+#if SUPPORT_WEAK_CELLS
+        if (ISA()->usesWeakCells()) table.weakCells.erase(this);
+#endif
     }
     // 将该对象的引用计数清空
     if (isa.has_sidetable_rc) {
         table.refcnts.erase(this);
     }
     table.unlock();
+
+    // A lock-free weak load may have read this object from any weak 
+    // variable that ever held it, including ones already rebound.
+    if (isa.weakly_referenced) weak_read_wait_all();
 }
 
 #endif
@@ -1859,6 +2694,83 @@ objc_object::sidetable_release(bool performDealloc)
 }
 
 
+/***********************************************************************
+* objc_object::rootReleaseMany
+* count releases at once, ignoring overrides, for objects without 
+* custom RR. All but the last come off the inline retain count in 
+* one store, or off the side table count under one lock. The last goes 
+* through rootRelease(), which borrows from the side table or 
+* deallocates as for any single release.
+* Returns true if the object was deallocated.
+**********************************************************************/
+bool 
+objc_object::rootReleaseMany(size_t count)
+{
+    assert(!UseGC);
+    assert(count > 0);
+    if (isTaggedPointer()) return false;
+
+#if SUPPORT_NONPOINTER_ISA
+    while (count > 1) {
+        isa_t oldisa = LoadExclusive(&isa.bits);
+        isa_t newisa = oldisa;
+        if (!newisa.indexed) return sidetable_releaseMany(count);
+
+        size_t take = MIN(count - 1, (size_t)newisa.extra_rc);
+        if (take == 0) {
+            // Borrow from the side table with a single release.
+            // Deallocating here means the rest are over-releases.
+            if (rootRelease()) return true;
+            count--;
+            continue;
+        }
+
+        uintptr_t carry;
+        newisa.bits = subc(newisa.bits, RC_ONE * take, 0, &carry);
+        assert(!carry);
+        if (StoreReleaseExclusive(&isa.bits, oldisa.bits, newisa.bits)) {
+            count -= take;
+        }
+    }
+    return rootRelease();
+#else
+    return sidetable_releaseMany(count);
+#endif
+}
+
+
+// Side table version of rootReleaseMany().
+bool 
+objc_object::sidetable_releaseMany(size_t count)
+{
+#if SUPPORT_NONPOINTER_ISA
+    assert(!isa.indexed);
+#endif
+    SideTable& table = SideTables()[this];
+
+    table.lock();
+    RefcountMap::iterator it = table.refcnts.find(this);
+    if (it != table.refcnts.end()) {
+        if (it->second & SIDE_TABLE_RC_PINNED) {
+            // A pinned count never changes.
+            count = 1;
+        } else if (!(it->second & SIDE_TABLE_DEALLOCATING)) {
+            size_t extra = it->second >> SIDE_TABLE_RC_SHIFT;
+            size_t take = MIN(count - 1, extra);
+            it->second -= take << SIDE_TABLE_RC_SHIFT;
+            count -= take;
+        }
+    }
+    table.unlock();
+
+    // More than one left means the rest are over-releases.
+    for (; count > 1; count--) {
+        if (sidetable_release()) return true;
+    }
+    return sidetable_release();
+}
+
+
 // 如果引用计数都存在了 side table 中，就会调用这个方法清理弱引用和引用计数
 void 
 objc_object::sidetable_clearDeallocating()
@@ -1868,6 +2780,7 @@ objc_object::sidetable_clearDeallocating()
     // clear any weak table items
     // clear extra retain count and deallocating bit
     // (fixme warn or abort if extra retain count == 0 ?)
+    bool weaklyReferenced = false;
     table.lock();
     RefcountMap::iterator it = table.refcnts.find(this);
     // 如果 side table 中的 refcnts 里有它
@@ -1877,10 +2790,18 @@ objc_object::sidetable_clearDeallocating()
             // 将 weak table 中该对象的所有记录都删除，
             // 并且会做将__weak pointer置为 nil 的重要操作
             weak_clear_no_lock(&table.weak_table, (id)this);
+#if SUPPORT_WEAK_CELLS
+            if (ISA()->usesWeakCells()) table.weakCells.erase(this);
+#endif
+            weaklyReferenced = true;
         }
         table.refcnts.erase(it);
     }
     table.unlock();
+
+    // A lock-free weak load may have read this object from any weak 
+    // variable that ever held it, including ones already rebound.
+    if (weaklyReferenced) weak_read_wait_all();
 }
 
 
@@ -2024,8 +2945,13 @@ _objc_rootAllocWithZone(Class cls, malloc_zone_t *zone)
     id obj;
 
 #if __OBJC2__
-    // allocWithZone under __OBJC2__ ignores the zone parameter
-    (void)zone;
+    // allocWithZone under __OBJC2__ ignores the zone parameter, 
+    // except for arena zones
+#   if !(TARGET_OS_EMBEDDED  ||  TARGET_OS_IPHONE)
+    if (zone  &&  !UseGC  &&  _objc_isArenaZone(zone)) {
+        obj = class_createInstanceFromZone(cls, 0, zone);
+    } else
+#   endif
     // 利用给定的 cls 实例化对象
     obj = class_createInstance(cls, 0);
 #else
@@ -2060,12 +2986,14 @@ callAlloc(Class cls, bool checkNil, bool allocWithZone=false)
         // fixme store hasCustomAWZ in the non-meta class and 
         // add it to canAllocFast's summary
         // 快速实例化，太高深，没看懂
-        if (cls->canAllocFast()) {
+        // GC instances must come from the auto zone, which the 
+        // fast path's calloc bypasses.
+        if (!UseGC  &&  cls->canAllocFast()) {
             // No ctors, raw isa, etc. Go straight to the metal.
             // ctor 构造函数
             // dtor 析构函数
             bool dtor = cls->hasCxxDtor();
-            id obj = (id)calloc(1, cls->bits.fastInstanceSize());
+            id obj = (id)_objc_callocInstance(cls, cls->bits.fastInstanceSize());
             if (!obj) return callBadAllocHandler(cls);
             obj->initInstanceIsa(cls, dtor);
             return obj;
@@ -2105,6 +3033,35 @@ objc_alloc(Class cls)
     return callAlloc(cls, true/*checkNil*/, false/*allocWithZone*/);
 }
 
+// Calls [[cls alloc] init].
+// Classes with the default alloc/allocWithZone: that inherit NSObject's 
+// -init get no message sends at all: NSObject's -init returns self.
+id
+objc_alloc_init(Class cls)
+{
+    if (!cls) return nil;
+
+#if __OBJC2__
+    if (! cls->ISA()->hasCustomAWZ()) {
+        id obj = callAlloc(cls, false/*checkNil*/, false/*allocWithZone*/);
+        if (!obj) return nil;
+
+        // -[NSObject init] as compiled, not as replaced by a category.
+        static IMP NSObjectInit;
+        if (!NSObjectInit) {
+            NSObjectInit = lookUpBaseImpOrNil([NSObject class], @selector(init));
+        }
+        // cache_getImp() finds nothing until -init has been sent once.
+        if (cache_getImp(cls, @selector(init)) == NSObjectInit) {
+            return obj;
+        }
+        return [obj init];
+    }
+#endif
+
+    return [callAlloc(cls, false/*checkNil*/, false/*allocWithZone*/) init];
+}
+
 // Calls [cls allocWithZone:nil].
 // 和 SEL_allocWithZone 有关
 id 
@@ -2236,6 +3193,29 @@ _objc_autoreleasePoolPrint(void)
     AutoreleasePoolPage::printAll();
 }
 
+BOOL
+_objc_autoreleasePoolGetStatistics(objc_autoreleasePoolStatistics *outStats)
+{
+    PoolStats *stats = poolStats();
+    if (!stats) return NO;
+    *outStats = stats->s;
+    return YES;
+}
+
+objc_autoreleasePoolStatistics *
+_objc_autoreleasePoolCopyStatistics(unsigned int *outCount)
+{
+    if (!RecordPoolStats) {
+        if (outCount) *outCount = 0;
+        return nil;
+    }
+
+    unsigned int count;
+    objc_autoreleasePoolStatistics *result = copyPoolStats(&count);
+    if (outCount) *outCount = count;
+    return result;
+}
+
 #pragma mark - 为 tail-calling 优化添加的方法
 
 // Same as objc_release but suitable for tail-calling 
@@ -2267,7 +3247,7 @@ id
 objc_autoreleaseReturnValue(id obj)
 {
     // 如果支持返回值优化，就不用走 autorelease 了，直接返回对象
-    if (prepareOptimizedReturn(ReturnAtPlus1)) {
+    if (prepareOptimizedReturn(ReturnAtPlus1, obj)) {
         return obj;
     }
 
@@ -2279,7 +3259,7 @@ objc_autoreleaseReturnValue(id obj)
 id 
 objc_retainAutoreleaseReturnValue(id obj)
 {
-    if (prepareOptimizedReturn(ReturnAtPlus0)) return obj;
+    if (prepareOptimizedReturn(ReturnAtPlus0, obj)) return obj;
 
     // not objc_autoreleaseReturnValue(objc_retain(obj)) 
     // because we don't need another optimization attempt
@@ -2292,7 +3272,7 @@ id
 objc_retainAutoreleasedReturnValue(id obj)
 {
     // 如果可以支持返回值优化，就不用 retain 了，直接返回对象
-    if (acceptOptimizedReturn() == ReturnAtPlus1) {
+    if (acceptOptimizedReturn(obj) == ReturnAtPlus1) {
         return obj;
     }
 
@@ -2304,7 +3284,7 @@ objc_retainAutoreleasedReturnValue(id obj)
 id
 objc_unsafeClaimAutoreleasedReturnValue(id obj)
 {
-    if (acceptOptimizedReturn() == ReturnAtPlus0) return obj;
+    if (acceptOptimizedReturn(obj) == ReturnAtPlus0) return obj;
 
     return objc_releaseAndReturn(obj);
 }
@@ -29,17 +29,12 @@
 #include "objc-private.h"
 #include "hashtable2.h"
 
-/* In order to improve efficiency, buckets contain a pointer to an array or directly the data when the array size is 1 */
-typedef union {
-    const void	*one;
-    const void	**many;
-    } oneOrMany;
-    /* an optimization consists of storing directly data when count = 1 */
-    
-typedef struct	{
-    unsigned 	count; 
-    oneOrMany	elements;
-    } HashBucket;
+#include "objc-grouptable.h"
+
+/* The buckets block is a header word, nbBuckets data slots, then their 
+   control bytes (see objc-grouptable.h).  The header holds the number 
+   of empty slots that may still be filled before the table is rebuilt.
+   nbBuckets is always a power of 2 of at least GROUP_WIDTH. */
     /* private data structure; may change */
     
 /*************************************************************************
@@ -48,41 +43,58 @@ typedef struct	{
  *	
  *************************************************************************/
 
-#define	PTRSIZE		sizeof(void *)
-
 #if !SUPPORT_ZONES
 #   define	DEFAULT_ZONE	 NULL
 #   define	ZONE_FROM_PTR(p) NULL
 #   define	ALLOCTABLE(z)	((NXHashTable *) malloc (sizeof (NXHashTable)))
-#   define	ALLOCBUCKETS(z,nb)((HashBucket *) calloc (nb, sizeof (HashBucket)))
 /* Return interior pointer so a table of classes doesn't look like objects */
-#   define	ALLOCPAIRS(z,nb) (1+(const void **) calloc (nb+1, sizeof (void *)))
-#   define	FREEPAIRS(p) (free((void*)(-1+p)))
+#   define	ALLOCSLOTS(z,size) (1+(const void **) malloc (size))
 #else
 #   define	DEFAULT_ZONE	 malloc_default_zone()
 #   define	ZONE_FROM_PTR(p) malloc_zone_from_ptr(p)
 #   define	ALLOCTABLE(z)	((NXHashTable *) malloc_zone_malloc ((malloc_zone_t *)z,sizeof (NXHashTable)))
-#   define	ALLOCBUCKETS(z,nb)((HashBucket *) malloc_zone_calloc ((malloc_zone_t *)z, nb, sizeof (HashBucket)))
 /* Return interior pointer so a table of classes doesn't look like objects */
-#   define	ALLOCPAIRS(z,nb) (1+(const void **) malloc_zone_calloc ((malloc_zone_t *)z, nb+1, sizeof (void *)))
-#   define	FREEPAIRS(p) (free((void*)(-1+p)))
+#   define	ALLOCSLOTS(z,size) (1+(const void **) malloc_zone_malloc ((malloc_zone_t *)z, size))
 #endif
+#define	FREESLOTS(p)	(free((void*)(-1+(const void **)p)))
 
-#if !SUPPORT_MOD
-    /* nbBuckets must be a power of 2 */
-#   define BUCKETOF(table, data) (((HashBucket *)table->buckets)+((*table->prototype->hash)(table->info, data) & (table->nbBuckets-1)))
-#   define GOOD_CAPACITY(c) (c <= 1 ? 1 : 1 << (log2u (c-1)+1))
-#   define MORE_CAPACITY(b) (b*2)
-#else
-    /* iff necessary this modulo can be optimized since the nbBuckets is of the form 2**n-1 */
-#   define	BUCKETOF(table, data) (((HashBucket *)table->buckets)+((*table->prototype->hash)(table->info, data) % table->nbBuckets))
-#   define GOOD_CAPACITY(c) (exp2m1u (log2u (c)+1))
-#   define MORE_CAPACITY(b) (b*2+1)
-#endif
+#define	SLOTSOF(table)	((const void **) (table)->buckets)
+#define	CTRLOF(table)	((int8_t *) (SLOTSOF(table) + (table)->nbBuckets))
+#define	GROWTHLEFT(table) (*(uintptr_t *) (SLOTSOF(table) - 1))
+#define	MASKOF(table)	((table)->nbBuckets - 1)
+#define	MIXEDHASH(table, data) group_mix ((*(table)->prototype->hash)((table)->info, data))
 
 #define ISEQUAL(table, data1, data2) ((data1 == data2) || (*table->prototype->isEqual)(table->info, data1, data2))
 	/* beware of double evaluation */
-	
+
+static size_t bucketsSize (unsigned nb) {
+    return (nb + 1) * sizeof (void *) + nb + GROUP_WIDTH;
+    }
+
+static void *allocBuckets (void *z, unsigned nb) {
+    const void	**slots = ALLOCSLOTS(z, bucketsSize (nb));
+    slots[-1] = (const void *) (uintptr_t) group_maxLoad (nb);
+    group_initCtrl ((int8_t *) (slots + nb), nb);
+    return slots;
+    }
+
+/* index of data's slot, or -1 */
+static int findIndex (NXHashTable *table, const void *data, uintptr_t mixed) {
+    const void	**slots = SLOTSOF(table);
+    int8_t	*ctrl = CTRLOF(table);
+    int8_t	h2 = group_h2 (mixed);
+    group_probe	probe (group_h1 (mixed), MASKOF(table));
+    while (1) {
+	const int8_t	*group = ctrl + probe.offset;
+	for (uint64_t match = group_match (group, h2); match; match &= match - 1) {
+	    unsigned	index = probe.slot (group_first (match));
+	    if (ISEQUAL(table, data, slots[index])) return (int) index;
+	    };
+	if (group_matchEmpty (group)) return -1;
+	probe.next ();
+	};
+    }
+
 /*************************************************************************
  *
  *	Global data and bootstrap
@@ -111,16 +123,17 @@ static NXHashTablePrototype protoPrototype = {
 static NXHashTable *prototypes = NULL;
 	/* table of all prototypes */
 
+static void insertNew (NXHashTable *table, const void *data, uintptr_t mixed);
+
 static void bootstrap (void) {
     free(malloc(8));
     prototypes = ALLOCTABLE (DEFAULT_ZONE);
     prototypes->prototype = &protoPrototype; 
-    prototypes->count = 1;
-    prototypes->nbBuckets = 1; /* has to be 1 so that the right bucket is 0 */
-    prototypes->buckets = ALLOCBUCKETS(DEFAULT_ZONE, 1);
+    prototypes->count = 0;
+    prototypes->nbBuckets = GROUP_WIDTH;
+    prototypes->buckets = allocBuckets (DEFAULT_ZONE, prototypes->nbBuckets);
     prototypes->info = NULL;
-    ((HashBucket *) prototypes->buckets)[0].count = 1;
-    ((HashBucket *) prototypes->buckets)[0].elements.one = &protoPrototype;
+    insertNew (prototypes, &protoPrototype, MIXEDHASH(prototypes, &protoPrototype));
     };
 
 int NXPtrIsEqual (const void *info, const void *data1, const void *data2) {
@@ -163,44 +176,28 @@ NXHashTable *NXCreateHashTableFromZone (NXHashTablePrototype prototype, unsigned
 	    };
 	};
     table->prototype = proto; table->count = 0; table->info = info;
-    table->nbBuckets = GOOD_CAPACITY(capacity);
-    table->buckets = ALLOCBUCKETS(z, table->nbBuckets);
+    table->nbBuckets = group_slotsForCapacity (capacity);
+    table->buckets = allocBuckets (z, table->nbBuckets);
     return table;
     }
 
-static void freeBucketPairs (void (*freeProc)(const void *info, void *data), HashBucket bucket, const void *info) {
-    unsigned	j = bucket.count;
-    const void	**pairs;
-    
-    if (j == 1) {
-	(*freeProc) (info, (void *) bucket.elements.one);
-	return;
-	};
-    pairs = bucket.elements.many;
-    while (j--) {
-	(*freeProc) (info, (void *) *pairs);
-	pairs ++;
-	};
-    FREEPAIRS (bucket.elements.many);
-    };
-    
 static void freeBuckets (NXHashTable *table, int freeObjects) {
     unsigned		i = table->nbBuckets;
-    HashBucket		*buckets = (HashBucket *) table->buckets;
+    const void		**slots = SLOTSOF(table);
+    int8_t		*ctrl = CTRLOF(table);
     
-    while (i--) {
-	if (buckets->count) {
-	    freeBucketPairs ((freeObjects) ? table->prototype->free : NXNoEffectFree, *buckets, table->info);
-	    buckets->count = 0;
-	    buckets->elements.one = NULL;
+    if (freeObjects) {
+	while (i--) {
+	    if (ctrl_isFull (ctrl[i])) (*table->prototype->free) (table->info, (void *) slots[i]);
 	    };
-	buckets++;
 	};
+    group_initCtrl (ctrl, table->nbBuckets);
+    GROWTHLEFT(table) = group_maxLoad (table->nbBuckets);
     };
     
 void NXFreeHashTable (NXHashTable *table) {
     freeBuckets (table, YES);
-    free (table->buckets);
+    FREESLOTS (table->buckets);
     free (table);
     };
     
@@ -229,17 +226,16 @@ BOOL NXCompareHashTables (NXHashTable *table1, NXHashTable *table2) {
 
 NXHashTable *NXCopyHashTable (NXHashTable *table) {
     NXHashTable		*newt;
-    NXHashState		state = NXInitHashState (table);
-    void		*data;
     __unused void	*z = ZONE_FROM_PTR(table);
+    size_t		size = bucketsSize (table->nbBuckets);
     
+    /* same capacity and hash, so the slots and control bytes copy as is */
     newt = ALLOCTABLE(z);
-    newt->prototype = table->prototype; newt->count = 0;
+    newt->prototype = table->prototype; newt->count = table->count;
     newt->info = table->info;
     newt->nbBuckets = table->nbBuckets;
-    newt->buckets = ALLOCBUCKETS(z, newt->nbBuckets);
-    while (NXNextHashState (table, &state, &data))
-        NXHashInsert (newt, data);
+    newt->buckets = ALLOCSLOTS(z, size);
+    bcopy ((const char*)(SLOTSOF(table) - 1), (char*)(SLOTSOF(newt) - 1), size);
     return newt;
     }
 
@@ -248,40 +244,12 @@ unsigned NXCountHashTable (NXHashTable *table) {
     }
 
 int NXHashMember (NXHashTable *table, const void *data) {
-    HashBucket	*bucket = BUCKETOF(table, data);
-    unsigned	j = bucket->count;
-    const void	**pairs;
-    
-    if (! j) return 0;
-    if (j == 1) {
-    	return ISEQUAL(table, data, bucket->elements.one);
-	};
-    pairs = bucket->elements.many;
-    while (j--) {
-	/* we don't cache isEqual because lists are short */
-    	if (ISEQUAL(table, data, *pairs)) return 1; 
-	pairs ++;
-	};
-    return 0;
+    return findIndex (table, data, MIXEDHASH(table, data)) >= 0;
     }
 
 void *NXHashGet (NXHashTable *table, const void *data) {
-    HashBucket	*bucket = BUCKETOF(table, data);
-    unsigned	j = bucket->count;
-    const void	**pairs;
-    
-    if (! j) return NULL;
-    if (j == 1) {
-    	return ISEQUAL(table, data, bucket->elements.one)
-	    ? (void *) bucket->elements.one : NULL; 
-	};
-    pairs = bucket->elements.many;
-    while (j--) {
-	/* we don't cache isEqual because lists are short */
-    	if (ISEQUAL(table, data, *pairs)) return (void *) *pairs; 
-	pairs ++;
-	};
-    return NULL;
+    int		index = findIndex (table, data, MIXEDHASH(table, data));
+    return (index >= 0) ? (void *) SLOTSOF(table)[index] : NULL;
     }
 
 unsigned _NXHashCapacity (NXHashTable *table) {
@@ -289,164 +257,82 @@ unsigned _NXHashCapacity (NXHashTable *table) {
     }
 
 void _NXHashRehashToCapacity (NXHashTable *table, unsigned newCapacity) {
-    /* Rehash: we create a pseudo table pointing really to the old guys,
-    extend self, copy the old pairs, and free the pseudo table */
-    NXHashTable	*old;
-    NXHashState	state;
-    void	*aux;
+    /* Rebuild into fresh slots, dropping tombstones.  Data is already 
+    unique, so each element goes straight into its first free slot. */
+    const void	**oldSlots = SLOTSOF(table);
+    int8_t	*oldCtrl = CTRLOF(table);
+    unsigned	i = table->nbBuckets;
+    unsigned	oldCount = table->count;
     __unused void *z = ZONE_FROM_PTR(table);
     
-    old = ALLOCTABLE(z);
-    old->prototype = table->prototype; old->count = table->count; 
-    old->nbBuckets = table->nbBuckets; old->buckets = table->buckets;
-    table->nbBuckets = newCapacity;
-    table->count = 0; table->buckets = ALLOCBUCKETS(z, table->nbBuckets);
-    state = NXInitHashState (old);
-    while (NXNextHashState (old, &state, &aux))
-	(void) NXHashInsert (table, aux);
-    freeBuckets (old, NO);
-    if (old->count != table->count)
+    table->nbBuckets = group_slotsForCapacity (newCapacity - newCapacity / 8);
+    if (table->nbBuckets < group_slotsForCapacity (oldCount))
+	table->nbBuckets = group_slotsForCapacity (oldCount);
+    table->count = 0; table->buckets = allocBuckets (z, table->nbBuckets);
+    while (i--) {
+	if (ctrl_isFull (oldCtrl[i])) 
+	    insertNew (table, oldSlots[i], MIXEDHASH(table, oldSlots[i]));
+	};
+    if (oldCount != table->count)
 	_objc_inform("*** hashtable: count differs after rehashing; probably indicates a broken invariant: there are x and y such as isEqual(x, y) is TRUE but hash(x) != hash (y)\n");
-    free (old->buckets); 
-    free (old);
+    FREESLOTS (oldSlots);
     }
 
 static void _NXHashRehash (NXHashTable *table) {
-    _NXHashRehashToCapacity (table, MORE_CAPACITY(table->nbBuckets));
+    /* no growth left: drop tombstones if that frees enough room, else double */
+    unsigned	nb = table->nbBuckets;
+    if (! group_shouldRehashInPlace (table->count, nb)) nb *= 2;
+    _NXHashRehashToCapacity (table, nb);
     }
 
-void *NXHashInsert (NXHashTable *table, const void *data) {
-    HashBucket	*bucket = BUCKETOF(table, data);
-    unsigned	j = bucket->count;
-    const void	**pairs;
-    const void	**newt;
-    __unused void *z = ZONE_FROM_PTR(table);
-    
-    if (! j) {
-	bucket->count++; bucket->elements.one = data; 
-	table->count++; 
-	return NULL;
-	};
-    if (j == 1) {
-    	if (ISEQUAL(table, data, bucket->elements.one)) {
-	    const void	*old = bucket->elements.one;
-	    bucket->elements.one = data;
-	    return (void *) old;
+/* data must not be in table yet */
+static void insertNew (NXHashTable *table, const void *data, uintptr_t mixed) {
+    unsigned	index = group_findInsertSlot (CTRLOF(table), MASKOF(table), mixed);
+    if (CTRLOF(table)[index] == CTRL_EMPTY) {
+	/* reusing a tombstone costs no growth */
+	if (GROWTHLEFT(table) == 0) {
+	    _NXHashRehash (table);
+	    index = group_findInsertSlot (CTRLOF(table), MASKOF(table), mixed);
 	    };
-	newt = ALLOCPAIRS(z, 2);
-	newt[1] = bucket->elements.one;
-	*newt = data;
-	bucket->count++; bucket->elements.many = newt; 
-	table->count++; 
-	if (table->count > table->nbBuckets) _NXHashRehash (table);
-	return NULL;
+	GROWTHLEFT(table)--;
 	};
-    pairs = bucket->elements.many;
-    while (j--) {
-	/* we don't cache isEqual because lists are short */
-    	if (ISEQUAL(table, data, *pairs)) {
-	    const void	*old = *pairs;
-	    *pairs = data;
-	    return (void *) old;
-	    };
-	pairs ++;
+    group_setCtrl (CTRLOF(table), MASKOF(table), index, group_h2 (mixed));
+    SLOTSOF(table)[index] = data;
+    table->count++;
+    }
+
+void *NXHashInsert (NXHashTable *table, const void *data) {
+    uintptr_t	mixed = MIXEDHASH(table, data);
+    int		index = findIndex (table, data, mixed);
+    
+    if (index >= 0) {
+	const void	*old = SLOTSOF(table)[index];
+	SLOTSOF(table)[index] = data;
+	return (void *) old;
 	};
-    /* we enlarge this bucket; and put new data in front */
-    newt = ALLOCPAIRS(z, bucket->count+1);
-    if (bucket->count) bcopy ((const char*)bucket->elements.many, (char*)(newt+1), bucket->count * PTRSIZE);
-    *newt = data;
-    FREEPAIRS (bucket->elements.many);
-    bucket->count++; bucket->elements.many = newt; 
-    table->count++; 
-    if (table->count > table->nbBuckets) _NXHashRehash (table);
+    insertNew (table, data, mixed);
     return NULL;
     }
 
 void *NXHashInsertIfAbsent (NXHashTable *table, const void *data) {
-    HashBucket	*bucket = BUCKETOF(table, data);
-    unsigned	j = bucket->count;
-    const void	**pairs;
-    const void	**newt;
-    __unused void *z = ZONE_FROM_PTR(table);
+    uintptr_t	mixed = MIXEDHASH(table, data);
+    int		index = findIndex (table, data, mixed);
     
-    if (! j) {
-	bucket->count++; bucket->elements.one = data; 
-	table->count++; 
-	return (void *) data;
-	};
-    if (j == 1) {
-    	if (ISEQUAL(table, data, bucket->elements.one))
-	    return (void *) bucket->elements.one;
-	newt = ALLOCPAIRS(z, 2);
-	newt[1] = bucket->elements.one;
-	*newt = data;
-	bucket->count++; bucket->elements.many = newt; 
-	table->count++; 
-	if (table->count > table->nbBuckets) _NXHashRehash (table);
-	return (void *) data;
-	};
-    pairs = bucket->elements.many;
-    while (j--) {
-	/* we don't cache isEqual because lists are short */
-    	if (ISEQUAL(table, data, *pairs))
-	    return (void *) *pairs;
-	pairs ++;
-	};
-    /* we enlarge this bucket; and put new data in front */
-    newt = ALLOCPAIRS(z, bucket->count+1);
-    if (bucket->count) bcopy ((const char*)bucket->elements.many, (char*)(newt+1), bucket->count * PTRSIZE);
-    *newt = data;
-    FREEPAIRS (bucket->elements.many);
-    bucket->count++; bucket->elements.many = newt; 
-    table->count++; 
-    if (table->count > table->nbBuckets) _NXHashRehash (table);
+    if (index >= 0) return (void *) SLOTSOF(table)[index];
+    insertNew (table, data, mixed);
     return (void *) data;
     }
 
 void *NXHashRemove (NXHashTable *table, const void *data) {
-    HashBucket	*bucket = BUCKETOF(table, data);
-    unsigned	j = bucket->count;
-    const void	**pairs;
-    const void	**newt;
-    __unused void *z = ZONE_FROM_PTR(table);
+    int		index = findIndex (table, data, MIXEDHASH(table, data));
     
-    if (! j) return NULL;
-    if (j == 1) {
-	if (! ISEQUAL(table, data, bucket->elements.one)) return NULL;
-	data = bucket->elements.one;
-	table->count--; bucket->count--; bucket->elements.one = NULL;
-	return (void *) data;
-	};
-    pairs = bucket->elements.many;
-    if (j == 2) {
-    	if (ISEQUAL(table, data, pairs[0])) {
-	    bucket->elements.one = pairs[1]; data = pairs[0];
-	    }
-	else if (ISEQUAL(table, data, pairs[1])) {
-	    bucket->elements.one = pairs[0]; data = pairs[1];
-	    }
-	else return NULL;
-	FREEPAIRS (pairs);
-	table->count--; bucket->count--;
-	return (void *) data;
-	};
-    while (j--) {
-    	if (ISEQUAL(table, data, *pairs)) {
-	    data = *pairs;
-	    /* we shrink this bucket */
-	    newt = (bucket->count-1) 
-		? ALLOCPAIRS(z, bucket->count-1) : NULL;
-	    if (bucket->count-1 != j)
-		    bcopy ((const char*)bucket->elements.many, (char*)newt, PTRSIZE*(bucket->count-j-1));
-	    if (j)
-		    bcopy ((const char*)(bucket->elements.many + bucket->count-j), (char*)(newt+bucket->count-j-1), PTRSIZE*j);
-	    FREEPAIRS (bucket->elements.many);
-	    table->count--; bucket->count--; bucket->elements.many = newt;
-	    return (void *) data;
-	    };
-	pairs ++;
-	};
-    return NULL;
+    if (index < 0) return NULL;
+    data = SLOTSOF(table)[index];
+    /* a tombstone keeps later elements of the same probe sequence reachable */
+    group_setCtrl (CTRLOF(table), MASKOF(table), index, CTRL_DELETED);
+    SLOTSOF(table)[index] = NULL;
+    table->count--;
+    return (void *) data;
     }
 
 NXHashState NXInitHashState (NXHashTable *table) {
@@ -458,16 +344,14 @@ NXHashState NXInitHashState (NXHashTable *table) {
 };
     
 int NXNextHashState (NXHashTable *table, NXHashState *state, void **data) {
-    HashBucket		*buckets = (HashBucket *) table->buckets;
+    int			i = group_prevFull (CTRLOF(table), state->i);
     
-    while (state->j == 0) {
-	if (state->i == 0) return NO;
-	state->i--; state->j = buckets[state->i].count;
-	}
-    state->j--;
-    buckets += state->i;
-    *data = (void *) ((buckets->count == 1) 
-    		? buckets->elements.one : buckets->elements.many[state->j]);
+    if (i < 0) {
+	state->i = 0;
+	return NO;
+	};
+    *data = (void *) SLOTSOF(table)[i];
+    state->i = i;
     return YES;
     };
 
@@ -482,20 +366,11 @@ uintptr_t NXPtrHash (const void *info, const void *data) {
     };
     
 uintptr_t NXStrHash (const void *info, const void *data) {
-    uintptr_t	hash = 0;
+    uintptr_t	hash = 5381;
     unsigned char	*s = (unsigned char *) data;
     /* unsigned to avoid a sign-extend */
-    /* unroll the loop */
-    if (s) for (; ; ) { 
-	if (*s == '\0') break;
-	hash ^= (uintptr_t) *s++;
-	if (*s == '\0') break;
-	hash ^= (uintptr_t) *s++ << 8;
-	if (*s == '\0') break;
-	hash ^= (uintptr_t) *s++ << 16;
-	if (*s == '\0') break;
-	hash ^= (uintptr_t) *s++ << 24;
-	}
+    /* no final scramble: the table mixes every hash itself */
+    if (s) while (*s) hash = (hash << 5) + hash + *s++;
     return hash;
     };
     
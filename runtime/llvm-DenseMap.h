@@ -323,7 +323,8 @@ protected:
   }
 
   template <typename OtherBaseT>
-  void copyFrom(const DenseMapBase<OtherBaseT, KeyT, ValueT, KeyInfoT>& other) {
+  void copyFrom(const DenseMapBase<OtherBaseT, KeyT, ValueT, KeyInfoT, 
+                                   ZeroValuesArePurgeable>& other) {
     assert(getNumBuckets() == other.getNumBuckets());
 
     setNumEntries(other.getNumEntries());
@@ -730,6 +731,10 @@ private:
   }
 };
 
+// SmallDenseMap keeps its first InlineBuckets buckets inside the map 
+// itself and only allocates once it outgrows them. Erasing the last 
+// entry of a spilled map frees the allocation and returns it to the 
+// inline buckets. InlineBuckets must be a power of two.
 template<typename KeyT, typename ValueT,
          unsigned InlineBuckets = 4,
          bool ZeroValuesArePurgeable = false, 
@@ -877,7 +882,7 @@ public:
     Small = true;
     if (other.getNumBuckets() > InlineBuckets) {
       Small = false;
-      allocateBuckets(other.getNumBuckets());
+      new (getLargeRep()) LargeRep(allocateBuckets(other.getNumBuckets()));
     }
     this->BaseT::copyFrom(other);
   }
@@ -896,7 +901,10 @@ public:
       AtLeast = std::max<unsigned>(MIN_BUCKETS, NextPowerOf2(AtLeast));
 
     if (Small) {
-      if (AtLeast <= InlineBuckets)
+      // AtLeast == InlineBuckets still rehashes in place to drop 
+      // tombstones and zero values; returning here could leave no 
+      // empty bucket to end a probe.
+      if (AtLeast < InlineBuckets)
         return; // Nothing to do.
 
       // First move the inline buckets into a temporary storage.
@@ -921,10 +929,12 @@ public:
         P->first.~KeyT();
       }
 
-      // Now make this map use the large rep, and move all the entries back
-      // into it.
-      Small = false;
-      new (getLargeRep()) LargeRep(allocateBuckets(AtLeast));
+      // Now make this map use the large rep if it needs one, and move 
+      // all the entries back into it.
+      if (AtLeast > InlineBuckets) {
+        Small = false;
+        new (getLargeRep()) LargeRep(allocateBuckets(AtLeast));
+      }
       this->moveFromOldBuckets(TmpBegin, TmpEnd);
       return;
     }
@@ -33,6 +33,7 @@
 #include "objc-private.h"
 #include "maptable.h"
 #include "hashtable2.h"
+#include "objc-grouptable.h"
 
 
 /******		Macros and utilities	****************************/
@@ -48,28 +49,40 @@ typedef struct _MapPair {
     const void	*value;
 } MapPair;
 
-static INLINE unsigned xorHash(unsigned hash) { 
-    unsigned xored = (hash & 0xffff) ^ (hash >> 16);
-    return ((xored * 65521) + hash);
+/* The buckets block is a header pair, nbBucketsMinusOne+1 pairs, then 
+   their control bytes (see objc-grouptable.h).  The header's value is 
+   the number of empty slots that may still be filled before the table 
+   is rebuilt.  Empty and deleted pairs keep key NX_MAPNOTAKEY so the 
+   pairs still read like the old layout. */
+
+static INLINE MapPair *pairsOf(NXMapTable *table) {
+    return (MapPair *)table->buckets;
 }
 
-static INLINE unsigned bucketOf(NXMapTable *table, const void *key) {
-    unsigned	hash = (table->prototype->hash)(table, key);
-    return hash & table->nbBucketsMinusOne;
+static INLINE int8_t *ctrlOf(NXMapTable *table) {
+    return (int8_t *)(pairsOf(table) + table->nbBucketsMinusOne + 1);
 }
 
-static INLINE int isEqual(NXMapTable *table, const void *key1, const void *key2) {
-    return (key1 == key2) ? 1 : (table->prototype->isEqual)(table, key1, key2);
+static INLINE uintptr_t *growthLeftOf(NXMapTable *table) {
+    return (uintptr_t *)&pairsOf(table)[-1].value;
 }
 
-static INLINE unsigned nextIndex(NXMapTable *table, unsigned index) {
-    return (index + 1) & table->nbBucketsMinusOne;
+static INLINE uintptr_t mixedHashOf(NXMapTable *table, const void *key) {
+    return group_mix((table->prototype->hash)(table, key));
+}
+
+static INLINE int isEqual(NXMapTable *table, const void *key1, const void *key2) {
+    return (key1 == key2) ? 1 : (table->prototype->isEqual)(table, key1, key2);
 }
 
 static INLINE void *allocBuckets(void *z, unsigned nb) {
-    MapPair	*pairs = 1+(MapPair *)malloc_zone_malloc((malloc_zone_t *)z, ((nb+1) * sizeof(MapPair)));
+    size_t	size = (nb+1) * sizeof(MapPair) + nb + GROUP_WIDTH;
+    MapPair	*pairs = 1+(MapPair *)malloc_zone_malloc((malloc_zone_t *)z, size);
     MapPair	*pair = pairs;
+    pairs[-1].key = NULL;
+    pairs[-1].value = (void *)(uintptr_t)group_maxLoad(nb);
     while (nb--) { pair->key = NX_MAPNOTAKEY; pair->value = NULL; pair++; }
+    group_initCtrl((int8_t *)pair, (unsigned)(pair - pairs));
     return pairs;
 }
 
@@ -77,6 +90,23 @@ static INLINE void freeBuckets(void *p) {
     free(-1+(MapPair *)p);
 }
 
+/* Index of key's pair, or -1. */
+static INLINE int findIndex(NXMapTable *table, const void *key, uintptr_t mixed) {
+    MapPair	*pairs = pairsOf(table);
+    int8_t	*ctrl = ctrlOf(table);
+    int8_t	h2 = group_h2(mixed);
+    group_probe	probe(group_h1(mixed), table->nbBucketsMinusOne);
+    while (1) {
+	const int8_t	*group = ctrl + probe.offset;
+	for (uint64_t match = group_match(group, h2); match; match &= match - 1) {
+	    unsigned	index = probe.slot(group_first(match));
+	    if (isEqual(table, pairs[index].key, key)) return (int)index;
+	}
+	if (group_matchEmpty(group)) return -1;
+	probe.next();
+    }
+}
+
 /*****		Global data and bootstrap	**********************/
 
 static int isEqualPrototype (const void *info, const void *data1, const void *data2) {
@@ -116,7 +146,7 @@ NXMapTable *NXCreateMapTableFromZone(NXMapTablePrototype prototype, unsigned cap
     	(void)NXHashInsert(prototypes, proto);
     }
     table->prototype = proto; table->count = 0;
-    table->nbBucketsMinusOne = exp2u(log2u(capacity)+1) - 1;
+    table->nbBucketsMinusOne = group_slotsForCapacity(capacity) - 1;
     table->buckets = allocBuckets(z, table->nbBucketsMinusOne + 1);
     return table;
 }
@@ -132,16 +162,19 @@ void NXFreeMapTable(NXMapTable *table) {
 }
 
 void NXResetMapTable(NXMapTable *table) {
-    MapPair	*pairs = (MapPair *)table->buckets;
+    MapPair	*pairs = pairsOf(table);
+    int8_t	*ctrl = ctrlOf(table);
     void	(*freeProc)(struct _NXMapTable *, void *, void *) = table->prototype->free;
-    unsigned	index = table->nbBucketsMinusOne + 1;
+    unsigned	nb = table->nbBucketsMinusOne + 1;
+    unsigned	index = nb;
     while (index--) {
-	if (pairs->key != NX_MAPNOTAKEY) {
-	    freeProc(table, (void *)pairs->key, (void *)pairs->value);
-	    pairs->key = NX_MAPNOTAKEY; pairs->value = NULL;
+	if (ctrl_isFull(ctrl[index])) {
+	    freeProc(table, (void *)pairs[index].key, (void *)pairs[index].value);
 	}
-	pairs++;
+	pairs[index].key = NX_MAPNOTAKEY; pairs[index].value = NULL;
     }
+    group_initCtrl(ctrl, nb);
+    *growthLeftOf(table) = group_maxLoad(nb);
     table->count = 0;
 }
 
@@ -162,25 +195,10 @@ BOOL NXCompareMapTables(NXMapTable *table1, NXMapTable *table2) {
 unsigned NXCountMapTable(NXMapTable *table) { return table->count; }
 
 static INLINE void *_NXMapMember(NXMapTable *table, const void *key, void **value) {
-    MapPair	*pairs = (MapPair *)table->buckets;
-    unsigned	index = bucketOf(table, key);
-    MapPair	*pair = pairs + index;
-    if (pair->key == NX_MAPNOTAKEY) return NX_MAPNOTAKEY;
-    if (isEqual(table, pair->key, key)) {
-	*value = (void *)pair->value;
-	return (void *)pair->key;
-    } else {
-	unsigned	index2 = index;
-	while ((index2 = nextIndex(table, index2)) != index) {
-	    pair = pairs + index2;
-	    if (pair->key == NX_MAPNOTAKEY) return NX_MAPNOTAKEY;
-	    if (isEqual(table, pair->key, key)) {
-	    	*value = (void *)pair->value;
-		return (void *)pair->key;
-	    }
-	}
-	return NX_MAPNOTAKEY;
-    }
+    int		index = findIndex(table, key, mixedHashOf(table, key));
+    if (index < 0) return NX_MAPNOTAKEY;
+    *value = (void *)pairsOf(table)[index].value;
+    return (void *)pairsOf(table)[index].key;
 }
 
 void *NXMapMember(NXMapTable *table, const void *key, void **value) {
@@ -192,117 +210,81 @@ void *NXMapGet(NXMapTable *table, const void *key) {
     return (_NXMapMember(table, key, &value) != NX_MAPNOTAKEY) ? value : NULL;
 }
 
-static void _NXMapRehash(NXMapTable *table) {
-    MapPair	*pairs = (MapPair *)table->buckets;
-    MapPair	*pair = pairs;
-    unsigned	numBuckets = table->nbBucketsMinusOne + 1;
-    unsigned	index = numBuckets;
+/* Rebuild into nb buckets, dropping tombstones.  Keys are already 
+   unique, so each pair goes straight into its first free slot. */
+static void _NXMapRehashToCapacity(NXMapTable *table, unsigned nb) {
+    MapPair	*oldPairs = pairsOf(table);
+    int8_t	*oldCtrl = ctrlOf(table);
+    unsigned	index = table->nbBucketsMinusOne + 1;
     unsigned	oldCount = table->count;
-    
-    table->nbBucketsMinusOne = 2 * numBuckets - 1;
-    table->count = 0; 
-    table->buckets = allocBuckets(malloc_zone_from_ptr(table), table->nbBucketsMinusOne + 1);
+
+    table->nbBucketsMinusOne = nb - 1;
+    table->count = 0;
+    table->buckets = allocBuckets(malloc_zone_from_ptr(table), nb);
+    MapPair	*pairs = pairsOf(table);
+    int8_t	*ctrl = ctrlOf(table);
     while (index--) {
-	if (pair->key != NX_MAPNOTAKEY) {
-	    (void)NXMapInsert(table, pair->key, pair->value);
-	}
-	pair++;
+	if (! ctrl_isFull(oldCtrl[index])) continue;
+	MapPair	*pair = oldPairs + index;
+	uintptr_t	mixed = mixedHashOf(table, pair->key);
+	unsigned	slot = group_findInsertSlot(ctrl, table->nbBucketsMinusOne, mixed);
+	group_setCtrl(ctrl, table->nbBucketsMinusOne, slot, group_h2(mixed));
+	pairs[slot] = *pair;
+	table->count++;
     }
+    *growthLeftOf(table) -= table->count;
     if (oldCount != table->count)
 	_objc_inform("*** maptable: count differs after rehashing; probably indicates a broken invariant: there are x and y such as isEqual(x, y) is TRUE but hash(x) != hash (y)\n");
-    freeBuckets(pairs);
+    freeBuckets(oldPairs);
+}
+
+/* No growth left: drop tombstones if that frees enough room, else double. */
+static void _NXMapRehash(NXMapTable *table) {
+    unsigned	nb = table->nbBucketsMinusOne + 1;
+    if (! group_shouldRehashInPlace(table->count, nb)) nb *= 2;
+    _NXMapRehashToCapacity(table, nb);
 }
 
 void *NXMapInsert(NXMapTable *table, const void *key, const void *value) {
-    MapPair	*pairs = (MapPair *)table->buckets;
-    unsigned	index = bucketOf(table, key);
-    MapPair	*pair = pairs + index;
     if (key == NX_MAPNOTAKEY) {
 	_objc_inform("*** NXMapInsert: invalid key: -1\n");
 	return NULL;
     }
 
-    unsigned numBuckets = table->nbBucketsMinusOne + 1;
-
-    if (pair->key == NX_MAPNOTAKEY) {
-	pair->key = key; pair->value = value;
-	table->count++;
-	if (table->count * 4 > numBuckets * 3) _NXMapRehash(table);
-	return NULL;
-    }
-    
-    if (isEqual(table, pair->key, key)) {
+    uintptr_t	mixed = mixedHashOf(table, key);
+    int		found = findIndex(table, key, mixed);
+    if (found >= 0) {
+	MapPair	*pair = pairsOf(table) + found;
 	const void	*old = pair->value;
 	if (old != value) pair->value = value;/* avoid writing unless needed! */
 	return (void *)old;
-    } else if (table->count == numBuckets) {
-	/* no room: rehash and retry */
-	_NXMapRehash(table);
-	return NXMapInsert(table, key, value);
-    } else {
-	unsigned	index2 = index;
-	while ((index2 = nextIndex(table, index2)) != index) {
-	    pair = pairs + index2;
-	    if (pair->key == NX_MAPNOTAKEY) {
-              pair->key = key; pair->value = value;
-		table->count++;
-		if (table->count * 4 > numBuckets * 3) _NXMapRehash(table);
-		return NULL;
-	    }
-	    if (isEqual(table, pair->key, key)) {
-		const void	*old = pair->value;
-		if (old != value) pair->value = value;/* avoid writing unless needed! */
-		return (void *)old;
-	    }
+    }
+
+    unsigned	index = group_findInsertSlot(ctrlOf(table), table->nbBucketsMinusOne, mixed);
+    if (ctrlOf(table)[index] == CTRL_EMPTY) {
+	/* reusing a tombstone costs no growth */
+	if (*growthLeftOf(table) == 0) {
+	    _NXMapRehash(table);
+	    index = group_findInsertSlot(ctrlOf(table), table->nbBucketsMinusOne, mixed);
 	}
-	/* no room: can't happen! */
-	_objc_inform("**** NXMapInsert: bug\n");
-	return NULL;
+	(*growthLeftOf(table))--;
     }
+    group_setCtrl(ctrlOf(table), table->nbBucketsMinusOne, index, group_h2(mixed));
+    pairsOf(table)[index].key = key;
+    pairsOf(table)[index].value = value;
+    table->count++;
+    return NULL;
 }
 
-static int mapRemove = 0;
-
 void *NXMapRemove(NXMapTable *table, const void *key) {
-    MapPair	*pairs = (MapPair *)table->buckets;
-    unsigned	index = bucketOf(table, key);
-    MapPair	*pair = pairs + index;
-    unsigned	chain = 1; /* number of non-nil pairs in a row */
-    int		found = 0;
-    const void	*old = NULL;
-    if (pair->key == NX_MAPNOTAKEY) return NULL;
-    mapRemove ++;
-    /* compute chain */
-    {
-	unsigned	index2 = index;
-	if (isEqual(table, pair->key, key)) {found ++; old = pair->value; }
-	while ((index2 = nextIndex(table, index2)) != index) {
-	    pair = pairs + index2;
-	    if (pair->key == NX_MAPNOTAKEY) break;
-	    if (isEqual(table, pair->key, key)) {found ++; old = pair->value; }
-	    chain++;
-	}
-    }
-    if (! found) return NULL;
-    if (found != 1) _objc_inform("**** NXMapRemove: incorrect table\n");
-    /* remove then reinsert */
-    {
-	MapPair	buffer[16];
-	MapPair	*aux = (chain > 16) ? (MapPair *)malloc(sizeof(MapPair)*(chain-1)) : buffer;
-	unsigned	auxnb = 0;
-	int	nb = chain;
-	unsigned	index2 = index;
-	while (nb--) {
-	    pair = pairs + index2;
-	    if (! isEqual(table, pair->key, key)) aux[auxnb++] = *pair;
-	    pair->key = NX_MAPNOTAKEY; pair->value = NULL;
-	    index2 = nextIndex(table, index2);
-	}
-	table->count -= chain;
-	if (auxnb != chain-1) _objc_inform("**** NXMapRemove: bug\n");
-	while (auxnb--) NXMapInsert(table, aux[auxnb].key, aux[auxnb].value);
-	if (chain > 16) free(aux);
-    }
+    int		index = findIndex(table, key, mixedHashOf(table, key));
+    if (index < 0) return NULL;
+    MapPair	*pair = pairsOf(table) + index;
+    const void	*old = pair->value;
+    /* a tombstone keeps later pairs of the same probe sequence reachable */
+    group_setCtrl(ctrlOf(table), table->nbBucketsMinusOne, index, CTRL_DELETED);
+    pair->key = NX_MAPNOTAKEY; pair->value = NULL;
+    table->count--;
     return (void *)old;
 }
 
@@ -313,15 +295,15 @@ NXMapState NXInitMapState(NXMapTable *table) {
 }
     
 int NXNextMapState(NXMapTable *table, NXMapState *state, const void **key, const void **value) {
-    MapPair	*pairs = (MapPair *)table->buckets;
-    while (state->index--) {
-	MapPair	*pair = pairs + state->index;
-	if (pair->key != NX_MAPNOTAKEY) {
-	    *key = pair->key; *value = pair->value;
-	    return YES;
-	}
+    int		index = group_prevFull(ctrlOf(table), state->index);
+    if (index < 0) {
+	state->index = 0;
+	return NO;
     }
-    return NO;
+    MapPair	*pair = pairsOf(table) + index;
+    *key = pair->key; *value = pair->value;
+    state->index = index;
+    return YES;
 }
 
 
@@ -382,21 +364,12 @@ static unsigned _mapPtrHash(NXMapTable *table, const void *key) {
 }
     
 static unsigned _mapStrHash(NXMapTable *table, const void *key) {
-    unsigned		hash = 0;
+    unsigned		hash = 5381;
     unsigned char	*s = (unsigned char *)key;
     /* unsigned to avoid a sign-extend */
-    /* unroll the loop */
-    if (s) for (; ; ) { 
-	if (*s == '\0') break;
-	hash ^= *s++;
-	if (*s == '\0') break;
-	hash ^= *s++ << 8;
-	if (*s == '\0') break;
-	hash ^= *s++ << 16;
-	if (*s == '\0') break;
-	hash ^= *s++ << 24;
-    }
-    return xorHash(hash);
+    /* no final scramble: the table mixes every hash itself */
+    if (s) while (*s) hash = (hash << 5) + hash + *s++;
+    return hash;
 }
     
 static int _mapPtrIsEqual(NXMapTable *table, const void *key1, const void *key2) {
@@ -23,6 +23,7 @@
 
 #include <string.h>
 #include <stddef.h>
+#include <sched.h>
 
 #include <libkern/OSAtomic.h>
 
@@ -45,6 +46,173 @@ static StripedMap<spinlock_t> PropertyLocks;
 
 #define MUTABLE_COPY 2
 
+
+/***********************************************************************
+* Lock-free atomic object properties
+* A getter publishes the value it is about to retain in its thread's 
+* hazard record, then re-reads the slot. If the value is still there, 
+* no setter has released it yet, and none will until the hazard is 
+* cleared. A setter exchanges the slot and releases the old value at 
+* once if no hazard record names it. Otherwise the value goes on the 
+* setter thread's short retired list, which is rescanned by that 
+* thread's next atomic store and drained when the thread exits. Only 
+* a setter whose list is full waits for the getters. 
+* Hazard records are never freed, so the list is walked without locks. 
+* A thread that cannot get a record counts itself in 
+* PropertyAnonymousReaders instead, which makes every release wait.
+* OBJC_DISABLE_LOCKFREE_PROPERTIES restores the PropertyLocks path.
+**********************************************************************/
+
+#define PROPERTY_RETIRED_MAX 16
+
+struct PropertyHazard {
+    PropertyHazard *next;
+    id volatile hazard;
+    volatile int32_t inUse;
+    // Values this thread swapped out while a getter might retain them.
+    // Only the owning thread touches these.
+    uint32_t retiredCount;
+    id retired[PROPERTY_RETIRED_MAX];
+};
+
+static PropertyHazard * volatile PropertyHazards;
+static volatile int32_t PropertyAnonymousReaders;
+
+// This thread's hazard record, or nil.
+static PropertyHazard *propertyHazard(bool create = true)
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(create);
+    if (!data) return nil;
+    if (data->propertyHazard  ||  !create) return data->propertyHazard;
+
+    PropertyHazard *rec;
+    for (rec = PropertyHazards; rec; rec = rec->next) {
+        if (!rec->inUse  &&  
+            OSAtomicCompareAndSwap32Barrier(0, 1, &rec->inUse)) 
+        {
+            break;
+        }
+    }
+    if (!rec) {
+        rec = (PropertyHazard *)calloc(1, sizeof(PropertyHazard));
+        rec->inUse = 1;
+        PropertyHazard *head;
+        do {
+            head = PropertyHazards;
+            rec->next = head;
+        } while (!OSAtomicCompareAndSwapPtrBarrier
+                 (head, rec, (void * volatile *)&PropertyHazards));
+    }
+    data->propertyHazard = rec;
+    return rec;
+}
+
+// Returns true if some getter may be about to retain value.
+static bool propertyIsHazard(id value)
+{
+    OSMemoryBarrier();
+    if (PropertyAnonymousReaders) return true;
+    for (PropertyHazard *rec = PropertyHazards; rec; rec = rec->next) {
+        if (rec->hazard == value) return true;
+    }
+    return false;
+}
+
+static id propertyLoadRetained(id *slot)
+{
+    id value;
+    PropertyHazard *rec = propertyHazard();
+    if (!rec) {
+        OSAtomicIncrement32Barrier(&PropertyAnonymousReaders);
+        value = objc_retain(*slot);
+        OSAtomicDecrement32Barrier(&PropertyAnonymousReaders);
+        return value;
+    }
+
+    do {
+        value = *(id volatile *)slot;
+        rec->hazard = value;
+        OSMemoryBarrier();
+    } while (*(id volatile *)slot != value);
+    if (!value) return nil;
+
+    value = objc_retain(value);
+    OSMemoryBarrier();
+    rec->hazard = nil;
+    return value;
+}
+
+// Release the retired values that no getter may still be retaining.
+static void propertyReleaseRetired(PropertyHazard *rec)
+{
+    id ready[PROPERTY_RETIRED_MAX];
+    uint32_t readyCount = 0;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < rec->retiredCount; i++) {
+        id value = rec->retired[i];
+        if (propertyIsHazard(value)) rec->retired[kept++] = value;
+        else ready[readyCount++] = value;
+    }
+    rec->retiredCount = kept;
+
+    // Release after the list is consistent: dealloc may store 
+    // atomic properties and retire more values.
+    for (uint32_t i = 0; i < readyCount; i++) objc_release(ready[i]);
+}
+
+// Dispose of a value swapped out of an atomic property.
+// A value some getter may be about to retain is released later 
+// unless this thread's retired list is full.
+static void propertyRetire(id oldValue)
+{
+    if (!oldValue) return;
+
+    PropertyHazard *rec = propertyHazard(false);
+    if (rec  &&  rec->retiredCount) propertyReleaseRetired(rec);
+
+    if (!propertyIsHazard(oldValue)) {
+        objc_release(oldValue);
+        return;
+    }
+
+    if (!rec) rec = propertyHazard();
+    if (rec  &&  rec->retiredCount < PROPERTY_RETIRED_MAX) {
+        rec->retired[rec->retiredCount++] = oldValue;
+        return;
+    }
+
+    // No room to defer it. Wait out the getters.
+    while (propertyIsHazard(oldValue)) sched_yield();
+    objc_release(oldValue);
+}
+
+/***********************************************************************
+* _destroyPropertyHazard
+* Release an exiting thread's retired values and free its hazard 
+* record for reuse by another thread. 
+* The thread forgets the record first, so nothing that runs later 
+* in its teardown can publish a hazard in a record it no longer owns.
+**********************************************************************/
+void _destroyPropertyHazard(_objc_pthread_data *data)
+{
+    PropertyHazard *rec = data->propertyHazard;
+    if (!rec) return;
+
+    // A release may store atomic properties and retire more values 
+    // into this record, so drain until it stays empty.
+    while (rec->retiredCount) {
+        id value = rec->retired[--rec->retiredCount];
+        while (propertyIsHazard(value)) sched_yield();
+        objc_release(value);
+    }
+
+    data->propertyHazard = nil;
+
+    rec->hazard = nil;
+    OSAtomicCompareAndSwap32Barrier(1, 0, &rec->inUse);
+}
+
+
 id objc_getProperty_non_gc(id self, SEL _cmd, ptrdiff_t offset, BOOL atomic) {
     if (offset == 0) {
         return object_getClass(self);
@@ -55,6 +223,10 @@ id objc_getProperty_non_gc(id self, SEL _cmd, ptrdiff_t offset, BOOL atomic) {
     if (!atomic) return *slot;
         
     // Atomic retain release world
+    if (!DisableLockFreeProperties) {
+        return objc_autoreleaseReturnValue(propertyLoadRetained(slot));
+    }
+
     spinlock_t& slotlock = PropertyLocks[slot];
     slotlock.lock();
     id value = objc_retain(*slot);
@@ -89,6 +261,13 @@ static inline void reallySetProperty(id self, SEL _cmd, id newValue, ptrdiff_t o
     if (!atomic) {
         oldValue = *slot;
         *slot = newValue;
+    } else if (!DisableLockFreeProperties) {
+        do {
+            oldValue = *slot;
+        } while (!OSAtomicCompareAndSwapPtrBarrier
+                 (oldValue, newValue, (void * volatile *)slot));
+        propertyRetire(oldValue);
+        return;
     } else {
         spinlock_t& slotlock = PropertyLocks[slot];
         slotlock.lock();
@@ -162,10 +341,89 @@ objc_setProperty(id self, SEL _cmd, ptrdiff_t offset, id newValue,
 #endif
 
 
+/***********************************************************************
+* objc_copyStruct seqlocks
+* Atomic structs without strong references are read optimistically: 
+* a reader copies the value between two reads of its stripe's sequence 
+* number and retries if a writer ran in between, so readers never 
+* write shared memory. A writer takes its stripe's lock and keeps the 
+* sequence odd for the length of its copy. 
+* A getter's destination is normally the caller's local variable, and 
+* a setter's source normally is too; neither needs the seqlock. 
+* Anything not on the calling thread's stack is treated as shared.
+**********************************************************************/
+
+struct StructSeqLock {
+    spinlock_t lock;
+    volatile int32_t seq;
+
+    StructSeqLock() : seq(0) { }
+};
+
+static StripedMap<StructSeqLock> StructSeqLocks;
+
+// Copies of at most this many bytes between shared locations 
+// are staged on the stack rather than in malloc memory.
+#define STRUCT_STAGING_MAX 256
+
+static inline bool isOnCurrentStack(const void *p)
+{
+    pthread_t self = pthread_self();
+    uintptr_t top = (uintptr_t)pthread_get_stackaddr_np(self);
+    uintptr_t bottom = top - pthread_get_stacksize_np(self);
+    return (uintptr_t)p >= bottom  &&  (uintptr_t)p < top;
+}
+
+static void seqlockRead(void *dest, const void *src, ptrdiff_t size)
+{
+    StructSeqLock& seqlock = StructSeqLocks[src];
+    int32_t seq;
+    do {
+        while ((seq = seqlock.seq) & 1) sched_yield();
+        OSMemoryBarrier();
+        memmove(dest, src, size);
+        OSMemoryBarrier();
+    } while (seqlock.seq != seq);
+}
+
+static void seqlockWrite(void *dest, const void *src, ptrdiff_t size)
+{
+    StructSeqLock& seqlock = StructSeqLocks[dest];
+    seqlock.lock.lock();
+    OSAtomicIncrement32Barrier(&seqlock.seq);
+    memmove(dest, src, size);
+    OSAtomicIncrement32Barrier(&seqlock.seq);
+    seqlock.lock.unlock();
+}
+
+static void seqlockCopy(void *dest, const void *src, ptrdiff_t size)
+{
+    if (isOnCurrentStack(dest)) {
+        seqlockRead(dest, src, size);
+    } else if (isOnCurrentStack(src)) {
+        seqlockWrite(dest, src, size);
+    } else {
+        // Read completely before writing, so no thread holds a 
+        // writer lock while it waits for another stripe.
+        char buf[STRUCT_STAGING_MAX] __attribute__((aligned(16)));
+        void *staging = (size <= STRUCT_STAGING_MAX) ? buf : malloc(size);
+        seqlockRead(staging, src, size);
+        seqlockWrite(dest, staging, size);
+        if (staging != buf) free(staging);
+    }
+}
+
+
 // This entry point was designed wrong.  When used as a getter, src needs to be locked so that
 // if simultaneously used for a setter then there would be contention on src.
 // So we need two locks - one of which will be contended.
+// Structs without strong references avoid this with seqlocks instead.
 void objc_copyStruct(void *dest, const void *src, ptrdiff_t size, BOOL atomic, BOOL hasStrong) {
+    if (atomic  &&  !hasStrong) {
+        seqlockCopy(dest, src, size);
+        return;
+    }
+
     static StripedMap<spinlock_t> StructLocks;
     spinlock_t *srcLock = nil;
     spinlock_t *dstLock = nil;
@@ -936,9 +936,10 @@ _objc_constructOrFree(id bytes, Class cls)
 #if SUPPORT_GC
         if (UseGC) {
             auto_zone_retain(gc_zone, bytes);  // gc free expects rc==1
-        }
+            free(bytes);
+        } else
 #endif
-        free(bytes);
+        _objc_freeInstance(bytes);
     }
 
     return obj;
@@ -951,16 +952,27 @@ _objc_constructOrFree(id bytes, Class cls)
 * Attempts to allocate num_requested objects, each with extraBytes.
 * Returns the number of allocated objects (possibly zero), with 
 * the allocated pointers in *results.
+* Instances of slab-allocated classes come from one depot transaction; 
+* everything else uses the zone's batch allocator.
 **********************************************************************/
 unsigned
 _class_createInstancesFromZone(Class cls, size_t extraBytes, void *zone, 
                                id *results, unsigned num_requested)
 {
-    unsigned num_allocated;
+    unsigned num_allocated = 0;
     if (!cls) return 0;
 
     size_t size = cls->instanceSize(extraBytes);
 
+#if SUPPORT_SLAB_ALLOCATOR
+    if (!UseGC  &&  !zone  &&  
+        (UseSlabAllocator  ||  cls->usesSlabAllocator()))
+    {
+        num_allocated = 
+            _objc_slabBatchCalloc(size, (void**)results, num_requested);
+    }
+    if (num_allocated == 0)
+#endif
 #if SUPPORT_GC
     if (UseGC) {
         num_allocated = 
@@ -983,9 +995,18 @@ _class_createInstancesFromZone(Class cls, size_t extraBytes, void *zone,
     unsigned shift = 0;
     unsigned i;
     bool ctor = cls->hasCxxCtor();
+#if __OBJC2__
+    // Same isa choice as _class_createInstanceFromZone.
+    bool indexed = !UseGC  &&  !zone  &&  cls->canAllocIndexed();
+    bool dtor = cls->hasCxxDtor();
+#endif
     for (i = 0; i < num_allocated; i++) {
         id obj = results[i];
-        obj->initIsa(cls);    // fixme allow indexed
+#if __OBJC2__
+        if (indexed) obj->initInstanceIsa(cls, dtor);
+        else
+#endif
+        obj->initIsa(cls);
         if (ctor) obj = _objc_constructOrFree(obj, cls);
 
         if (obj) {
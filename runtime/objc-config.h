@@ -51,7 +51,7 @@
 #   define SUPPORT_ZONES 1
 #endif
 
-// Define SUPPORT_MOD=1 to use the mod operator in NXHashTable and objc-sel-set
+// Define SUPPORT_MOD=1 to use the mod operator in objc-sel-set
 #if defined(__arm__)
 #   define SUPPORT_MOD 0
 #else
@@ -138,6 +138,60 @@
 #   define SUPPORT_RETURN_AUTORELEASE 1
 #endif
 
+// Define SUPPORT_RETURN_AUTORELEASE_HANDSHAKE to be able to optimize 
+// autoreleased return values with a thread-local handshake instead of 
+// inspecting the caller's instructions. 
+// Define RETURN_AUTORELEASE_HANDSHAKE_ONLY where callerAcceptsOptimizedReturn() 
+// has no instruction pattern to look for; elsewhere the handshake is 
+// used only when OBJC_USE_RETURN_HANDSHAKE is set.
+#if !SUPPORT_RETURN_AUTORELEASE
+#   define SUPPORT_RETURN_AUTORELEASE_HANDSHAKE 0
+#   define RETURN_AUTORELEASE_HANDSHAKE_ONLY 0
+#else
+#   define SUPPORT_RETURN_AUTORELEASE_HANDSHAKE 1
+#   if defined(__linux__)  ||  \
+        !(__x86_64__  ||  __arm__  ||  __arm64__  ||  __i386__)
+#       define RETURN_AUTORELEASE_HANDSHAKE_ONLY 1
+#   else
+#       define RETURN_AUTORELEASE_HANDSHAKE_ONLY 0
+#   endif
+#endif
+
+// Define SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS to coalesce consecutive 
+// autoreleases of the same object into a single autorelease pool entry.
+// Requires unused high bits in object pointers to hold the repeat count.
+#if !__LP64__  ||  TARGET_OS_WIN32
+#   define SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS 0
+#else
+#   define SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS 1
+#endif
+
+// Define SUPPORT_SLAB_ALLOCATOR to allocate small instances of opted-in 
+// classes from slabs with per-thread magazines instead of calloc().
+// The slabs are registered as a malloc zone so malloc_size() and free() 
+// keep working on the instances.
+#if !__OBJC2__  ||  TARGET_OS_WIN32
+#   define SUPPORT_SLAB_ALLOCATOR 0
+#else
+#   define SUPPORT_SLAB_ALLOCATOR 1
+#endif
+
+// Define SUPPORT_ARENA_ZONES to provide bump-pointer malloc zones 
+// for allocWithZone: and class_createInstanceFromZone().
+#if TARGET_OS_WIN32
+#   define SUPPORT_ARENA_ZONES 0
+#else
+#   define SUPPORT_ARENA_ZONES 1
+#endif
+
+// Define SUPPORT_WEAK_CELLS to let opted-in classes share one 
+// refcounted cell among all weak variables pointing to an instance.
+#if !__OBJC2__
+#   define SUPPORT_WEAK_CELLS 0
+#else
+#   define SUPPORT_WEAK_CELLS 1
+#endif
+
 // Define SUPPORT_STRET on architectures that need separate struct-return ABI.
 #if defined(__arm64__)
 #   define SUPPORT_STRET 0
@@ -23,6 +23,8 @@ OPTION( PrintAltHandlers,         OBJC_PRINT_ALT_HANDLERS,         "log processi
 OPTION( PrintReplacedMethods,     OBJC_PRINT_REPLACED_METHODS,     "log methods replaced by category implementations")
 OPTION( PrintDeprecation,         OBJC_PRINT_DEPRECATION_WARNINGS, "warn about calls to deprecated runtime functions")
 OPTION( PrintPoolHiwat,           OBJC_PRINT_POOL_HIGHWATER,       "log high-water marks for autorelease pools")
+OPTION( PrintPoolStatistics,      OBJC_PRINT_POOL_STATISTICS,      "print per-thread autorelease pool statistics as JSON at exit")
+OPTION( PrintSyncStatistics,      OBJC_PRINT_SYNC_STATISTICS,      "print @synchronized contention statistics as JSON at exit")
 OPTION( PrintCustomRR,            OBJC_PRINT_CUSTOM_RR,            "log classes with un-optimized custom retain/release methods")
 OPTION( PrintCustomAWZ,           OBJC_PRINT_CUSTOM_AWZ,           "log classes with un-optimized custom allocWithZone methods")
 OPTION( PrintRawIsa,              OBJC_PRINT_RAW_ISA,              "log classes that require raw pointer isa fields")
@@ -35,6 +37,9 @@ OPTION( DebugNonFragileIvars,     OBJC_DEBUG_NONFRAGILE_IVARS,     "capriciously
 OPTION( DebugAltHandlers,         OBJC_DEBUG_ALT_HANDLERS,         "record more info about bad alt handler use")
 OPTION( DebugMissingPools,        OBJC_DEBUG_MISSING_POOLS,        "warn about autorelease with no pool in place, which may be a leak")
 OPTION( DebugPoolAllocation,      OBJC_DEBUG_POOL_ALLOCATION,      "halt when autorelease pools are popped out of order, and allow heap debuggers to track autorelease pools")
+OPTION( RecordPoolStatistics,     OBJC_RECORD_POOL_STATISTICS,     "record per-thread autorelease pool statistics for _objc_autoreleasePoolCopyStatistics()")
+OPTION( ProfileLocks,             OBJC_PROFILE_LOCKS,              "record acquisitions, wait times and hold times of the runtime's global locks for _objc_copyLockProfiles()")
+OPTION( RecordSyncStatistics,     OBJC_RECORD_SYNC_STATISTICS,     "record @synchronized contention statistics for _objc_syncCopyStatistics()")
 OPTION( DebugDuplicateClasses,    OBJC_DEBUG_DUPLICATE_CLASSES,    "halt when multiple classes with the same name are present")
 
 OPTION( DisableGC,                OBJC_DISABLE_GC,                 "force GC OFF, even if the executable wants it on")
@@ -42,3 +47,8 @@ OPTION( DisableVtables,           OBJC_DISABLE_VTABLES,            "disable vtab
 OPTION( DisablePreopt,            OBJC_DISABLE_PREOPTIMIZATION,    "disable preoptimization courtesy of dyld shared cache")
 OPTION( DisableTaggedPointers,    OBJC_DISABLE_TAGGED_POINTERS,    "disable tagged pointer optimization of NSNumber et al.") 
 OPTION( DisableIndexedIsa,        OBJC_DISABLE_NONPOINTER_ISA,     "disable non-pointer isa fields")
+OPTION( DisableLockFreeProperties, OBJC_DISABLE_LOCKFREE_PROPERTIES, "use spinlocks for atomic object properties instead of hazard pointers")
+OPTION( UseReturnHandshake,       OBJC_USE_RETURN_HANDSHAKE,       "optimize autoreleased return values with a thread-local handshake instead of inspecting the caller's instructions")
+OPTION( DisableAutoreleaseCoalescing, OBJC_DISABLE_AUTORELEASE_COALESCING, "disable coalescing of consecutive autoreleases of the same object")
+OPTION( UseSlabAllocator,         OBJC_USE_SLAB_ALLOCATOR,         "allocate small instances of every class from the slab allocator")
+OPTION( DisableSlabAllocator,     OBJC_DISABLE_SLAB_ALLOCATOR,     "disable the slab allocator, even for classes that opted in")
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2016 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/***********************************************************************
+* objc-grouptable.h
+* Control bytes and group probing for the open-addressed tables
+* behind NXHashTable and NXMapTable.
+*
+* Every slot has one control byte: CTRL_EMPTY, CTRL_DELETED, or, when
+* the slot is full, the low 7 bits of its mixed hash (H2). The other
+* bits (H1) choose where probing starts. A probe loads a whole group
+* of control bytes (16 with SSE2, otherwise 8 with word arithmetic)
+* and calls isEqual only on slots whose H2 matches. The first group's
+* control bytes are cloned past the end, so a group load never wraps.
+*
+* Probing moves between groups in triangular steps, which reaches
+* every group because capacities are powers of two of at least
+* GROUP_WIDTH. A table keeps at most 7/8 of its slots full or deleted,
+* so every probe sequence ends at an empty slot. When no growth is
+* left, a table that is mostly tombstones is rebuilt at the same
+* capacity; otherwise it doubles.
+**********************************************************************/
+
+#ifndef _OBJC_GROUPTABLE_H
+#define _OBJC_GROUPTABLE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if __SSE2__
+#   include <emmintrin.h>
+#   define GROUP_WIDTH 16
+#   define GROUP_SHIFT 0    // mask bit i is slot i
+#else
+#   define GROUP_WIDTH 8
+#   define GROUP_SHIFT 3    // mask bit 8*i+7 is slot i
+#endif
+
+#define CTRL_EMPTY   ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+
+static inline bool ctrl_isFull(int8_t ctrl) { return ctrl >= 0; }
+
+// One multiply spreads weak hashes such as aligned pointers over all bits.
+static inline uintptr_t group_mix(uintptr_t hash)
+{
+#if __LP64__
+    hash *= 0x9e3779b97f4a7c15ULL;
+    return hash ^ (hash >> 32);
+#else
+    hash *= 0x9e3779b9U;
+    return hash ^ (hash >> 16);
+#endif
+}
+
+static inline uintptr_t group_h1(uintptr_t mixed) { return mixed >> 7; }
+static inline int8_t group_h2(uintptr_t mixed) { return (int8_t)(mixed & 0x7f); }
+
+// Bit sets of the slots in a group that match some condition.
+// Walk them with group_first() and mask &= mask - 1.
+static inline unsigned group_first(uint64_t mask)
+{
+    return (unsigned)__builtin_ctzll(mask) >> GROUP_SHIFT;
+}
+
+static inline unsigned group_last(uint64_t mask)
+{
+    return (unsigned)(63 - __builtin_clzll(mask)) >> GROUP_SHIFT;
+}
+
+// The slots of a group before slot n.
+static inline uint64_t group_below(unsigned n)
+{
+    if (n >= (64 >> GROUP_SHIFT)) return ~0ULL;
+    return (1ULL << (n << GROUP_SHIFT)) - 1;
+}
+
+#if __SSE2__
+
+static inline __m128i group_load(const int8_t *ctrl)
+{
+    return _mm_loadu_si128((const __m128i *)ctrl);
+}
+
+static inline uint64_t group_match(const int8_t *ctrl, int8_t h2)
+{
+    __m128i match = _mm_cmpeq_epi8(_mm_set1_epi8(h2), group_load(ctrl));
+    return (uint32_t)_mm_movemask_epi8(match);
+}
+
+static inline uint64_t group_matchEmpty(const int8_t *ctrl)
+{
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline uint64_t group_matchEmptyOrDeleted(const int8_t *ctrl)
+{
+    // Only empty and deleted control bytes have the high bit set.
+    return (uint32_t)_mm_movemask_epi8(group_load(ctrl));
+}
+
+static inline uint64_t group_matchFull(const int8_t *ctrl)
+{
+    return group_matchEmptyOrDeleted(ctrl) ^ 0xffff;
+}
+
+#else
+
+#define GROUP_LSBS 0x0101010101010101ULL
+#define GROUP_MSBS 0x8080808080808080ULL
+
+static inline uint64_t group_load(const int8_t *ctrl)
+{
+    uint64_t group;
+    memcpy(&group, ctrl, sizeof(group));
+    return group;
+}
+
+// May also report a slot right after a real match;
+// callers compare keys anyway.
+static inline uint64_t group_match(const int8_t *ctrl, int8_t h2)
+{
+    uint64_t x = group_load(ctrl) ^ (GROUP_LSBS * (uint8_t)h2);
+    return (x - GROUP_LSBS) & ~x & GROUP_MSBS;
+}
+
+static inline uint64_t group_matchEmpty(const int8_t *ctrl)
+{
+    // Empty is the only control byte with bit 7 set and bit 1 clear.
+    uint64_t group = group_load(ctrl);
+    return group & (~group << 6) & GROUP_MSBS;
+}
+
+static inline uint64_t group_matchEmptyOrDeleted(const int8_t *ctrl)
+{
+    return group_load(ctrl) & GROUP_MSBS;
+}
+
+static inline uint64_t group_matchFull(const int8_t *ctrl)
+{
+    return ~group_load(ctrl) & GROUP_MSBS;
+}
+
+#endif
+
+// Number of slots to allocate for capacity entries.
+static inline unsigned group_slotsForCapacity(unsigned capacity)
+{
+    unsigned slots = GROUP_WIDTH;
+    while (slots - slots / 8 < capacity) slots *= 2;
+    return slots;
+}
+
+// Full or deleted slots a table of this many slots may have.
+static inline unsigned group_maxLoad(unsigned slots)
+{
+    return slots - slots / 8;
+}
+
+// Whether a table with no growth left should rebuild at its current
+// size to drop tombstones instead of doubling.
+static inline bool group_shouldRehashInPlace(unsigned count, unsigned slots)
+{
+    return (uint64_t)count * 32 <= (uint64_t)slots * 25;
+}
+
+static inline void group_setCtrl(int8_t *ctrl, unsigned mask,
+                                 unsigned index, int8_t value)
+{
+    ctrl[index] = value;
+    ctrl[((index - GROUP_WIDTH) & mask) + GROUP_WIDTH] = value;
+}
+
+static inline void group_initCtrl(int8_t *ctrl, unsigned slots)
+{
+    memset(ctrl, (uint8_t)CTRL_EMPTY, slots + GROUP_WIDTH);
+}
+
+struct group_probe {
+    unsigned mask;
+    unsigned offset;
+    unsigned step;
+
+    group_probe(uintptr_t h1, unsigned newMask)
+        : mask(newMask), offset((unsigned)h1 & newMask), step(0) { }
+
+    unsigned slot(unsigned i) const { return (offset + i) & mask; }
+
+    void next() {
+        step += GROUP_WIDTH;
+        offset = (offset + step) & mask;
+    }
+};
+
+// Last full slot before index, or -1. Iteration runs downwards a group 
+// at a time, so empty stretches cost no branch per slot.
+static inline int group_prevFull(const int8_t *ctrl, int index)
+{
+    while (index > 0) {
+        int base = (index > GROUP_WIDTH) ? index - GROUP_WIDTH : 0;
+        uint64_t full = group_matchFull(ctrl + base) & group_below(index - base);
+        if (full) return base + (int)group_last(full);
+        index = base;
+    }
+    return -1;
+}
+
+// First empty or deleted slot in the probe sequence for mixed.
+static inline unsigned group_findInsertSlot(const int8_t *ctrl,
+                                            unsigned mask, uintptr_t mixed)
+{
+    group_probe probe(group_h1(mixed), mask);
+    while (true) {
+        uint64_t candidates = group_matchEmptyOrDeleted(ctrl + probe.offset);
+        if (candidates) return probe.slot(group_first(candidates));
+        probe.next();
+    }
+}
+
+#endif
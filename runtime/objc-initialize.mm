@@ -177,7 +177,7 @@
 // classInitLock 保护 CLS_INITIALIZED 和 CLS_INITIALIZING
 // 并且会在所有的类都完成 initializing 后被 signal
 // 线程们等待一个类完成 initializing，就是在 wait 这个锁(条件变量)
-static monitor_t classInitLock;
+monitor_t classInitLock;
 
 
 /***********************************************************************
@@ -441,6 +441,9 @@ OBJC_EXPORT id objc_alloc(Class cls)
 OBJC_EXPORT id objc_allocWithZone(Class cls)
     __OSX_AVAILABLE_STARTING(__MAC_10_9, __IPHONE_7_0);
 
+OBJC_EXPORT id objc_alloc_init(Class cls)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
 OBJC_EXPORT id objc_retain(id obj)
     __asm__("_objc_retain")
     __OSX_AVAILABLE_STARTING(__MAC_10_7, __IPHONE_5_0);
@@ -532,12 +535,239 @@ void
 objc_moveWeak(id *to, id *from) 
     __OSX_AVAILABLE_STARTING(__MAC_10_7, __IPHONE_5_0);
 
+// objc_moveWeak() or objc_copyWeak() on count pairs of weak variables, 
+// locking each side table once rather than once or twice per pair. 
+// For resizing weak-holding collections. The ranges must not overlap.
+OBJC_EXPORT
+void 
+objc_moveWeakBatch(id *to, id *from, size_t count) 
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+OBJC_EXPORT
+void 
+objc_copyWeakBatch(id *to, id *from, size_t count) 
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+// Raw-value associations.
+// Associates up to OBJC_ASSOCIATED_VALUE_MAX bytes with object under key, 
+// stored inline in the association table: no boxing object, and no 
+// retain or release on set, get, or when the object is deallocated.
+// A key holds either an object from objc_setAssociatedObject() or a 
+// raw value. Pass NULL or size 0 to remove the value.
+// There is no association policy: the bytes are never retained or 
+// copied by message, and sets and gets copy them under the association 
+// lock, so a get never sees a partially written value.
+#define OBJC_ASSOCIATED_VALUE_MAX 16
+
+// Returns NO if size is too big or object is garbage-collected.
+OBJC_EXPORT
+BOOL 
+objc_setAssociatedValue(id object, const void *key, 
+                        const void *value, size_t size)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+// Copies at most size bytes of the value into outValue. 
+// Returns the stored value's size, or 0 if key has no raw value.
+OBJC_EXPORT
+size_t 
+objc_getAssociatedValue(id object, const void *key, 
+                        void *outValue, size_t size)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
 
 OBJC_EXPORT
 void
 _objc_autoreleasePoolPrint(void)
     __OSX_AVAILABLE_STARTING(__MAC_10_7, __IPHONE_5_0);
 
+// Autorelease pool statistics. 
+// Recorded only when OBJC_RECORD_POOL_STATISTICS or 
+// OBJC_PRINT_POOL_STATISTICS is set in the environment.
+#define OBJC_POOL_STATISTICS_BUCKETS 24
+typedef struct {
+    uint64_t thread;       // pthread_threadid_np(), or 0 for exited threads
+    uint64_t threadCount;  // number of threads combined in this record
+    uint64_t pushes;
+    uint64_t pops;
+    uint64_t depth;        // pools currently in place
+    uint64_t pages;        // pool pages currently allocated
+    uint64_t pending;      // autoreleases not yet released
+    uint64_t highWater;    // largest value of pending so far
+    // Histogram of objects released per pop. Bucket 0 counts pops that 
+    // released nothing; bucket i counts pops that released 2^(i-1) to 
+    // 2^i - 1 objects. The last bucket also counts everything larger.
+    uint64_t releasesPerPop[OBJC_POOL_STATISTICS_BUCKETS];
+} objc_autoreleasePoolStatistics;
+
+// Statistics for the calling thread. Returns NO if not recording.
+OBJC_EXPORT
+BOOL
+_objc_autoreleasePoolGetStatistics(objc_autoreleasePoolStatistics *outStats)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+// Statistics for every live thread, followed by one record that combines 
+// all exited threads. Values for other threads are a racy snapshot.
+// Returns NULL if not recording. The caller must free() the result.
+OBJC_EXPORT
+objc_autoreleasePoolStatistics *
+_objc_autoreleasePoolCopyStatistics(unsigned int *outCount)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+// @synchronized statistics, per locked object's class and caller of 
+// objc_sync_enter(). Recorded only when OBJC_RECORD_SYNC_STATISTICS or 
+// OBJC_PRINT_SYNC_STATISTICS is set in the environment. 
+// Times are in mach_absolute_time() units.
+typedef struct {
+    Class cls;             // nil for the record collecting table overflow
+    const void *caller;
+    uint64_t acquisitions;
+    uint64_t contended;    // acquisitions that had to wait for another thread
+    uint64_t waitTime;     // total time spent waiting
+    uint64_t maxHoldTime;  // longest time from outermost enter to exit
+} objc_syncStatistics;
+
+// Every record, sorted by waitTime, longest first. 
+// Returns NULL if not recording. The caller must free() the result.
+OBJC_EXPORT
+objc_syncStatistics *
+_objc_syncCopyStatistics(unsigned int *outCount)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+typedef struct {
+    uint32_t length;       // SyncData monitors in this stripe
+    uint32_t inUse;        // monitors currently used by some thread
+    uint32_t maxLength;    // largest length so far
+} objc_syncListStatistics;
+
+// Monitor list lengths for each stripe of the @synchronized table. 
+// Available whether or not statistics are recorded. 
+// The caller must free() the result.
+OBJC_EXPORT
+objc_syncListStatistics *
+_objc_syncCopyListStatistics(unsigned int *outCount)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+// Runtime lock profiles. 
+// Recorded only when OBJC_PROFILE_LOCKS is set in the environment, 
+// for runtimeLock, selLock, cacheUpdateLock, loadMethodLock and 
+// classInitLock (and the old runtime's classLock and methodListLock).
+#define OBJC_LOCK_PROFILE_BUCKETS 32
+typedef struct {
+    const char *name;
+    uint64_t acquisitions;
+    uint64_t contended;     // acquisitions that had to block
+    uint64_t waitTime;      // nanoseconds spent blocked
+    uint64_t holdTime;      // nanoseconds held, outermost holds only
+    // Histograms in nanoseconds. Bucket 0 counts 0 ns; bucket i counts 
+    // 2^(i-1) to 2^i - 1 ns. The last bucket also counts everything larger.
+    uint64_t waitHistogram[OBJC_LOCK_PROFILE_BUCKETS];  // contended only
+    uint64_t holdHistogram[OBJC_LOCK_PROFILE_BUCKETS];
+} objc_lockProfile;
+
+// One record per profiled lock, combining every thread. 
+// Returns NULL if not profiling. The caller must free() the result.
+OBJC_EXPORT
+objc_lockProfile *
+_objc_copyLockProfiles(unsigned int *outCount)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+#if __OBJC2__
+// Asynchronous deallocation.
+// Instances of cls and its subclasses run C++ destructors (including 
+// ARC ivar cleanup), lose their associated objects and weak references, 
+// and are freed on a background thread. Weak references to them read nil 
+// once the releasing thread returns from -dealloc. If the queue is full, 
+// the releasing thread disposes of the object itself.
+OBJC_EXPORT void _class_setDeallocatesAsynchronously(Class cls)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+typedef struct {
+    size_t depth;        // objects waiting to be freed
+    size_t maxDepth;     // largest value of depth so far
+    uint64_t enqueued;   // objects handed to the background thread
+    uint64_t throttled;  // objects freed inline because the queue was full
+} objc_asyncDeallocStatistics;
+
+OBJC_EXPORT void _objc_getAsyncDeallocStatistics(objc_asyncDeallocStatistics *outStats)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+// Block until every object queued so far has been freed.
+OBJC_EXPORT void _objc_waitForAsyncDealloc(void)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+#endif
+
+// Weak cells.
+// Every weak variable pointing to an instance of a class opted in with 
+// _class_setUsesWeakCells() refers to one shared, refcounted cell, 
+// so deallocating an object with many weak referrers clears one cell 
+// instead of every variable. Such weak variables must only be accessed 
+// with the objc_*Weak() functions.
+#if __OBJC2__
+OBJC_EXPORT void _class_setUsesWeakCells(Class cls)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+#endif
+
+// Slab allocator.
+// Small instances of classes opted in with _class_setUsesSlabAllocator() 
+// (or of every class, with OBJC_USE_SLAB_ALLOCATOR) are carved from 
+// per-size-class slabs through per-thread magazines. malloc_size() and 
+// free() still work on them.
+typedef struct {
+    size_t blockSize;   // bytes per block in this size class
+    size_t chunks;      // slab chunks carved for this size class
+    size_t capacity;    // blocks carved from those chunks
+    size_t inUse;       // blocks holding live instances
+    size_t cached;      // free blocks held in thread magazines
+    size_t free;        // free blocks in the shared depot
+    uint64_t refills;   // batches of blocks taken from the depot
+    uint64_t flushes;   // batches of blocks returned to the depot
+} objc_slabStatistics;
+
+#if __OBJC2__
+OBJC_EXPORT void _class_setUsesSlabAllocator(Class cls)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+#endif
+
+// Statistics of the size class that blocks of size bytes come from. 
+// They cover every class whose instances fall in that size class. 
+// Returns NO if size is 0 or too big for the slab allocator.
+OBJC_EXPORT BOOL _objc_slabGetStatisticsForSize(size_t size, objc_slabStatistics *outStats)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+// Fills in up to count size classes, smallest first. 
+// Returns the number of size classes.
+OBJC_EXPORT unsigned _objc_slabGetStatistics(objc_slabStatistics *outStats, unsigned count)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+// Arena zones.
+// A malloc zone that carves blocks from large arenas with a bump pointer. 
+// Pass it to allocWithZone:, class_createInstanceFromZone() or 
+// object_copyFromZone(); objects are freed normally. When the last live 
+// block is freed the zone rewinds and keeps only its first arena.
+// Don't destroy arena zones with malloc_destroy_zone() while objects 
+// in them are alive; use _objc_destroyArenaZoneWhenEmpty() instead.
+// A destroyed zone releases its arenas but keeps its small zone record, 
+// so concurrent free() calls that are still asking it stay safe.
+typedef struct {
+    size_t arenas;          // arenas currently mapped
+    size_t bytesReserved;   // bytes in those arenas
+    size_t liveObjects;     // blocks allocated and not yet freed
+    size_t liveBytes;       // bytes in those blocks
+    uint64_t allocations;   // blocks allocated
+    uint64_t frees;         // blocks freed
+    uint64_t rewinds;       // times the zone emptied and started over
+} objc_arenaZoneStatistics;
+
+// arenaSize 0 picks a default. Returns nil if arena zones are unsupported.
+OBJC_EXPORT void *_objc_createArenaZone(const char *name, size_t arenaSize)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+OBJC_EXPORT void _objc_destroyArenaZoneWhenEmpty(void *zone)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+OBJC_EXPORT BOOL _objc_getArenaZoneStatistics(void *zone, objc_arenaZoneStatistics *outStats)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
 OBJC_EXPORT BOOL objc_should_deallocate(id object)
     __OSX_AVAILABLE_STARTING(__MAC_10_7, __IPHONE_5_0);
 
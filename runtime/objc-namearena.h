@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2016 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/***********************************************************************
+* objc-namearena.h
+* Append-only storage for copied selector and class names.
+*
+* Copied names are appended to page-sized chunks that are never freed,
+* so names sit together without a malloc header apiece, and a lock-free
+* reader never touches a name freed by objc_disposeClassPair or an
+* image unload. A name too long to share a chunk gets its own
+* allocation, which is never freed either.
+*
+* Locking: the arena's spinlock guards the current chunk. It is a leaf.
+**********************************************************************/
+
+#ifndef _OBJC_NAMEARENA_H
+#define _OBJC_NAMEARENA_H
+
+// Copies name into the arena of never-freed names.
+extern const char *name_arena_copy(const char *name);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2016 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/***********************************************************************
+* objc-namearena.mm
+* The arena of copied names. See objc-namearena.h.
+**********************************************************************/
+
+#include "objc-private.h"
+#include "objc-namearena.h"
+
+#define NAME_ARENA_SIZE PAGE_MAX_SIZE
+#define NAME_ARENA_MAX_NAME (NAME_ARENA_SIZE / 8)
+
+static char *nameArenaNext;
+static char *nameArenaEnd;
+static spinlock_t nameArenaLock;
+
+const char *name_arena_copy(const char *name)
+{
+    size_t size = strlen(name) + 1;
+    if (size > NAME_ARENA_MAX_NAME) return strdup(name);
+
+    nameArenaLock.lock();
+    if ((size_t)(nameArenaEnd - nameArenaNext) < size) {
+        // The rest of the old chunk is abandoned.
+        nameArenaNext = (char *)malloc(NAME_ARENA_SIZE);
+        nameArenaEnd = nameArenaNext + NAME_ARENA_SIZE;
+    }
+    char *result = nameArenaNext;
+    nameArenaNext += size;
+    nameArenaLock.unlock();
+
+    memcpy(result, name, size);
+    return result;
+}
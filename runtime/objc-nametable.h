@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2016 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/***********************************************************************
+* objc-nametable.h
+* String-keyed tables that readers search without a lock. The selector 
+* table in objc-sel.mm is one: a SEL is the table's copy of its name. 
+* Selectors in the shared cache are found by search_builtins() before 
+* the table is consulted and never enter it. The name => class and 
+* name => protocol indexes in objc-runtime-new.mm are the others: they 
+* map names to values with get() and set().
+*
+* Open addressing with linear probing. An inserter claims an empty slot
+* by storing the name's hash with compare-and-swap, then stores the
+* slot's name, so a name is copied only by the thread that wins its
+* slot. Strings are compared only when the full 32-bit hash matches.
+* Readers depend on the address dependency from a slot's name to its
+* characters, as the method cache does for its buckets.
+*
+* Growth freezes the old table's empty slots so no insertion can land
+* behind the copy, copies it into a table twice the size, and publishes
+* the new table. Probes that reach a frozen slot retry in the new table.
+*
+* Nothing is ever reclaimed. Old tables are leaked because readers may
+* still be probing them. Copied names live in the arena of 
+* objc-namearena.h and are never freed either. A name whose value is 
+* set to nil keeps its slot and its copy; re-adding the name reuses 
+* both, but a program that keeps inventing new class names grows the 
+* table and the arena for good.
+*
+* Locking: each table's lock serializes creation, growth and value
+* stores. Lookups and name insertions take no lock. The lock is a leaf.
+**********************************************************************/
+
+#ifndef _OBJC_NAMETABLE_H
+#define _OBJC_NAMETABLE_H
+
+#include "objc-private.h"
+
+class NameTable : nocopy_t {
+    struct Slot {
+        volatile int32_t hash;
+        const char * volatile name;
+        void * volatile value;
+    };
+
+    struct Table {
+        uint32_t mask;
+        volatile int32_t occupied;
+        Slot *slots;
+    };
+
+    Table * volatile table;
+    mutex_t lock;
+    size_t expectedCount;
+
+    static Table *create(uint32_t capacity);
+    Table *current();
+    Slot *probe(Table *t, const char *name, uint32_t hash,
+                bool insert, bool copy, bool *outRetry);
+    Slot *find(const char *name, uint32_t hash,
+               bool insert, bool copy, Table **outTable);
+    void grow(Table *t);
+
+  public:
+    // Sizes the first table for count names. Call before any insertion.
+    void reserve(size_t count) { expectedCount = count; }
+
+    // The table's copy of name, or nil if name was never added.
+    const char *getName(const char *name);
+
+    // Adds name if it is absent. copy puts the table's copy of name
+    // in the name arena; otherwise the caller's string is kept and must
+    // never be freed. Returns the table's copy.
+    const char *addName(const char *name, bool copy);
+
+    // The value for name, or nil.
+    void *get(const char *name);
+
+    // Sets the value for name, adding a copy of name if needed.
+    // A nil value removes name from get() but keeps its slot.
+    void set(const char *name, void *value);
+};
+
+#endif
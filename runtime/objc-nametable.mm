@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2016 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/***********************************************************************
+* objc-nametable.mm
+* Lock-free string-keyed tables. See objc-nametable.h.
+**********************************************************************/
+
+#include "objc-private.h"
+#include "objc-nametable.h"
+#include "objc-namearena.h"
+
+// Slot hashes with special meaning. name_hash() never returns these.
+#define NAME_HASH_EMPTY  0
+#define NAME_HASH_FROZEN 1
+
+static uint32_t name_hash(const char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const uint8_t *s = (const uint8_t *)name; *s; s++) {
+        hash = (hash ^ *s) * 16777619u;
+    }
+    if (hash <= NAME_HASH_FROZEN) hash += 2;
+    return hash;
+}
+
+
+// capacity must be a power of two.
+NameTable::Table *NameTable::create(uint32_t capacity)
+{
+    Table *t = (Table *)calloc(1, sizeof(Table) + capacity * sizeof(Slot));
+    t->mask = capacity - 1;
+    t->slots = (Slot *)(t + 1);
+    return t;
+}
+
+NameTable::Table *NameTable::current()
+{
+    Table *t = table;
+    if (t) return t;
+
+    mutex_locker_t locker(lock);
+    if (!table) {
+        uint32_t capacity = 16;
+        while (capacity * 3 < expectedCount * 4) capacity *= 2;
+        t = create(capacity);
+        OSMemoryBarrier();
+        table = t;
+    }
+    return table;
+}
+
+// A claimed slot's name is stored right after the claim.
+static const char *name_table_slotName(const char * volatile *namep)
+{
+    const char *name;
+    while (!(name = *namep)) sched_yield();
+    return name;
+}
+
+
+/***********************************************************************
+* NameTable::probe
+* Look for name in t, inserting it if it is absent and insert is set.
+* copy copies the name into the arena. Returns the slot found or
+* inserted, or nil if absent.
+* Sets *outRetry if the answer is in a newer table: the probe reached
+* a frozen slot, or an insertion found the table full.
+**********************************************************************/
+NameTable::Slot *NameTable::probe(Table *t, const char *name, uint32_t hash,
+                                  bool insert, bool copy, bool *outRetry)
+{
+    *outRetry = false;
+
+    uint32_t mask = t->mask;
+    uint32_t index = hash & mask;
+    for (uint32_t probes = 0; probes <= mask; probes++) {
+        Slot *slot = &t->slots[index];
+        uint32_t slotHash = (uint32_t)slot->hash;
+        if (slotHash == NAME_HASH_EMPTY  &&  insert) {
+            if (OSAtomicCompareAndSwap32Barrier(NAME_HASH_EMPTY, (int32_t)hash,
+                                                &slot->hash))
+            {
+                const char *stored = copy ? name_arena_copy(name) : name;
+                // Publish the copied characters before the name.
+                OSMemoryBarrier();
+                slot->name = stored;
+                OSAtomicIncrement32Barrier(&t->occupied);
+                return slot;
+            }
+            slotHash = (uint32_t)slot->hash;
+        }
+
+        if (slotHash == NAME_HASH_EMPTY) return nil;
+        if (slotHash == NAME_HASH_FROZEN) {
+            *outRetry = true;
+            return nil;
+        }
+        if (slotHash == hash) {
+            const char *found = name_table_slotName(&slot->name);
+            if (0 == strcmp(name, found)) return slot;
+        }
+        index = (index + 1) & mask;
+    }
+
+    // Full. A lookup has seen every live entry.
+    *outRetry = insert;
+    return nil;
+}
+
+
+/***********************************************************************
+* NameTable::grow
+* Replace t with a table twice the size, unless it was already replaced.
+* Waits for a growth in progress.
+**********************************************************************/
+void NameTable::grow(Table *t)
+{
+    mutex_locker_t locker(lock);
+    if (t != table) return;
+
+    uint32_t capacity = t->mask + 1;
+    for (uint32_t i = 0; i < capacity; i++) {
+        OSAtomicCompareAndSwap32Barrier(NAME_HASH_EMPTY, NAME_HASH_FROZEN,
+                                        &t->slots[i].hash);
+    }
+
+    // Nobody else can see newTable yet.
+    Table *newTable = create(capacity * 2);
+    for (uint32_t i = 0; i < capacity; i++) {
+        Slot *slot = &t->slots[i];
+        uint32_t hash = (uint32_t)slot->hash;
+        if (hash == NAME_HASH_FROZEN) continue;
+
+        uint32_t index = hash & newTable->mask;
+        while (newTable->slots[index].hash != NAME_HASH_EMPTY) {
+            index = (index + 1) & newTable->mask;
+        }
+        Slot *dst = &newTable->slots[index];
+        dst->hash = (int32_t)hash;
+        dst->name = name_table_slotName(&slot->name);
+        // Values are stored with the lock held, so this one is final.
+        dst->value = slot->value;
+        newTable->occupied++;
+    }
+
+    OSMemoryBarrier();
+    table = newTable;
+}
+
+// Look up name, inserting it if it is absent and insert is set.
+// *outTable is the table holding the slot.
+NameTable::Slot *NameTable::find(const char *name, uint32_t hash,
+                                 bool insert, bool copy, Table **outTable)
+{
+    Table *t = current();
+    while (true) {
+        bool retry;
+        Slot *result = probe(t, name, hash, insert, copy, &retry);
+        if (!retry) {
+            if (insert  &&  (uint32_t)t->occupied * 4 > (t->mask + 1) * 3) {
+                // More than 3/4 full.
+                grow(t);
+            }
+            *outTable = t;
+            return result;
+        }
+
+        if (insert) {
+            grow(t);
+        } else {
+            // Wait for the growth that froze this table.
+            mutex_locker_t locker(lock);
+        }
+        t = table;
+    }
+}
+
+
+const char *NameTable::getName(const char *name)
+{
+    Table *t;
+    Slot *slot = find(name, name_hash(name), NO, NO, &t);
+    return slot ? slot->name : nil;
+}
+
+const char *NameTable::addName(const char *name, bool copy)
+{
+    uint32_t hash = name_hash(name);
+    Table *t;
+    Slot *slot = find(name, hash, NO, NO, &t);
+    if (!slot) slot = find(name, hash, YES, copy, &t);
+    return slot->name;
+}
+
+void *NameTable::get(const char *name)
+{
+    Table *t;
+    Slot *slot = find(name, name_hash(name), NO, NO, &t);
+    return slot ? slot->value : nil;
+}
+
+
+/***********************************************************************
+* NameTable::set
+* Stores the value in the slot of the current table. A growth that
+* copied the slot first makes the store retry in the new table.
+**********************************************************************/
+void NameTable::set(const char *name, void *value)
+{
+    uint32_t hash = name_hash(name);
+    while (true) {
+        Table *t;
+        Slot *slot = find(name, hash, value != nil, YES, &t);
+        if (!slot) return;
+
+        mutex_locker_t locker(lock);
+        if (t != table) continue;
+        // Publish the value's contents before the pointer to it.
+        OSMemoryBarrier();
+        slot->value = value;
+        return;
+    }
+}
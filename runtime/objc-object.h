@@ -41,7 +41,21 @@ enum ReturnDisposition : bool {
 };
 
 static ALWAYS_INLINE 
-bool prepareOptimizedReturn(ReturnDisposition disposition);
+bool prepareOptimizedReturn(ReturnDisposition disposition, id obj);
+
+// True if optimized returns use the thread-local handshake 
+// instead of inspecting the caller's instructions.
+static ALWAYS_INLINE bool 
+returnHandshakeEnabled()
+{
+#if !SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+    return false;
+#elif RETURN_AUTORELEASE_HANDSHAKE_ONLY
+    return true;
+#else
+    return UseReturnHandshake;
+#endif
+}
 
 
 #if SUPPORT_TAGGED_POINTERS
@@ -411,7 +425,7 @@ objc_object::rootDealloc()
         // 就直接 free 掉对象的内存
         // 真粗暴😂😂😂，难怪说可以大幅度提高效率
         assert(!sidetable_present());
-        free(this);
+        _objc_freeInstance(this);
     } 
     else {
         // object_dispose 中会做调用c++析构器、清除关联对象、清除弱引用、释放内存等等工作，把对象安全彻底的干掉
@@ -785,7 +799,13 @@ objc_object::rootAutorelease()
 
     if (isTaggedPointer()) return (id)this;
     // 检测是否支持 Optimized Return（不知道干嘛用的）
-    if (prepareOptimizedReturn(ReturnAtPlus1)) return (id)this;
+    // The handshake parks only objc_autoreleaseReturnValue() results. 
+    // A parked object is flushed through here, so it must not park again.
+    if (!returnHandshakeEnabled()  &&  
+        prepareOptimizedReturn(ReturnAtPlus1, (id)this)) 
+    {
+        return (id)this;
+    }
 
     // rootAutorelease2 里的操作是，将当前对象添加进了当前的 autoreleasepage 中
     return rootAutorelease2();
@@ -1098,7 +1118,13 @@ objc_object::rootAutorelease()
 
     if (isTaggedPointer()) return (id)this;
     // Optimized adj.最佳的，准备最佳的返回，看不懂什么鬼
-    if (prepareOptimizedReturn(ReturnAtPlus1)) return (id)this;
+    // The handshake parks only objc_autoreleaseReturnValue() results. 
+    // A parked object is flushed through here, so it must not park again.
+    if (!returnHandshakeEnabled()  &&  
+        prepareOptimizedReturn(ReturnAtPlus1, (id)this)) 
+    {
+        return (id)this;
+    }
 
     return rootAutorelease2();
 }
@@ -1189,6 +1215,22 @@ objc_object::rootRetainCount()
   Tagged pointer objects do participate in the optimized return scheme, 
   because it saves message sends. They are not entered in the autorelease 
   pool in the unoptimized case.
+
+  The handshake replaces the instruction check with one that needs no 
+  knowledge of the caller's code. It is always used where the caller's 
+  instructions can't be checked (RETURN_AUTORELEASE_HANDSHAKE_ONLY), 
+  and elsewhere when OBJC_USE_RETURN_HANDSHAKE is set:
+    The callee parks the result at +1 in thread-local storage instead of 
+      autoreleasing it, along with the return address of the call that 
+      parked it. Any previously parked object is autoreleased first.
+    An optimized caller claims the result if it is the parked object 
+      and the claim is called from just after the call that parked it, 
+      taking over the +1 without a retain. A stale parked object that 
+      reaches any other claim site is retained as usual instead.
+    Anything that depends on autorelease pool order autoreleases the 
+      parked object first: pool push, pool pop, and thread exit. 
+      An unclaimed result therefore lands in the same pool it would 
+      have without the optimization.
 **********************************************************************/
 
 /*
@@ -1214,7 +1256,18 @@ objc_object::rootRetainCount()
   ARC 提出了巧妙的运行时优化方案来跳过 autorelease 机制。这个过程是这样的：当方法的调用方和实现方的代码都是基于 ARC 实现的时候，在方法 return 的时候，ARC 会调用 objc_autoreleaseReturnValue() 替代前面说的 autorelease。在调用方持有方法返回对象的时候（也就是做 retain 的时候），ARC 会调用 objc_retainAutoreleasedReturnValue()。在调用 objc_autoreleaseReturnValue() 时，它会在栈上查询 return address 来确定 return value 是否会被传给 objc_retainAutoreleasedReturnValue()。如果没传，那么它就会走前文所讲的 autorelease 的过程。如果传了（这表明返回值能顺利从提供方交接给接收方），那么它就跳过 autorelease 并同时修改 return address 来跳过 objc_retainAutoreleasedReturnValue()，从而一举消除了 autorelease 和 retain 的过程。这个方案可以在 MRC-to-ARC 调用、ARC-to-ARC 调用以及 ARC-to-MRC 调用中正确工作，并在符合条件的一些 ARC-to-ARC 调用中消除 autorelease 机制。
 */
     
-# if __x86_64__
+# if RETURN_AUTORELEASE_HANDSHAKE_ONLY
+
+// No instruction check. See parkReturnValue() below.
+
+static ALWAYS_INLINE bool 
+callerAcceptsOptimizedReturn(const void *ra __unused)
+{
+    return false;
+}
+
+// RETURN_AUTORELEASE_HANDSHAKE_ONLY
+# elif __x86_64__
 
 static ALWAYS_INLINE bool 
 callerAcceptsOptimizedReturn(const void * const ra0)
@@ -1340,11 +1393,11 @@ setReturnDisposition(ReturnDisposition disposition)
 // 准备优化返回值，如果成功了就返回true
 // 失败的话，就返回false，返回值就只能按原来的套路 - autorelease 防止对象在调用方拿到返回值前就被释放
 static ALWAYS_INLINE bool 
-prepareOptimizedReturn(ReturnDisposition disposition)
+prepareCallerReturn(ReturnDisposition disposition, const void *ra)
 {
     assert(getReturnDisposition() == ReturnAtPlus0);
 
-    if (callerAcceptsOptimizedReturn(__builtin_return_address(0))) {
+    if (callerAcceptsOptimizedReturn(ra)) {
         if (disposition) {
             setReturnDisposition(disposition);
         }
@@ -1359,7 +1412,7 @@ prepareOptimizedReturn(ReturnDisposition disposition)
 // Returns the disposition of the returned object (+0 or +1).
 // An un-optimized return is +0.
 static ALWAYS_INLINE ReturnDisposition 
-acceptOptimizedReturn()
+acceptCallerReturn()
 {
     ReturnDisposition disposition = getReturnDisposition();
     setReturnDisposition(ReturnAtPlus0);  // reset to the unoptimized state
@@ -1367,20 +1420,142 @@ acceptOptimizedReturn()
 }
 
 
+# if SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+
+// RETURN_DISPOSITION_KEY holds the parked object itself, or nil.
+// RETURN_CALLER_KEY holds the return address of the objc_*ReturnValue 
+// entry point that parked it. The callee tail-calls that entry point, 
+// so this is the address just after the caller's call to the callee. 
+// The caller's claim follows within a few instructions: a register move 
+// or marker nop and the call to the claiming entry point. 
+// Anywhere else, the parked object was left over by some other call.
+#define RETURN_CLAIM_WINDOW 16
+
+static ALWAYS_INLINE id 
+getParkedReturnValue()
+{
+    id obj = (id)tls_get_direct(RETURN_DISPOSITION_KEY);
+    // A leftover disposition from the instruction check is not an object.
+    if ((uintptr_t)obj <= (uintptr_t)ReturnAtPlus1) return nil;
+    return obj;
+}
+
+
+static ALWAYS_INLINE void 
+setParkedReturnValue(id obj)
+{
+    tls_set_direct(RETURN_DISPOSITION_KEY, (void*)obj);
+}
+
+
+// Autorelease any parked object that nobody claimed. 
+// Called before anything that depends on autorelease pool order.
+static ALWAYS_INLINE void 
+flushParkedReturn()
+{
+    if (id obj = getParkedReturnValue()) {
+        setParkedReturnValue(nil);
+        objc_autorelease(obj);
+    }
+}
+
+
+// Park obj for the caller at ra to claim. Always succeeds.
+// A result at +0 is retained so the parked object is always +1.
+static ALWAYS_INLINE bool 
+parkReturnValue(ReturnDisposition disposition, id obj, const void *ra)
+{
+    flushParkedReturn();
+    if (obj) {
+        if (disposition == ReturnAtPlus0) objc_retain(obj);
+        tls_set_direct(RETURN_CALLER_KEY, (void *)ra);
+        setParkedReturnValue(obj);
+    }
+    return true;
+}
+
+
+// Claim obj for the claim call returning to ra if it is the parked 
+// object and was parked by the call just before it.
+// Returns the disposition of the returned object (+0 or +1).
+// An unclaimed return is +0.
+static ALWAYS_INLINE ReturnDisposition 
+claimParkedReturn(id obj, const void *ra)
+{
+    if (!obj  ||  getParkedReturnValue() != obj) return ReturnAtPlus0;
+
+    uintptr_t parkedRA = (uintptr_t)tls_get_direct(RETURN_CALLER_KEY);
+    uintptr_t distance = (uintptr_t)ra - parkedRA;
+    if (distance == 0  ||  distance > RETURN_CLAIM_WINDOW) {
+        return ReturnAtPlus0;
+    }
+
+    setParkedReturnValue(nil);
+    return ReturnAtPlus1;
+}
+
+// SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+# endif
+
+
+// Autorelease any parked return value that nobody claimed.
+static ALWAYS_INLINE void 
+flushOptimizedReturn()
+{
+# if SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+    if (returnHandshakeEnabled()) flushParkedReturn();
+# endif
+}
+
+
+// Only meaningful when inlined into an objc_*ReturnValue entry point, 
+// whose return address is the one that matters.
+static ALWAYS_INLINE bool 
+prepareOptimizedReturn(ReturnDisposition disposition, id obj __unused)
+{
+# if SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+    if (returnHandshakeEnabled()) {
+        return parkReturnValue(disposition, obj, __builtin_return_address(0));
+    }
+# endif
+    return prepareCallerReturn(disposition, __builtin_return_address(0));
+}
+
+
+// Only meaningful when inlined into an objc_*ReturnValue entry point.
+static ALWAYS_INLINE ReturnDisposition 
+acceptOptimizedReturn(id obj __unused)
+{
+# if SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+    if (returnHandshakeEnabled()) {
+        return claimParkedReturn(obj, __builtin_return_address(0));
+    }
+# endif
+    return acceptCallerReturn();
+}
+
+
 // SUPPORT_RETURN_AUTORELEASE
 #else
 // not SUPPORT_RETURN_AUTORELEASE
 
 
+static ALWAYS_INLINE void 
+flushOptimizedReturn()
+{
+}
+
+
 static ALWAYS_INLINE bool
-prepareOptimizedReturn(ReturnDisposition disposition __unused)
+prepareOptimizedReturn(ReturnDisposition disposition __unused, 
+                       id obj __unused)
 {
     return false;
 }
 
 
 static ALWAYS_INLINE ReturnDisposition 
-acceptOptimizedReturn()
+acceptOptimizedReturn(id obj __unused)
 {
     return ReturnAtPlus0;
 }
@@ -412,6 +412,9 @@ extern void _objc_fatal(const char *fmt, ...) __attribute__((noreturn, format (p
 # if SUPPORT_QOS_HACK
 #   define QOS_KEY               ((tls_key_t)__PTK_FRAMEWORK_OBJC_KEY5)
 # endif
+# if SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+#   define RETURN_CALLER_KEY     ((tls_key_t)__PTK_FRAMEWORK_OBJC_KEY6)
+# endif
 #else
 #   define SUPPORT_DIRECT_THREAD_KEYS 0
 #endif
@@ -442,6 +445,7 @@ static __inline void *malloc_zone_calloc(malloc_zone_t z, size_t size, size_t co
 static __inline void *malloc_zone_realloc(malloc_zone_t z, void *p, size_t size) { return realloc(p, size); }
 static __inline void malloc_zone_free(malloc_zone_t z, void *p) { free(p); }
 static __inline malloc_zone_t malloc_zone_from_ptr(const void *p) { return (malloc_zone_t)-1; }
+static __inline unsigned malloc_zone_batch_malloc(malloc_zone_t z, size_t size, void **results, unsigned num) { unsigned i; for (i = 0; i < num; i++) { if (!(results[i] = malloc(size))) break; } return i; }
 static __inline size_t malloc_size(const void *p) { return _msize((void*)p); /* fixme invalid pointer check? */ }
 
 
@@ -722,6 +726,9 @@ static bool is_valid_direct_key(tls_key_t k) {
 #   endif
 #   if SUPPORT_QOS_HACK
             || k == QOS_KEY
+#   endif
+#   if SUPPORT_RETURN_AUTORELEASE_HANDSHAKE
+            || k == RETURN_CALLER_KEY
 #   endif
                );
 }
@@ -836,20 +843,39 @@ template <bool Debug> class recursive_mutex_tt;
 
 #include "objc-lockdebug.h"
 
+// Lock profiling (OBJC_PROFILE_LOCKS), implemented in objc-os.mm.
+// A lock given a name with setProfileName() records acquisitions, 
+// waits and holds in per-thread counters. waitStart is the 
+// nanoseconds() value before blocking, or 0 for an acquisition that 
+// did not block. Other locks test one nil pointer.
+struct lockprofile_t;
+extern lockprofile_t *lockprofile_create(const char *name);
+extern void lockprofile_acquire(lockprofile_t *profile, uint64_t waitStart);
+extern void lockprofile_release(lockprofile_t *profile);
+
 // 互斥量，也继承自 nocopy_t ，没有拷贝构造
 template <bool Debug>
 class mutex_tt : nocopy_t {
     pthread_mutex_t mLock;  // 原理还是利用 pthread_mutex_t 来完成互斥量的操作
+    lockprofile_t *mProfile;
 
   public:
-    mutex_tt() : mLock((pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER) { }
+    mutex_tt() : mLock((pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER), mProfile(nil) { }
+
+    void setProfileName(const char *name) { mProfile = lockprofile_create(name); }
 
     void lock()
     {
         lockdebug_mutex_lock(this);
 
+        if (mProfile  &&  pthread_mutex_trylock(&mLock) == 0) {
+            lockprofile_acquire(mProfile, 0);
+            return;
+        }
+        uint64_t waitStart = mProfile ? nanoseconds() : 0;
         int err = pthread_mutex_lock(&mLock);
         if (err) _objc_fatal("pthread_mutex_lock failed (%d)", err);
+        if (mProfile) lockprofile_acquire(mProfile, waitStart);
     }
 
     bool tryLock()
@@ -857,6 +883,7 @@ class mutex_tt : nocopy_t {
         int err = pthread_mutex_trylock(&mLock);
         if (err == 0) {
             lockdebug_mutex_try_lock_success(this);
+            if (mProfile) lockprofile_acquire(mProfile, 0);
             return true;
         } else if (err == EBUSY) {
             return false;
@@ -869,6 +896,7 @@ class mutex_tt : nocopy_t {
     {
         lockdebug_mutex_unlock(this);
 
+        if (mProfile) lockprofile_release(mProfile);
         int err = pthread_mutex_unlock(&mLock);
         if (err) _objc_fatal("pthread_mutex_unlock failed (%d)", err);
     }
@@ -889,16 +917,25 @@ using mutex_t = mutex_tt<DEBUG>;
 template <bool Debug>
 class recursive_mutex_tt : nocopy_t {
     pthread_mutex_t mLock;
+    lockprofile_t *mProfile;
 
   public:
-    recursive_mutex_tt() : mLock((pthread_mutex_t)PTHREAD_RECURSIVE_MUTEX_INITIALIZER) { }
+    recursive_mutex_tt() : mLock((pthread_mutex_t)PTHREAD_RECURSIVE_MUTEX_INITIALIZER), mProfile(nil) { }
+
+    void setProfileName(const char *name) { mProfile = lockprofile_create(name); }
 
     void lock()
     {
         lockdebug_recursive_mutex_lock(this);
 
+        if (mProfile  &&  pthread_mutex_trylock(&mLock) == 0) {
+            lockprofile_acquire(mProfile, 0);
+            return;
+        }
+        uint64_t waitStart = mProfile ? nanoseconds() : 0;
         int err = pthread_mutex_lock(&mLock);
         if (err) _objc_fatal("pthread_mutex_lock failed (%d)", err);
+        if (mProfile) lockprofile_acquire(mProfile, waitStart);
     }
 
     bool tryLock()
@@ -906,6 +943,7 @@ class recursive_mutex_tt : nocopy_t {
         int err = pthread_mutex_trylock(&mLock);
         if (err == 0) {
             lockdebug_recursive_mutex_lock(this);
+            if (mProfile) lockprofile_acquire(mProfile, 0);
             return true;
         } else if (err == EBUSY) {
             return false;
@@ -919,6 +957,7 @@ class recursive_mutex_tt : nocopy_t {
     {
         lockdebug_recursive_mutex_unlock(this);
 
+        if (mProfile) lockprofile_release(mProfile);
         int err = pthread_mutex_unlock(&mLock);
         if (err) _objc_fatal("pthread_mutex_unlock failed (%d)", err);
     }
@@ -928,6 +967,7 @@ class recursive_mutex_tt : nocopy_t {
         int err = pthread_mutex_unlock(&mLock);
         if (err == 0) {
             lockdebug_recursive_mutex_unlock(this);
+            if (mProfile) lockprofile_release(mProfile);
             return true;
         } else if (err == EPERM) {
             return false;
@@ -1074,6 +1114,7 @@ template <bool Debug>
 class monitor_tt {
     pthread_mutex_t mutex;  // 互斥量，玩法就是 加锁、解锁
     pthread_cond_t cond;    // 条件变量
+    lockprofile_t *mProfile;
     
   public:
     
@@ -1084,21 +1125,30 @@ class monitor_tt {
           int pthread_cond_init(pthread_cond_t *cond, pthread_condattr_t *cond_attr)
      */
     monitor_tt()
-        : mutex((pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER), cond((pthread_cond_t)PTHREAD_COND_INITIALIZER) { }
+        : mutex((pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER), cond((pthread_cond_t)PTHREAD_COND_INITIALIZER), mProfile(nil) { }
+
+    void setProfileName(const char *name) { mProfile = lockprofile_create(name); }
 
     void enter()
     {
         lockdebug_monitor_enter(this);
 
+        if (mProfile  &&  pthread_mutex_trylock(&mutex) == 0) {
+            lockprofile_acquire(mProfile, 0);
+            return;
+        }
+        uint64_t waitStart = mProfile ? nanoseconds() : 0;
         // 互斥量加锁
         int err = pthread_mutex_lock(&mutex);
         if (err) _objc_fatal("pthread_mutex_lock failed (%d)", err);
+        if (mProfile) lockprofile_acquire(mProfile, waitStart);
     }
 
     void leave()
     {
         lockdebug_monitor_leave(this);
 
+        if (mProfile) lockprofile_release(mProfile);
         // 互斥量解锁
         int err = pthread_mutex_unlock(&mutex);
         if (err) _objc_fatal("pthread_mutex_unlock failed (%d)", err);
@@ -1109,8 +1159,11 @@ class monitor_tt {
         lockdebug_monitor_wait(this);
 
         // 自动解锁互斥量(如同执行了 pthread_unlock_mutex)，并等待条件变量触发。这时线程挂起，不占用 CPU 时间，直到条件变量被触发。在调用 pthread_cond_wait 之前，应用程序必须加锁互斥量。pthread_cond_wait 函数返回前，自动重新对互斥量加锁(如同执行了 pthread_lock_mutex)。
+        // A profiled monitor counts each wakeup as a new acquisition.
+        if (mProfile) lockprofile_release(mProfile);
         int err = pthread_cond_wait(&cond, &mutex);
         if (err) _objc_fatal("pthread_cond_wait failed (%d)", err);
+        if (mProfile) lockprofile_acquire(mProfile, 0);
     }
 
     void notify() 
@@ -1216,25 +1269,35 @@ static inline void qosEndOverride() { }
 template <bool Debug>
 class rwlock_tt : nocopy_t {
     pthread_rwlock_t mLock = PTHREAD_RWLOCK_INITIALIZER;
+    lockprofile_t *mProfile = nil;
 
   public:
     
     rwlock_tt() {
     }
+
+    void setProfileName(const char *name) { mProfile = lockprofile_create(name); }
     
     void read() 
     {
         lockdebug_rwlock_read(this);
 
         qosStartOverride();
+        if (mProfile  &&  pthread_rwlock_tryrdlock(&mLock) == 0) {
+            lockprofile_acquire(mProfile, 0);
+            return;
+        }
+        uint64_t waitStart = mProfile ? nanoseconds() : 0;
         int err = pthread_rwlock_rdlock(&mLock);
         if (err) _objc_fatal("pthread_rwlock_rdlock failed (%d)", err);
+        if (mProfile) lockprofile_acquire(mProfile, waitStart);
     }
 
     void unlockRead()
     {
         lockdebug_rwlock_unlock_read(this);
 
+        if (mProfile) lockprofile_release(mProfile);
         int err = pthread_rwlock_unlock(&mLock);
         if (err) _objc_fatal("pthread_rwlock_unlock failed (%d)", err);
         qosEndOverride();
@@ -1246,6 +1309,7 @@ class rwlock_tt : nocopy_t {
         int err = pthread_rwlock_tryrdlock(&mLock);
         if (err == 0) {
             lockdebug_rwlock_try_read_success(this);
+            if (mProfile) lockprofile_acquire(mProfile, 0);
             return true;
         } else if (err == EBUSY) {
             qosEndOverride();
@@ -1260,14 +1324,21 @@ class rwlock_tt : nocopy_t {
         lockdebug_rwlock_write(this);
 
         qosStartOverride();
+        if (mProfile  &&  pthread_rwlock_trywrlock(&mLock) == 0) {
+            lockprofile_acquire(mProfile, 0);
+            return;
+        }
+        uint64_t waitStart = mProfile ? nanoseconds() : 0;
         int err = pthread_rwlock_wrlock(&mLock);
         if (err) _objc_fatal("pthread_rwlock_wrlock failed (%d)", err);
+        if (mProfile) lockprofile_acquire(mProfile, waitStart);
     }
 
     void unlockWrite()
     {
         lockdebug_rwlock_unlock_write(this);
 
+        if (mProfile) lockprofile_release(mProfile);
         int err = pthread_rwlock_unlock(&mLock);
         if (err) _objc_fatal("pthread_rwlock_unlock failed (%d)", err);
         qosEndOverride();
@@ -1279,6 +1350,7 @@ class rwlock_tt : nocopy_t {
         int err = pthread_rwlock_trywrlock(&mLock);
         if (err == 0) {
             lockdebug_rwlock_try_write_success(this);
+            if (mProfile) lockprofile_acquire(mProfile, 0);
             return true;
         } else if (err == EBUSY) {
             qosEndOverride();
@@ -103,6 +103,7 @@ WINBOOL APIENTRY DllMain( HMODULE hModule,
         lock_init();
         sel_init(NO, 3500);  // old selector heuristic
         exception_init();
+        sync_init();
         break;
 
     case DLL_THREAD_ATTACH:
@@ -846,6 +847,7 @@ void _objc_init(void)
     static_init();
     lock_init();
     exception_init();
+    sync_init();
     
     // Register for unmap first, in case some +load unmaps something
     // 首先第一步，注册 unmap 函数，万一有的类的 +load 方法需要 unmap 一些东西
@@ -988,6 +990,187 @@ int secure_open(const char *filename, int flags, uid_t euid)
 }
 
 
+/***********************************************************************
+* Lock profiling
+* Enabled by OBJC_PROFILE_LOCKS for the locks named in lock_init(). 
+* Each thread counts into its own LockProfileThread without locking, 
+* and tracks its own hold depth and start time for each lock, so 
+* read holds of an rwlock are timed like exclusive ones. 
+* LockProfileLock guards the list of live records and the totals of 
+* threads that have exited. It is never profiled itself.
+**********************************************************************/
+
+#define LOCK_PROFILE_MAX 16
+
+struct lockprofile_t {
+    const char *name;
+    unsigned int index;
+};
+
+struct LockProfileThread {
+    LockProfileThread *next;
+    LockProfileThread **prevp;
+    uint64_t heldSince[LOCK_PROFILE_MAX];
+    uint32_t depth[LOCK_PROFILE_MAX];
+    objc_lockProfile counts[LOCK_PROFILE_MAX];
+};
+
+static lockprofile_t LockProfiles[LOCK_PROFILE_MAX];
+static unsigned int LockProfileCount;
+static mutex_t LockProfileLock;
+static LockProfileThread *LiveLockProfiles;
+static objc_lockProfile ExitedLockProfiles[LOCK_PROFILE_MAX];
+static mach_timebase_info_data_t LockProfileTimebase;
+
+// Called by lock_init() before other threads exist.
+lockprofile_t *lockprofile_create(const char *name)
+{
+    if (!ProfileLocks  ||  LockProfileCount == LOCK_PROFILE_MAX) return nil;
+    if (LockProfileCount == 0) mach_timebase_info(&LockProfileTimebase);
+
+    lockprofile_t *profile = &LockProfiles[LockProfileCount];
+    profile->name = name;
+    profile->index = LockProfileCount++;
+    return profile;
+}
+
+static LockProfileThread *lockProfileThread()
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(true);
+    if (!data) return nil;
+
+    LockProfileThread *thread = data->lockProfile;
+    if (!thread) {
+        thread = (LockProfileThread *)calloc(1, sizeof(LockProfileThread));
+
+        mutex_locker_t lock(LockProfileLock);
+        thread->next = LiveLockProfiles;
+        thread->prevp = &LiveLockProfiles;
+        if (LiveLockProfiles) LiveLockProfiles->prevp = &thread->next;
+        LiveLockProfiles = thread;
+
+        data->lockProfile = thread;
+    }
+    return thread;
+}
+
+static inline uint64_t lockProfileNanoseconds(uint64_t ticks)
+{
+    return ticks * LockProfileTimebase.numer / LockProfileTimebase.denom;
+}
+
+// Bucket 0 counts 0 ns; bucket i counts 2^(i-1) to 2^i - 1 ns.
+static unsigned lockProfileBucket(uint64_t ns)
+{
+    unsigned bucket = 0;
+    while (ns  &&  bucket < OBJC_LOCK_PROFILE_BUCKETS - 1) {
+        ns >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void lockprofile_acquire(lockprofile_t *profile, uint64_t waitStart)
+{
+    LockProfileThread *thread = lockProfileThread();
+    if (!thread) return;
+
+    unsigned int i = profile->index;
+    objc_lockProfile& counts = thread->counts[i];
+    uint64_t now = nanoseconds();
+    counts.acquisitions++;
+    if (waitStart) {
+        uint64_t wait = lockProfileNanoseconds(now - waitStart);
+        counts.contended++;
+        counts.waitTime += wait;
+        counts.waitHistogram[lockProfileBucket(wait)]++;
+    }
+    if (thread->depth[i]++ == 0) thread->heldSince[i] = now;
+}
+
+void lockprofile_release(lockprofile_t *profile)
+{
+    LockProfileThread *thread = lockProfileThread();
+    if (!thread) return;
+
+    unsigned int i = profile->index;
+    // Held since before this thread's record existed.
+    if (thread->depth[i] == 0) return;
+    if (--thread->depth[i] == 0) {
+        objc_lockProfile& counts = thread->counts[i];
+        uint64_t hold = 
+            lockProfileNanoseconds(nanoseconds() - thread->heldSince[i]);
+        counts.holdTime += hold;
+        counts.holdHistogram[lockProfileBucket(hold)]++;
+    }
+}
+
+static void lockProfileAccumulate(objc_lockProfile& dst, 
+                                  const objc_lockProfile& src)
+{
+    dst.acquisitions += src.acquisitions;
+    dst.contended += src.contended;
+    dst.waitTime += src.waitTime;
+    dst.holdTime += src.holdTime;
+    for (unsigned i = 0; i < OBJC_LOCK_PROFILE_BUCKETS; i++) {
+        dst.waitHistogram[i] += src.waitHistogram[i];
+        dst.holdHistogram[i] += src.holdHistogram[i];
+    }
+}
+
+/***********************************************************************
+* _destroyLockProfile
+* Fold an exiting thread's counts into the exited-thread totals.
+* The thread forgets its record first, so nothing that runs later 
+* can count into a record that has been freed.
+**********************************************************************/
+void _destroyLockProfile(_objc_pthread_data *data)
+{
+    LockProfileThread *thread = data->lockProfile;
+    if (!thread) return;
+    data->lockProfile = nil;
+
+    mutex_locker_t lock(LockProfileLock);
+    *thread->prevp = thread->next;
+    if (thread->next) thread->next->prevp = thread->prevp;
+    for (unsigned int i = 0; i < LockProfileCount; i++) {
+        lockProfileAccumulate(ExitedLockProfiles[i], thread->counts[i]);
+    }
+
+    free(thread);
+}
+
+/***********************************************************************
+* _objc_copyLockProfiles
+* Totals for each profiled lock over every thread, live or exited. 
+* Counts of other live threads are a racy snapshot.
+**********************************************************************/
+objc_lockProfile *_objc_copyLockProfiles(unsigned int *outCount)
+{
+    if (outCount) *outCount = 0;
+    if (LockProfileCount == 0) return nil;
+
+    objc_lockProfile *result = (objc_lockProfile *)
+        malloc(LockProfileCount * sizeof(objc_lockProfile));
+    {
+        mutex_locker_t lock(LockProfileLock);
+        for (unsigned int i = 0; i < LockProfileCount; i++) {
+            result[i] = ExitedLockProfiles[i];
+            for (LockProfileThread *thread = LiveLockProfiles; 
+                 thread; 
+                 thread = thread->next)
+            {
+                lockProfileAccumulate(result[i], thread->counts[i]);
+            }
+            result[i].name = LockProfiles[i].name;
+        }
+    }
+
+    if (outCount) *outCount = LockProfileCount;
+    return result;
+}
+
+
 bool crashlog_header_name(header_info *hi)
 {
     return crashlog_header_name_string(hi ? hi->fname : NULL);
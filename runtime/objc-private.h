@@ -206,6 +206,7 @@ public:
     id   rootAutorelease();
     bool rootTryRetain();
     bool rootReleaseShouldDealloc();
+    bool rootReleaseMany(size_t count);
     uintptr_t rootRetainCount(); // 取得引用计数？
 
     // Implementation of dealloc methods
@@ -264,6 +265,7 @@ private:
 
     uintptr_t sidetable_release(bool performDealloc = true);
     uintptr_t sidetable_release_slow(SideTable& table, bool performDealloc = true);
+    bool sidetable_releaseMany(size_t count);
 
     bool sidetable_tryRetain();
 
@@ -516,6 +518,9 @@ extern Class _calloc_class(size_t size);
 // 但是如果没有找到的话，返回nil，而不是 _objc_msgForward_impcache，即不会进行消息转发
 // 实现在 objc-runtime-new.mm 文件中
 extern IMP lookUpImpOrNil(Class, SEL, id obj, bool initialize, bool cache, bool resolver);
+#if __OBJC2__
+extern IMP lookUpBaseImpOrNil(Class cls, SEL sel);
+#endif
 
 /***********************************************************************
  * lookUpImpOrForward.
@@ -624,6 +629,7 @@ extern void lock_init(void);
 extern rwlock_t selLock;
 extern mutex_t cacheUpdateLock; // 用户方法缓存更新时的互斥锁
 extern recursive_mutex_t loadMethodLock;
+extern monitor_t classInitLock;
 #if __OBJC2__
 extern rwlock_t runtimeLock;
 #else
@@ -779,6 +785,14 @@ extern void environ_init(void);
 extern void logReplacedMethod(const char *className, SEL s, bool isMeta, const char *catName, IMP oldImp, IMP newImp);
 
 
+// Thin @synchronized locks held by one thread; see objc-sync.mm.
+#define SYNC_THIN_LOCK_CACHE 4
+typedef struct {
+    objc_object *object;
+    uintptr_t lockCount;    // exclusive holds
+    uintptr_t sharedCount;  // shared holds nested in the thin lock
+} SyncThinLockItem;
+
 // objc per-thread storage
 // 线程数据 结构体
 typedef struct {
@@ -786,11 +800,18 @@ typedef struct {
     struct _objc_initializing_classes *initializingClasses; // for +initialize
     // 同步缓存
     struct SyncCache *syncCache;  // for @synchronize
+    SyncThinLockItem syncThinLocks[SYNC_THIN_LOCK_CACHE];  // for @synchronize
     struct alt_handler_list *handlerList;  // for exception alt handlers
     char *printableNames[4];  // temporary demangled names for logging
                         // 数组，存储需要打印的类取消重整的名字，
                         // 是一个 FIFO 的队列，有新的元素进来时，会将第一个元素释放，然后后面的元素向前挪一个单位，
                         // 再把新来的元素放在末尾
+    struct PoolPageCache *poolPageCache;  // for autorelease pool page reuse
+    struct PoolStats *poolStats;  // for autorelease pool statistics
+    struct SlabThread *slabThread;  // for the slab allocator
+    struct SyncStatsThread *syncStats;  // for @synchronized statistics
+    struct PropertyHazard *propertyHazard;  // for atomic property getters
+    struct LockProfileThread *lockProfile;  // for OBJC_PROFILE_LOCKS
 
     // If you add new fields here, don't forget to update 
     // _objc_pthread_destroyspecific()
@@ -798,6 +819,7 @@ typedef struct {
 } _objc_pthread_data;
 
 extern _objc_pthread_data *_objc_fetch_pthread_data(bool create);
+extern void _destroyLockProfile(_objc_pthread_data *data);
 extern void tls_init(void);
 
 // encoding.h
@@ -811,14 +833,64 @@ extern char *encoding_copyArgumentType(const char *t, unsigned int index);
 
 // sync.h
 extern void _destroySyncCache(struct SyncCache *cache);
+extern void _destroySyncStats(struct SyncStatsThread *stats);
+extern void sync_init(void);
+
+// accessors
+extern void _destroyPropertyHazard(_objc_pthread_data *data);
 
 // arr
 extern void arr_init(void);
+extern void _destroyPoolPageCache(_objc_pthread_data *data);
+extern void _destroyPoolStats(struct PoolStats *stats);
 extern id objc_autoreleaseReturnValue(id obj);
 
 // block trampolines
 extern IMP _imp_implementationWithBlockNoCopy(id block);
 
+// slab allocator
+#if SUPPORT_SLAB_ALLOCATOR
+extern uintptr_t _objc_slabRegionStart;
+extern uintptr_t _objc_slabRegionEnd;
+extern void *_objc_slabCalloc(size_t size);
+extern unsigned _objc_slabBatchCalloc(size_t size, void **results, unsigned num);
+extern void _objc_slabFree(void *p);
+extern size_t _objc_slabSize(const void *p);
+extern void _destroySlabThread(struct SlabThread *thread);
+
+static inline bool _objc_isSlabPointer(const void *p)
+{
+    return (uintptr_t)p >= _objc_slabRegionStart  &&  
+        (uintptr_t)p < _objc_slabRegionEnd;
+}
+#endif
+
+// arena zones
+extern bool _objc_isArenaZone(void *zone);
+
+// Allocate zeroed memory for an instance of cls without a zone
+static inline void *_objc_callocInstance(Class cls, size_t size)
+{
+#if SUPPORT_SLAB_ALLOCATOR
+    if (UseSlabAllocator  ||  cls->usesSlabAllocator()) {
+        return _objc_slabCalloc(size);
+    }
+#endif
+    return calloc(1, size);
+}
+
+// Free the memory of an instance allocated by _objc_callocInstance
+static inline void _objc_freeInstance(void *p)
+{
+#if SUPPORT_SLAB_ALLOCATOR
+    if (_objc_isSlabPointer(p)) {
+        _objc_slabFree(p);
+        return;
+    }
+#endif
+    free(p);
+}
+
 // layout.h
 typedef struct {
     uint8_t *bits;
@@ -1034,6 +1106,12 @@ class StripedMap {
         return const_cast<StripedMap<T>>(this)[p]; 
     }
 
+    // Access by stripe index, for walking every stripe.
+    static unsigned int stripeCount() { return StripeCount; }
+    T& stripeAt(unsigned int i) { 
+        return array[i].value; 
+    }
+
 #if DEBUG
     StripedMap() {
         // Verify alignment expectations.
@@ -35,6 +35,8 @@ __BEGIN_DECLS
 extern void _object_set_associative_reference(id object, void *key, id value, uintptr_t policy);
 extern id _object_get_associative_reference(id object, void *key);
 extern void _object_remove_assocations(id object);
+extern void _object_set_associative_value(id object, void *key, const void *value, size_t size);
+extern size_t _object_get_associative_value(id object, void *key, void *outValue, size_t size);
 
 __END_DECLS
 
@@ -27,76 +27,12 @@
 
 #include "objc-private.h"
 #include <objc/message.h>
-#include <map>
-
-#if _LIBCPP_VERSION
-#   include <unordered_map>
-#else
-#   include <tr1/unordered_map>
-    using namespace tr1;
-#endif
+#include <vector>
 
 
 // wrap all the murky C++ details in a namespace to get them out of the way.
 
 namespace objc_references_support {
-    struct DisguisedPointerEqual {
-        bool operator()(uintptr_t p1, uintptr_t p2) const {
-            return p1 == p2;
-        }
-    };
-    
-    struct DisguisedPointerHash {
-        uintptr_t operator()(uintptr_t k) const {
-            // borrowed from CFSet.c
-#if __LP64__
-            uintptr_t a = 0x4368726973746F70ULL;
-            uintptr_t b = 0x686572204B616E65ULL;
-#else
-            uintptr_t a = 0x4B616E65UL;
-            uintptr_t b = 0x4B616E65UL; 
-#endif
-            uintptr_t c = 1;
-            a += k;
-#if __LP64__
-            a -= b; a -= c; a ^= (c >> 43);
-            b -= c; b -= a; b ^= (a << 9);
-            c -= a; c -= b; c ^= (b >> 8);
-            a -= b; a -= c; a ^= (c >> 38);
-            b -= c; b -= a; b ^= (a << 23);
-            c -= a; c -= b; c ^= (b >> 5);
-            a -= b; a -= c; a ^= (c >> 35);
-            b -= c; b -= a; b ^= (a << 49);
-            c -= a; c -= b; c ^= (b >> 11);
-            a -= b; a -= c; a ^= (c >> 12);
-            b -= c; b -= a; b ^= (a << 18);
-            c -= a; c -= b; c ^= (b >> 22);
-#else
-            a -= b; a -= c; a ^= (c >> 13);
-            b -= c; b -= a; b ^= (a << 8);
-            c -= a; c -= b; c ^= (b >> 13);
-            a -= b; a -= c; a ^= (c >> 12);
-            b -= c; b -= a; b ^= (a << 16);
-            c -= a; c -= b; c ^= (b >> 5);
-            a -= b; a -= c; a ^= (c >> 3);
-            b -= c; b -= a; b ^= (a << 10);
-            c -= a; c -= b; c ^= (b >> 15);
-#endif
-            return c;
-        }
-    };
-    
-    struct ObjectPointerLess {
-        bool operator()(const void *p1, const void *p2) const {
-            return p1 < p2;
-        }
-    };
-    
-    struct ObjcPointerHash {
-        uintptr_t operator()(void *p) const {
-            return DisguisedPointerHash()(uintptr_t(p));
-        }
-    };
 
     // STL allocator that uses the runtime's internal allocator.
     
@@ -148,64 +84,189 @@ namespace objc_references_support {
         template <typename U> struct rebind { typedef ObjcAllocator<U> other; };
     };
   
-    typedef uintptr_t disguised_ptr_t;
-    inline disguised_ptr_t DISGUISE(id value) { return ~uintptr_t(value); }
-    inline id UNDISGUISE(disguised_ptr_t dptr) { return id(~dptr); }
-  
+    // Raw-value associations set OBJC_ASSOCIATION_RAW_VALUE in the 
+    // policy and keep the value's size in its top byte. Their setter 
+    // bits are zero, so releaseValue() leaves them alone.
+    enum {
+        OBJC_ASSOCIATION_RAW_VALUE = (1 << 16),
+        OBJC_ASSOCIATION_RAW_SIZE_SHIFT = 24
+    };
+
     class ObjcAssociation {
         uintptr_t _policy;
-        id _value;
+        union {
+            id _value;
+            uint8_t _bytes[OBJC_ASSOCIATED_VALUE_MAX];
+        };
     public:
         ObjcAssociation(uintptr_t policy, id value) : _policy(policy), _value(value) {}
         ObjcAssociation() : _policy(0), _value(nil) {}
+        ObjcAssociation(const void *bytes, size_t size) 
+            : _policy(OBJC_ASSOCIATION_RAW_VALUE | (size << OBJC_ASSOCIATION_RAW_SIZE_SHIFT)) 
+        {
+            assert(size <= OBJC_ASSOCIATED_VALUE_MAX);
+            memcpy(_bytes, bytes, size);
+        }
 
         uintptr_t policy() const { return _policy; }
-        id value() const { return _value; }
+        id value() const { return isRawValue() ? nil : _value; }
         
-        bool hasValue() { return _value != nil; }
+        bool hasValue() { return value() != nil; }
+
+        bool isRawValue() const { return _policy & OBJC_ASSOCIATION_RAW_VALUE; }
+        size_t rawSize() const { return _policy >> OBJC_ASSOCIATION_RAW_SIZE_SHIFT; }
+        const uint8_t *rawBytes() const { return _bytes; }
     };
 
-#if TARGET_OS_WIN32
-    typedef hash_map<void *, ObjcAssociation> ObjectAssociationMap;
-    typedef hash_map<disguised_ptr_t, ObjectAssociationMap *> AssociationsHashMap;
-#else
-    typedef ObjcAllocator<std::pair<void * const, ObjcAssociation> > ObjectAssociationMapAllocator;
-    class ObjectAssociationMap : public std::map<void *, ObjcAssociation, ObjectPointerLess, ObjectAssociationMapAllocator> {
+    // One object's associations. Most objects have only a few, which 
+    // are kept in a small inline array searched linearly. Past 
+    // InlineCount keys the associations move to a hash map.
+    // The map's empty and tombstone keys can't be association keys; 
+    // setters reject them with checkAssociationKey().
+    class ObjectAssociationMap {
+        enum { InlineCount = 4 };
+        typedef objc::DenseMap<void *, ObjcAssociation, false> LargeMap;
+
     public:
-        void *operator new(size_t n) { return ::malloc(n); }
-        void operator delete(void *ptr) { ::free(ptr); }
-    };
-    typedef ObjcAllocator<std::pair<const disguised_ptr_t, ObjectAssociationMap*> > AssociationsHashMapAllocator;
-    class AssociationsHashMap : public unordered_map<disguised_ptr_t, ObjectAssociationMap *, DisguisedPointerHash, DisguisedPointerEqual, AssociationsHashMapAllocator> {
+        static bool isReservedKey(void *key) {
+            typedef objc::DenseMapInfo<void *> KeyInfo;
+            return key == KeyInfo::getEmptyKey()  ||  
+                key == KeyInfo::getTombstoneKey();
+        }
+
+    private:
+
+        struct Entry {
+            void *key;
+            ObjcAssociation association;
+        };
+
+        uint32_t _count;     // entries used in _inline, if !_large
+        LargeMap *_large;
+        Entry _inline[InlineCount];
+
     public:
+        ObjectAssociationMap() : _count(0), _large(nil) { }
+        ~ObjectAssociationMap() { delete _large; }
+
         void *operator new(size_t n) { return ::malloc(n); }
         void operator delete(void *ptr) { ::free(ptr); }
+
+        bool empty() const {
+            return _large ? _large->empty() : _count == 0;
+        }
+
+        ObjcAssociation *find(void *key) {
+            if (_large) {
+                if (isReservedKey(key)) return nil;
+                LargeMap::iterator it = _large->find(key);
+                return it == _large->end() ? nil : &it->second;
+            }
+            for (uint32_t i = 0; i < _count; i++) {
+                if (_inline[i].key == key) return &_inline[i].association;
+            }
+            return nil;
+        }
+
+        // Insert or replace. Returns the previous association, if any.
+        ObjcAssociation set(void *key, const ObjcAssociation& association) {
+            ObjcAssociation old;
+            if (ObjcAssociation *existing = find(key)) {
+                old = *existing;
+                *existing = association;
+                return old;
+            }
+            if (!_large  &&  _count < InlineCount) {
+                _inline[_count].key = key;
+                _inline[_count].association = association;
+                _count++;
+                return old;
+            }
+            if (!_large) {
+                _large = new LargeMap();
+                for (uint32_t i = 0; i < _count; i++) {
+                    (*_large)[_inline[i].key] = _inline[i].association;
+                }
+                _count = 0;
+            }
+            (*_large)[key] = association;
+            return old;
+        }
+
+        // Remove. Returns the removed association, if any.
+        ObjcAssociation erase(void *key) {
+            ObjcAssociation old;
+            if (_large) {
+                if (isReservedKey(key)) return old;
+                LargeMap::iterator it = _large->find(key);
+                if (it != _large->end()) {
+                    old = it->second;
+                    _large->erase(it);
+                }
+                return old;
+            }
+            for (uint32_t i = 0; i < _count; i++) {
+                if (_inline[i].key == key) {
+                    old = _inline[i].association;
+                    _inline[i] = _inline[--_count];
+                    break;
+                }
+            }
+            return old;
+        }
+
+        template <typename Fn>
+        void forEach(const Fn& fn) {
+            if (_large) {
+                for (LargeMap::iterator it = _large->begin(), end = _large->end(); it != end; ++it) {
+                    fn(it->second);
+                }
+                return;
+            }
+            for (uint32_t i = 0; i < _count; i++) {
+                fn(_inline[i].association);
+            }
+        }
+    };
+
+    typedef objc::DenseMap<DisguisedPtr<objc_object>, ObjectAssociationMap *, false> AssociationsHashMap;
+
+    // One shard of the associations table.
+    struct AssociationsShard {
+        spinlock_t lock;
+        AssociationsHashMap *map;    // object -> ObjectAssociationMap, lazily allocated
     };
-#endif
 }
 
 using namespace objc_references_support;
 
-// class AssociationsManager manages a lock / hash table singleton pair.
-// Allocating an instance acquires the lock, and calling its assocations() method
-// lazily allocates it.
+// class AssociationsManager manages the shard of the association tables 
+// that holds one object's associations. Shards are picked by object 
+// address, as SideTables are, so unrelated objects do not contend.
+// Allocating an instance acquires the shard's lock, and calling its 
+// assocations() method lazily allocates the shard's table.
+
+static StripedMap<AssociationsShard> AssociationsShards;
 
 class AssociationsManager {
-    static spinlock_t _lock;
-    static AssociationsHashMap *_map;               // associative references:  object pointer -> PtrPtrHashMap.
+    AssociationsShard &_shard;
 public:
-    AssociationsManager()   { _lock.lock(); }
-    ~AssociationsManager()  { _lock.unlock(); }
+    AssociationsManager(id object) : _shard(AssociationsShards[object]) { 
+        _shard.lock.lock(); 
+    }
+    ~AssociationsManager()  { _shard.lock.unlock(); }
     
     AssociationsHashMap &associations() {
-        if (_map == NULL)
-            _map = new AssociationsHashMap();
-        return *_map;
+        if (_shard.map == NULL)
+            _shard.map = new AssociationsHashMap();
+        return *_shard.map;
     }
-};
 
-spinlock_t AssociationsManager::_lock;
-AssociationsHashMap *AssociationsManager::_map = NULL;
+    // NULL if no object in this shard has ever had associations.
+    AssociationsHashMap *associationsIfPresent() {
+        return _shard.map;
+    }
+};
 
 // expanded policy bits.
 
@@ -222,18 +283,17 @@ id _object_get_associative_reference(id object, void *key) {
     id value = nil;
     uintptr_t policy = OBJC_ASSOCIATION_ASSIGN;
     {
-        AssociationsManager manager;
-        AssociationsHashMap &associations(manager.associations());
-        disguised_ptr_t disguised_object = DISGUISE(object);
-        AssociationsHashMap::iterator i = associations.find(disguised_object);
-        if (i != associations.end()) {
-            ObjectAssociationMap *refs = i->second;
-            ObjectAssociationMap::iterator j = refs->find(key);
-            if (j != refs->end()) {
-                ObjcAssociation &entry = j->second;
-                value = entry.value();
-                policy = entry.policy();
-                if (policy & OBJC_ASSOCIATION_GETTER_RETAIN) ((id(*)(id, SEL))objc_msgSend)(value, SEL_retain);
+        AssociationsManager manager(object);
+        AssociationsHashMap *associations = manager.associationsIfPresent();
+        if (associations) {
+            AssociationsHashMap::iterator i = associations->find(object);
+            if (i != associations->end()) {
+                ObjectAssociationMap *refs = i->second;
+                if (ObjcAssociation *entry = refs->find(key)) {
+                    value = entry->value();
+                    policy = entry->policy();
+                    if (policy & OBJC_ASSOCIATION_GETTER_RETAIN) ((id(*)(id, SEL))objc_msgSend)(value, SEL_retain);
+                }
             }
         }
     }
@@ -265,43 +325,42 @@ struct ReleaseValue {
     }
 };
 
+static void checkAssociationKey(void *key)
+{
+    if (ObjectAssociationMap::isReservedKey(key)) {
+        _objc_fatal("objc_setAssociatedObject: key %p is reserved "
+                    "and cannot be used as an association key", key);
+    }
+}
+
 void _object_set_associative_reference(id object, void *key, id value, uintptr_t policy) {
+    checkAssociationKey(key);
     // retain the new value (if any) outside the lock.
     ObjcAssociation old_association(0, nil);
     id new_value = value ? acquireValue(value, policy) : nil;
     {
-        AssociationsManager manager;
-        AssociationsHashMap &associations(manager.associations());
-        disguised_ptr_t disguised_object = DISGUISE(object);
+        AssociationsManager manager(object);
         if (new_value) {
+            AssociationsHashMap &associations(manager.associations());
             // break any existing association.
-            AssociationsHashMap::iterator i = associations.find(disguised_object);
+            AssociationsHashMap::iterator i = associations.find(object);
             if (i != associations.end()) {
                 // secondary table exists
-                ObjectAssociationMap *refs = i->second;
-                ObjectAssociationMap::iterator j = refs->find(key);
-                if (j != refs->end()) {
-                    old_association = j->second;
-                    j->second = ObjcAssociation(policy, new_value);
-                } else {
-                    (*refs)[key] = ObjcAssociation(policy, new_value);
-                }
+                old_association = i->second->set(key, ObjcAssociation(policy, new_value));
             } else {
                 // create the new association (first time).
                 ObjectAssociationMap *refs = new ObjectAssociationMap;
-                associations[disguised_object] = refs;
-                (*refs)[key] = ObjcAssociation(policy, new_value);
+                associations[object] = refs;
+                refs->set(key, ObjcAssociation(policy, new_value));
                 object->setHasAssociatedObjects();
             }
         } else {
             // setting the association to nil breaks the association.
-            AssociationsHashMap::iterator i = associations.find(disguised_object);
-            if (i !=  associations.end()) {
-                ObjectAssociationMap *refs = i->second;
-                ObjectAssociationMap::iterator j = refs->find(key);
-                if (j != refs->end()) {
-                    old_association = j->second;
-                    refs->erase(j);
+            AssociationsHashMap *associations = manager.associationsIfPresent();
+            if (associations) {
+                AssociationsHashMap::iterator i = associations->find(object);
+                if (i != associations->end()) {
+                    old_association = i->second->erase(key);
                 }
             }
         }
@@ -310,25 +369,81 @@ void _object_set_associative_reference(id object, void *key, id value, uintptr_t
     if (old_association.hasValue()) ReleaseValue()(old_association);
 }
 
+/***********************************************************************
+* _object_set_associative_value
+* Stores size bytes inline in object's association for key, replacing 
+* any object or raw value there. NULL value or size 0 removes it. 
+* No retain, release, or allocation besides the association tables.
+* Locking: acquires the association shard lock of object
+**********************************************************************/
+void _object_set_associative_value(id object, void *key, const void *value, size_t size) {
+    assert(size <= OBJC_ASSOCIATED_VALUE_MAX);
+    checkAssociationKey(key);
+    ObjcAssociation old_association(0, nil);
+    {
+        AssociationsManager manager(object);
+        if (value  &&  size) {
+            AssociationsHashMap &associations(manager.associations());
+            AssociationsHashMap::iterator i = associations.find(object);
+            if (i != associations.end()) {
+                old_association = i->second->set(key, ObjcAssociation(value, size));
+            } else {
+                ObjectAssociationMap *refs = new ObjectAssociationMap;
+                associations[object] = refs;
+                refs->set(key, ObjcAssociation(value, size));
+                object->setHasAssociatedObjects();
+            }
+        } else {
+            AssociationsHashMap *associations = manager.associationsIfPresent();
+            if (associations) {
+                AssociationsHashMap::iterator i = associations->find(object);
+                if (i != associations->end()) {
+                    old_association = i->second->erase(key);
+                }
+            }
+        }
+    }
+    // a replaced object value is released outside of the lock.
+    if (old_association.hasValue()) ReleaseValue()(old_association);
+}
+
+/***********************************************************************
+* _object_get_associative_value
+* Copies up to size bytes of object's raw value for key into outValue.
+* Returns the raw value's size, or 0 if key holds no raw value.
+* Locking: acquires the association shard lock of object
+**********************************************************************/
+size_t _object_get_associative_value(id object, void *key, void *outValue, size_t size) {
+    AssociationsManager manager(object);
+    AssociationsHashMap *associations = manager.associationsIfPresent();
+    if (!associations) return 0;
+    AssociationsHashMap::iterator i = associations->find(object);
+    if (i == associations->end()) return 0;
+    ObjcAssociation *entry = i->second->find(key);
+    if (!entry  ||  !entry->isRawValue()) return 0;
+    size_t rawSize = entry->rawSize();
+    memcpy(outValue, entry->rawBytes(), MIN(size, rawSize));
+    return rawSize;
+}
+
 // 移除 object 的关联对象
 // 调用者：objc_destructInstance() / objc_removeAssociatedObjects()
 void _object_remove_assocations(id object) {
-    vector< ObjcAssociation,ObjcAllocator<ObjcAssociation> > elements;
+    std::vector< ObjcAssociation,ObjcAllocator<ObjcAssociation> > elements;
     {
-        AssociationsManager manager;
-        AssociationsHashMap &associations(manager.associations());
-        if (associations.size() == 0) return;
-        disguised_ptr_t disguised_object = DISGUISE(object);
-        AssociationsHashMap::iterator i = associations.find(disguised_object);
-        if (i != associations.end()) {
+        AssociationsManager manager(object);
+        AssociationsHashMap *associations = manager.associationsIfPresent();
+        if (!associations  ||  associations->size() == 0) return;
+        AssociationsHashMap::iterator i = associations->find(object);
+        if (i != associations->end()) {
             // copy all of the associations that need to be removed.
             ObjectAssociationMap *refs = i->second;
-            for (ObjectAssociationMap::iterator j = refs->begin(), end = refs->end(); j != end; ++j) {
-                elements.push_back(j->second);
-            }
+            refs->forEach([&](ObjcAssociation &association) {
+                elements.push_back(association);
+            });
             // remove the secondary table.
             delete refs;
-            associations.erase(i);
+            associations->erase(i);
         }
     }
     // the calls to releaseValue() happen outside of the lock.
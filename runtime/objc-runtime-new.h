@@ -629,10 +629,17 @@ struct locstamped_category_list_t {
 // class has instance-specific GC layout
 #define RW_HAS_INSTANCE_SPECIFIC_LAYOUT (1 << 21)  // 指定了 Instance-specific object layout，
                                                    // 见 _class_setIvarLayoutAccessor
-// available for use
-// #define RW_20       (1<<20)
+// class's instances are disposed of on the async dealloc thread
+#define RW_DEALLOC_ASYNC      (1<<20)
 // class has started realizing but not yet completed it
 #define RW_REALIZING          (1<<19)   // 类开始 realizing 但还没有结束
+// class's instances are allocated from the slab allocator
+#define RW_SLAB_ALLOC         (1<<15)
+// summary bit for fast alloc path where class_data_bits_t has no room:
+//   !hasCxxCtor and !requiresRawIsa and fastInstanceSize is set
+#define RW_FAST_ALLOC         (1<<14)
+// weak references to class's instances go through a shared weak cell
+#define RW_WEAK_CELLS         (1<<13)
 
 // NOTE: MORE RW_ FLAGS DEFINED BELOW
 
@@ -1286,6 +1293,11 @@ struct class_rw_t {
                          // 而 swift 类重整前后的名字不一样，见 objc_class::demangledName()
                          // 取消重整的名字，没有乱七八糟的字符，看上去正常一点
 
+#if __LP64__
+    uint32_t fastInstanceSize;  // instance size rounded up to 16 bytes,
+                                // for RW_FAST_ALLOC
+#endif
+
     // 将 set 给定的 bit 位设为 1
     void setFlags(uint32_t set) 
     {
@@ -1484,6 +1496,7 @@ public:
     }
     void setHasCxxCtor() {
         data()->setFlags(RW_HAS_CXX_CTOR);
+        updateRWFastAlloc();
     }
 #endif
 
@@ -1517,6 +1530,7 @@ public:
     // 设置需要 raw isa
     void setRequiresRawIsa() {
         setBits(FAST_REQUIRES_RAW_ISA);
+        updateRWFastAlloc();
     }
 #else   // 下面不用看，不会有下面的这种情况
 # if SUPPORT_NONPOINTER_ISA
@@ -1574,6 +1588,37 @@ public:
     bool canAllocFast() {
         return bits & FAST_ALLOC;
     }
+    void updateRWFastAlloc() {
+        // summary is in bits
+    }
+#elif __LP64__
+    // The leaks-compatible layout has no room in bits for the fast alloc 
+    // summary, so it lives in class_rw_t next to the flags it summarizes.
+    size_t fastInstanceSize() {
+        assert(canAllocFast());
+        return data()->fastInstanceSize;
+    }
+
+    void setFastInstanceSize(size_t newSize) {
+        // Set during realization or construction only. No locking needed.
+        newSize = (newSize + 15) & ~15;
+        data()->fastInstanceSize = (uint32_t)newSize;
+        updateRWFastAlloc();
+    }
+
+    bool canAllocFast() {
+        return data()->flags & RW_FAST_ALLOC;
+    }
+
+    // Recompute RW_FAST_ALLOC after a change to anything it summarizes.
+    void updateRWFastAlloc() {
+        class_rw_t *rw = data();
+        if (rw->fastInstanceSize  &&  !hasCxxCtor()  &&  !requiresRawIsa()) {
+            rw->setFlags(RW_FAST_ALLOC);
+        } else {
+            rw->clearFlags(RW_FAST_ALLOC);
+        }
+    }
 #else
     size_t fastInstanceSize() {
         abort();
@@ -1586,6 +1631,9 @@ public:
     bool canAllocFast() {
         return false;
     }
+    void updateRWFastAlloc() {
+        // nothing
+    }
 #endif
 
     // 是否是 swift 类
@@ -1783,6 +1831,37 @@ struct objc_class : objc_object {
         setInfo(RW_FINALIZE_ON_MAIN_THREAD);
     }
 
+    // Instances are destroyed and freed on the async dealloc thread.
+    // Inherited by subclasses; see _class_setDeallocatesAsynchronously().
+    bool shouldDeallocAsync() {
+        assert(isRealized());
+        return data()->flags & RW_DEALLOC_ASYNC;
+    }
+    void setShouldDeallocAsync() {
+        assert(isRealized());
+        setInfo(RW_DEALLOC_ASYNC);
+    }
+
+    bool usesSlabAllocator() {
+        assert(isRealized());
+        return data()->flags & RW_SLAB_ALLOC;
+    }
+    void setUsesSlabAllocator() {
+        assert(isRealized());
+        setInfo(RW_SLAB_ALLOC);
+    }
+
+    // Weak variables point at one refcounted cell per instance.
+    // Inherited by subclasses; see _class_setUsesWeakCells().
+    bool usesWeakCells() {
+        assert(isRealized());
+        return data()->flags & RW_WEAK_CELLS;
+    }
+    void setUsesWeakCells() {
+        assert(isRealized());
+        setInfo(RW_WEAK_CELLS);
+    }
+
     // 是否正在被初始化
     bool isInitializing() {
         return getMeta()->data()->flags & RW_INITIALIZING;
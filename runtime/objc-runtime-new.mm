@@ -32,6 +32,7 @@
 #include "objc-runtime-new.h"
 #include "objc-file.h"
 #include "objc-cache.h"
+#include "objc-nametable.h"
 #include <Block.h>
 #include <objc/message.h>
 #include <mach/shared_region.h>
@@ -105,6 +106,12 @@ static __unused void destroyQOSKey(void *arg) {
 
 void lock_init(void)
 {
+    runtimeLock.setProfileName("runtimeLock");
+    selLock.setProfileName("selLock");
+    cacheUpdateLock.setProfileName("cacheUpdateLock");
+    loadMethodLock.setProfileName("loadMethodLock");
+    classInitLock.setProfileName("classInitLock");
+
 #if SUPPORT_QOS_HACK
     BackgroundPriority = _pthread_qos_class_encode(QOS_CLASS_BACKGROUND, 0, 0);
     MainPriority = _pthread_qos_class_encode(qos_class_main(), 0, 0);
@@ -1150,11 +1157,25 @@ static char *copySwiftV1MangledName(const char *string, bool isProtocol = false)
 }
 
 
+/***********************************************************************
+* Name indexes
+* The name => class entries of gdb_objc_realized_classes and the 
+* name => protocol entries of the protocol map, copied into tables 
+* that readers search without runtimeLock. See objc-nametable.h. 
+* Disposing a class clears its value only: the names and slots of 
+* classes created and disposed at runtime are never reclaimed.
+* Locking: runtimeLock must be held for writing to change an index. 
+* Lookups take no lock.
+**********************************************************************/
+static NameTable namedClassIndex;
+static NameTable namedProtocolIndex;
+
+
 /***********************************************************************
 * getClass
 * Looks up a class by name. The class MIGHT NOT be realized.
 * Demangled Swift names are recognized.
-* Locking: runtimeLock must be read- or write-locked by the caller.
+* Locking: none. Searches namedClassIndex, not gdb_objc_realized_classes.
 **********************************************************************/
 
 // This is a misnomer（用词不当、误称）: gdb_objc_realized_classes is actually a list of
@@ -1171,14 +1192,9 @@ NXMapTable *gdb_objc_realized_classes;  // exported for debuggers in objc-gdb.h
 // 该函数被 getClass() 函数调用
 static Class getClass_impl(const char *name)
 {
-    runtimeLock.assertLocked(); // 必须事先被加锁
-
-    // allocated in _read_images 
-    assert(gdb_objc_realized_classes); // gdb_objc_realized_classes 是在 _read_images() 函数中被初始化的(分配内存)
-
     // Try runtime-allocated table
-    // 从 gdb_objc_realized_classes 根据 key 即 name 查找类
-    Class result = (Class)NXMapGet(gdb_objc_realized_classes, name);
+    // 从 namedClassIndex（gdb_objc_realized_classes 的无锁副本）根据 key 即 name 查找类
+    Class result = (Class)namedClassIndex.get(name);
     if (result) {
         return result; // 找到了，就将其返回
     }
@@ -1191,8 +1207,6 @@ static Class getClass_impl(const char *name)
 // 根据 name 查找类，实际上调用的还是 getClass_impl，但是需要对 swift 的类做一些处理
 static Class getClass(const char *name)
 {
-    runtimeLock.assertLocked(); // 必须事先被加锁
-
     // Try name as-is
     Class result = getClass_impl(name); // 先直接用 name 查找
     if (result) {
@@ -1244,6 +1258,7 @@ static void addNamedClass(Class cls, const char *name, Class replacing = nil)
     } else {
         // 如果没有旧值，或者指定要覆盖旧值（replacing == old），就将新的 name->cls 对插入 gdb_objc_realized_classes
         NXMapInsert(gdb_objc_realized_classes, name, cls);
+        namedClassIndex.set(name, cls);
     }
     assert(!(cls->data()->flags & RO_META)); // cls 不能是元类
 
@@ -1264,6 +1279,7 @@ static void removeNamedClass(Class cls, const char *name)
     assert(!(cls->data()->flags & RO_META)); // cls 不能是元类
     if (cls == NXMapGet(gdb_objc_realized_classes, name)) { // 先看 gdb_objc_realized_classes 中有没有
         NXMapRemove(gdb_objc_realized_classes, name); // 有的话，将其移除
+        namedClassIndex.set(name, nil);
     } else {
         // cls has a name collision with another class - don't remove the other
         // but do remove cls from the secondary metaclass->class map.
@@ -1885,6 +1901,18 @@ static void addSubclass(Class supercls, Class subcls)
         if (supercls->requiresRawIsa()) {
             subcls->setRequiresRawIsa(true);
         }
+
+        if (supercls->shouldDeallocAsync()) {
+            subcls->setShouldDeallocAsync();
+        }
+
+        if (supercls->usesSlabAllocator()) {
+            subcls->setUsesSlabAllocator();
+        }
+
+        if (supercls->usesWeakCells()) {
+            subcls->setUsesWeakCells();
+        }
     }
 }
 
@@ -1947,25 +1975,23 @@ static NXMapTable *protocols(void)
 /***********************************************************************
 * getProtocol
 * Looks up a protocol by name. Demangled Swift names are recognized.
-* Locking: runtimeLock must be read- or write-locked by the caller.
+* Locking: none. Searches namedProtocolIndex, not the protocol map.
 **********************************************************************/
 // 从 protocol_map 中根据协议名 name 查找对应的协议
 // 调用者：objc_allocateProtocol() / objc_getProtocol() /
 //           readProtocol() / remapProtocol()
 static Protocol *getProtocol(const char *name)
 {
-    runtimeLock.assertLocked(); // 需要事先加锁
-
     // Try name as-is.
     // 先用直接用 name 查找
-    Protocol *result = (Protocol *)NXMapGet(protocols(), name);
+    Protocol *result = (Protocol *)namedProtocolIndex.get(name);
     if (result) return result;
 
     // Try Swift-mangled equivalent of the given name.
     // 如果 name 找不到，那么可能这是一个 swift 的协议，就将其重整为 swift 协议的格式
     // 如果不符合 swift 重整前名字的格式的话，copySwiftV1MangledName 会返回 nil
     if (char *swName = copySwiftV1MangledName(name, true/*isProtocol*/)) {
-        result = (Protocol *)NXMapGet(protocols(), swName);  // 用 swName 再查找一次
+        result = (Protocol *)namedProtocolIndex.get(swName);  // 用 swName 再查找一次
         free(swName);  // 将 swName 释放，原因见 copySwiftV1MangledName()
         return result;
     }
@@ -1974,6 +2000,26 @@ static Protocol *getProtocol(const char *name)
 }
 
 
+/***********************************************************************
+* addNamedProtocol
+* Adds name => proto to the protocol map and to namedProtocolIndex.
+* copyKey copies the name for the map, for images that may be unloaded.
+* Locking: runtimeLock must be held for writing by the caller
+**********************************************************************/
+static void addNamedProtocol(NXMapTable *protocol_map, protocol_t *proto, 
+                             bool copyKey)
+{
+    runtimeLock.assertWriting();
+
+    if (copyKey) {
+        NXMapKeyCopyingInsert(protocol_map, proto->mangledName, proto);
+    } else {
+        NXMapInsert(protocol_map, proto->mangledName, proto);
+    }
+    namedProtocolIndex.set(proto->mangledName, proto);
+}
+
+
 /***********************************************************************
 * remapProtocol
 * Returns the live protocol pointer for proto, which may be pointing to 
@@ -2972,9 +3018,8 @@ readProtocol(protocol_t *newproto, Class protocol_class,
 {
     // This is not enough to make protocols in unloaded bundles safe, 
     // but it does prevent crashes when looking up unrelated protocols.
-    // 如果镜像是 bundle，就使用 NXMapKeyCopyingInsert 函数，否则使用 NXMapInsert
-    // NXMapKeyCopyingInsert 会在堆中拷贝 key
-    auto insertFn = headerIsBundle ? NXMapKeyCopyingInsert : NXMapInsert;
+    // 如果镜像是 bundle，就让 protocol_map 在堆中拷贝 key（NXMapKeyCopyingInsert），否则使用 NXMapInsert
+    bool copyKey = headerIsBundle;
 
     // 根据新协议的重整名称，去 protocol_map 映射表中查找老的协议
     protocol_t *oldproto = (protocol_t *)getProtocol(newproto->mangledName);
@@ -3012,8 +3057,7 @@ readProtocol(protocol_t *newproto, Class protocol_class,
         assert(installedproto->size >= sizeof(protocol_t));
         
         // 将 新协议的重整名称 -> 新协议 的映射插入 protocol_map 映射表中
-        insertFn(protocol_map, installedproto->mangledName, 
-                 installedproto);
+        addNamedProtocol(protocol_map, installedproto, copyKey);
         
         if (PrintProtocols) {
             _objc_inform("PROTOCOLS: protocol at %p is %s", 
@@ -3032,8 +3076,8 @@ readProtocol(protocol_t *newproto, Class protocol_class,
         // with sufficient storage. Fix it up in place.
         // fixme duplicate protocols from unloadable bundle
         newproto->initIsa(protocol_class);  // fixme pinned
-        insertFn(protocol_map, newproto->mangledName, newproto); // 就将 新协议的重整名称 -> 新协议 的映射插入
-                                                                 // protocol_map 映射表中
+        addNamedProtocol(protocol_map, newproto, copyKey); // 就将 新协议的重整名称 -> 新协议 的映射插入
+                                                           // protocol_map 映射表中
         if (PrintProtocols) {
             _objc_inform("PROTOCOLS: protocol at %p is %s",
                          newproto, newproto->nameForLogging());
@@ -3057,7 +3101,7 @@ readProtocol(protocol_t *newproto, Class protocol_class,
         installedproto->initIsa(protocol_class); // 设置 isa  // fixme pinned
         
         // 将 installedproto 插入 protocol_map 映射表中
-        insertFn(protocol_map, installedproto->mangledName, installedproto);
+        addNamedProtocol(protocol_map, installedproto, copyKey);
         
         if (PrintProtocols) {
             _objc_inform("PROTOCOLS: protocol at %p is %s  ", 
@@ -4749,7 +4793,7 @@ void objc_registerProtocol(Protocol *proto_gen)
     proto->changeIsa(cls); // 改变协议的 cls，不用 initProtocolIsa() 是为了不改变除 cls 外的其他信息
 
     // 将协议插入 protocol_map 映射表中
-    NXMapKeyCopyingInsert(protocols(), proto->mangledName, proto);
+    addNamedProtocol(protocols(), proto, true);
 }
 
 
@@ -5106,13 +5150,12 @@ objc_copyProtocolList(unsigned int *outCount)
 /***********************************************************************
 * objc_getProtocol
 * Get a protocol by name, or return nil
-* Locking: read-locks runtimeLock
+* Locking: none
 **********************************************************************/
 // 根据协议名 name 查找对应的协议，调用 getProtocol() 完成查找，
-// 与之不同的是，加了读锁
+// getProtocol() 查的是无锁的 namedProtocolIndex，所以不用加读锁
 Protocol *objc_getProtocol(const char *name)
 {
-    rwlock_reader_t lock(runtimeLock); 
     return getProtocol(name);
 }
 
@@ -6171,6 +6214,21 @@ IMP lookUpImpOrNil(Class cls, SEL sel, id inst,
 }
 
 
+/***********************************************************************
+* lookUpBaseImpOrNil.
+* Returns the IMP for sel in cls's compiled method list, ignoring 
+* categories, superclasses, and methods added at runtime.
+* Locking: acquires runtimeLock
+**********************************************************************/
+IMP lookUpBaseImpOrNil(Class cls, SEL sel)
+{
+    rwlock_reader_t lock(runtimeLock);
+    assert(cls->isRealized());
+    method_t *m = search_method_list(cls->data()->ro->baseMethods(), sel);
+    return m ? m->imp : nil;
+}
+
+
 /***********************************************************************
 * lookupMethodInClassAndLoadCache.
 * Like _class_lookupMethodAndLoadCache, but does not search superclasses.
@@ -7310,7 +7368,7 @@ class_replaceProperty(Class cls, const char *name,
 /***********************************************************************
 * look_up_class
 * Look up a class by name, and realize it.
-* Locking: acquires runtimeLock
+* Locking: acquires runtimeLock only to realize the class
 **********************************************************************/
 // 根据 name 查找类，并且如果该类没有 realize 就将其 realize 了
 // 调用者 ：gdb_class_getClass() / objc_getClass() / objc_getFutureClass() / objc_lookUpClass()
@@ -7321,15 +7379,10 @@ look_up_class(const char *name,
 {
     if (!name) return nil; // 类名不能为 nil，否则不能查
 
-    Class result;
-    bool unrealized;
-    { // 加函数块是为了能实现自动释放 runtimeLock 锁，下面也一样
-        
-        rwlock_reader_t lock(runtimeLock); // 加读锁
-        result = getClass(name); // 利用 getClass 函数查找类
-        unrealized = result  &&  !result->isRealized(); // 如果找到了类，且类没有被 realize，就标记为 unrealized
-    }
-    if (unrealized) { // 类存在，且没有被 realize
+    // No lock: getClass() searches the name indexes. The unlocked 
+    // isRealized() check is the same one lookUpImpOrForward() makes.
+    Class result = getClass(name); // 利用 getClass 函数查找类，不需要加锁
+    if (result  &&  !result->isRealized()) { // 类存在，且没有被 realize
         rwlock_writer_t lock(runtimeLock); // 加写锁
         realizeClass(result); // 将类 realize 了
     }
@@ -7989,7 +8042,7 @@ _class_createInstanceFromZone(Class cls, size_t extraBytes, void *zone,
 
     id obj;
     if (!UseGC  &&  !zone  &&  fast) {
-        obj = (id)calloc(1, size);
+        obj = (id)_objc_callocInstance(cls, size);
         if (!obj) return nil;
         obj->initInstanceIsa(cls, hasCxxDtor);
     } 
@@ -8003,7 +8056,7 @@ _class_createInstanceFromZone(Class cls, size_t extraBytes, void *zone,
         if (zone) {
             obj = (id)malloc_zone_calloc ((malloc_zone_t *)zone, 1, size);
         } else {
-            obj = (id)calloc(1, size);
+            obj = (id)_objc_callocInstance(cls, size);
         }
         if (!obj) return nil;
 
@@ -8032,9 +8085,6 @@ class_createInstance(Class cls, size_t extraBytes)
 * fixme
 * Locking: none
 **********************************************************************/
-#if SUPPORT_NONPOINTER_ISA
-#warning fixme optimize class_createInstances
-#endif
 unsigned 
 class_createInstances(Class cls, size_t extraBytes, 
                       id *results, unsigned num_requested)
@@ -8213,6 +8263,191 @@ void *objc_destructInstance(id obj)
 }
 
 
+/***********************************************************************
+* Asynchronous deallocation
+* Instances of classes opted in with _class_setDeallocatesAsynchronously() 
+* are destroyed and freed on a background drain thread, which calls 
+* objc_destructInstance() so C++ destructors, association removal and 
+* clearDeallocating() keep their order. Until then the object is already 
+* marked deallocating, so weak references to it read nil once -dealloc 
+* has run, and nothing can retain it again.
+* The queue is bounded. When it is full the releasing thread disposes 
+* of the object itself, which bounds memory and throttles the producer.
+* Locking: asyncDeallocLock guards the queue and statistics.
+**********************************************************************/
+
+#define ASYNC_DEALLOC_CAPACITY 4096
+
+static monitor_t asyncDeallocLock;
+static id *asyncDeallocQueue;      // ring buffer, allocated with the thread
+static size_t asyncDeallocHead;    // next object to drain
+static size_t asyncDeallocBusy;    // objects being drained right now
+static objc_asyncDeallocStatistics asyncDeallocStats;
+
+// Locking: none. clearDeallocating() takes side table locks 
+// and may wait out weak readers.
+static void disposeDeferred(id obj)
+{
+    objc_destructInstance(obj);
+    _objc_freeInstance(obj);
+}
+
+static void *asyncDeallocThread(void *arg __unused)
+{
+    pthread_setname_np("org.opensource.objc.async-dealloc");
+
+    asyncDeallocLock.enter();
+    while (true) {
+        while (asyncDeallocStats.depth == 0) asyncDeallocLock.wait();
+
+        id obj = asyncDeallocQueue[asyncDeallocHead];
+        asyncDeallocHead = (asyncDeallocHead + 1) % ASYNC_DEALLOC_CAPACITY;
+        asyncDeallocStats.depth--;
+        asyncDeallocBusy++;
+        asyncDeallocLock.leave();
+
+        // C++ destructors may autorelease.
+        void *pool = objc_autoreleasePoolPush();
+        disposeDeferred(obj);
+        objc_autoreleasePoolPop(pool);
+
+        asyncDeallocLock.enter();
+        asyncDeallocBusy--;
+        if (asyncDeallocStats.depth == 0  &&  asyncDeallocBusy == 0) {
+            // wake _objc_waitForAsyncDealloc()
+            asyncDeallocLock.notifyAll();
+        }
+    }
+    return nil;
+}
+
+// Returns false if obj must be disposed of synchronously after all.
+static bool disposeAsync(id obj)
+{
+    asyncDeallocLock.enter();
+
+    if (!asyncDeallocQueue) {
+        asyncDeallocQueue = (id *)calloc(ASYNC_DEALLOC_CAPACITY, sizeof(id));
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int err = pthread_create(&thread, &attr, asyncDeallocThread, nil);
+        pthread_attr_destroy(&attr);
+        if (err) {
+            free(asyncDeallocQueue);
+            asyncDeallocQueue = nil;
+            asyncDeallocLock.leave();
+            return false;
+        }
+    }
+
+    if (asyncDeallocStats.depth == ASYNC_DEALLOC_CAPACITY) {
+        asyncDeallocStats.throttled++;
+        asyncDeallocLock.leave();
+        return false;
+    }
+
+    size_t tail = (asyncDeallocHead + asyncDeallocStats.depth) 
+        % ASYNC_DEALLOC_CAPACITY;
+    asyncDeallocQueue[tail] = obj;
+    if (asyncDeallocStats.depth++ == 0) {
+        // The drain thread and _objc_waitForAsyncDealloc() share the 
+        // condition, so wake everybody to be sure the drain thread runs.
+        asyncDeallocLock.notifyAll();
+    }
+    if (asyncDeallocStats.depth > asyncDeallocStats.maxDepth) {
+        asyncDeallocStats.maxDepth = asyncDeallocStats.depth;
+    }
+    asyncDeallocStats.enqueued++;
+
+    asyncDeallocLock.leave();
+    return true;
+}
+
+
+/***********************************************************************
+* _class_setDeallocatesAsynchronously
+* Opt cls and its subclasses in to asynchronous deallocation.
+* Locking: acquires runtimeLock
+**********************************************************************/
+void _class_setDeallocatesAsynchronously(Class cls)
+{
+    if (!cls) return;
+
+    rwlock_writer_t lock(runtimeLock);
+
+    realizeClass(cls);
+    foreach_realized_class_and_subclass(cls, ^(Class c){
+        c->setShouldDeallocAsync();
+    });
+}
+
+
+/***********************************************************************
+* _class_setUsesSlabAllocator
+* Allocate small instances of cls and its subclasses from slabs.
+* Locking: acquires runtimeLock
+**********************************************************************/
+void _class_setUsesSlabAllocator(Class cls)
+{
+    if (!cls) return;
+
+    rwlock_writer_t lock(runtimeLock);
+
+    realizeClass(cls);
+    foreach_realized_class_and_subclass(cls, ^(Class c){
+        c->setUsesSlabAllocator();
+    });
+}
+
+
+/***********************************************************************
+* _class_setUsesWeakCells
+* Weak variables pointing to instances of cls and its subclasses 
+* share one refcounted cell per instance. Existing weak variables 
+* are unaffected.
+* Locking: acquires runtimeLock
+**********************************************************************/
+void _class_setUsesWeakCells(Class cls)
+{
+    if (!cls) return;
+
+    rwlock_writer_t lock(runtimeLock);
+
+    realizeClass(cls);
+    foreach_realized_class_and_subclass(cls, ^(Class c){
+        c->setUsesWeakCells();
+    });
+}
+
+
+/***********************************************************************
+* _objc_getAsyncDeallocStatistics
+* Locking: acquires asyncDeallocLock
+**********************************************************************/
+void _objc_getAsyncDeallocStatistics(objc_asyncDeallocStatistics *outStats)
+{
+    if (!outStats) return;
+    monitor_locker_t lock(asyncDeallocLock);
+    *outStats = asyncDeallocStats;
+}
+
+
+/***********************************************************************
+* _objc_waitForAsyncDealloc
+* Block until every queued object has been freed.
+* Locking: acquires asyncDeallocLock
+**********************************************************************/
+void _objc_waitForAsyncDealloc(void)
+{
+    monitor_locker_t lock(asyncDeallocLock);
+    while (asyncDeallocStats.depth != 0  ||  asyncDeallocBusy != 0) {
+        asyncDeallocLock.wait();
+    }
+}
+
+
 /***********************************************************************
 * object_dispose
 * fixme
@@ -8225,6 +8460,10 @@ object_dispose(id obj)
 {
     if (!obj) return nil;
 
+    if (!UseGC  &&  obj->ISA()->shouldDeallocAsync()  &&  disposeAsync(obj)) {
+        return nil;
+    }
+
     // 析构实例，里面会调用c++析构器、清除关联对象、清除弱引用
     objc_destructInstance(obj);
     
@@ -8237,7 +8476,11 @@ object_dispose(id obj)
 #endif
 
     // 释放内存
-    free(obj);
+#if SUPPORT_GC
+    if (UseGC) free(obj);
+    else
+#endif
+    _objc_freeInstance(obj);
 
     return nil;
 }
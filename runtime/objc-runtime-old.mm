@@ -3285,6 +3285,12 @@ recursive_mutex_t loadMethodLock;
 
 void lock_init(void)
 {
+    selLock.setProfileName("selLock");
+    classLock.setProfileName("classLock");
+    methodListLock.setProfileName("methodListLock");
+    cacheUpdateLock.setProfileName("cacheUpdateLock");
+    loadMethodLock.setProfileName("loadMethodLock");
+    classInitLock.setProfileName("classInitLock");
 }
 
 
@@ -395,7 +395,16 @@ void _objc_pthread_destroyspecific(void *arg)
     if (data != NULL) {
         _destroyInitializingClassList(data->initializingClasses);
         _destroySyncCache(data->syncCache);
+        _destroySyncStats(data->syncStats);
+        _destroyPropertyHazard(data);
         _destroyAltHandlerList(data->handlerList);
+        _destroyPoolPageCache(data);
+        _destroyPoolStats(data->poolStats);
+#if SUPPORT_SLAB_ALLOCATOR
+        _destroySlabThread(data->slabThread);
+#endif
+        // Last: the destructors above may take profiled locks.
+        _destroyLockProfile(data);
         for (int i = 0; i < (int)countof(data->printableNames); i++) {
             if (data->printableNames[i]) {
                 free(data->printableNames[i]);  
@@ -666,6 +675,35 @@ objc_setAssociatedObject(id object, const void *key, id value,
 #endif
 
 
+/**********************************************************************
+* objc_setAssociatedValue / objc_getAssociatedValue
+* Raw-value associations of up to OBJC_ASSOCIATED_VALUE_MAX bytes, 
+* stored inline in the association table. Not supported for GC objects.
+**********************************************************************/
+BOOL 
+objc_setAssociatedValue(id object, const void *key, 
+                        const void *value, size_t size) 
+{
+    if (!object  ||  size > OBJC_ASSOCIATED_VALUE_MAX) return NO;
+#if SUPPORT_GC
+    if (UseGC  &&  !object->isTaggedPointer()) return NO;
+#endif
+    _object_set_associative_value(object, (void *)key, value, size);
+    return YES;
+}
+
+size_t 
+objc_getAssociatedValue(id object, const void *key, 
+                        void *outValue, size_t size) 
+{
+    if (!object) return 0;
+#if SUPPORT_GC
+    if (UseGC  &&  !object->isTaggedPointer()) return 0;
+#endif
+    return _object_get_associative_value(object, (void *)key, outValue, size);
+}
+
+
 void objc_removeAssociatedObjects(id object) 
 {
 #if SUPPORT_GC
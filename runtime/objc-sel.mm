@@ -25,6 +25,7 @@
 
 #include "objc-private.h"
 #include "objc-cache.h"
+#include "objc-nametable.h"
 
 #if SUPPORT_PREOPT
 static const objc_selopt_t *builtins = NULL;
@@ -35,11 +36,16 @@ static const objc_selopt_t *builtins = NULL;
 #endif
 
 
-static size_t SelrefCount = 0;
+static SEL search_builtins(const char *key);
 
-static NXMapTable *namedSelectors;
 
-static SEL search_builtins(const char *key);
+/***********************************************************************
+* Selector table
+* Every registered selector that is not in the shared cache's builtins.
+* A SEL is the table's copy of its name. See objc-nametable.h.
+* selLock is not needed for the table.
+**********************************************************************/
+static NameTable selTable;
 
 
 /***********************************************************************
@@ -49,7 +55,7 @@ static SEL search_builtins(const char *key);
 void sel_init(bool wantsGC, size_t selrefCount)
 {
     // save this value for later
-    SelrefCount = selrefCount;
+    selTable.reserve(selrefCount);
 
 #if SUPPORT_PREOPT
     builtins = preoptimizedSelectors();
@@ -108,14 +114,6 @@ void sel_init(bool wantsGC, size_t selrefCount)
 }
 
 
-// 创建一个 selector，如果设置需要 copy，就在堆中分配内存
-// 因为 selector 本质上就是 char * 字符串，所以直接强转就可以了
-static SEL sel_alloc(const char *name, bool copy)
-{
-    selLock.assertWriting();
-    return (SEL)(copy ? strdup(name) : name);    
-}
-
 // 取得 sel 中的方法名，其实 sel 就是一个 char * 字符串
 // 强转为 char * ，就得到了方法名
 const char *sel_getName(SEL sel) 
@@ -137,11 +135,7 @@ BOOL sel_isMapped(SEL sel)
 
     if (sel == search_builtins(name)) return YES;
 
-    rwlock_reader_t lock(selLock);
-    if (namedSelectors) {
-        return (sel == (SEL)NXMapGet(namedSelectors, name));
-    }
-    return false;
+    return (sel == (SEL)selTable.getName(name));
 }
 
 
@@ -153,12 +147,13 @@ static SEL search_builtins(const char *name)
     return nil;
 }
 
-// 注册 SEL 的名字，能决定是否加锁和拷贝，拷贝即是否深拷贝 name，见 sel_alloc()
+// 注册 SEL 的名字，能决定是否加锁和拷贝，拷贝即是否深拷贝 name，见 NameTable::addName()
 // 调用者：sel_getUid() / sel_registerName() / sel_registerNameNoLock()
 static SEL __sel_registerName(const char *name, int lock, int copy) 
 {
     SEL result = 0;
 
+    // The table takes no lock, but callers still keep their lock order.
     if (lock) selLock.assertUnlocked();
     else selLock.assertWriting();
 
@@ -167,33 +162,8 @@ static SEL __sel_registerName(const char *name, int lock, int copy)
     result = search_builtins(name);
     if (result) return result;
     
-    if (lock) selLock.read();
-    if (namedSelectors) {
-        result = (SEL)NXMapGet(namedSelectors, name);
-    }
-    if (lock) selLock.unlockRead();
-    if (result) return result;
-
-    // No match. Insert.
-
-    if (lock) selLock.write();
-
-    if (!namedSelectors) {
-        namedSelectors = NXCreateMapTable(NXStrValueMapPrototype, 
-                                          (unsigned)SelrefCount);
-    }
-    if (lock) {
-        // Rescan in case it was added while we dropped the lock
-        result = (SEL)NXMapGet(namedSelectors, name);
-    }
-    if (!result) {
-        result = sel_alloc(name, copy);
-        // fixme choose a better container (hash not map for starters)
-        NXMapInsert(namedSelectors, sel_getName(result), result);
-    }
-
-    if (lock) selLock.unlockWrite();
-    return result;
+    // If another thread inserts the same name first, its SEL wins.
+    return (SEL)selTable.addName(name, copy);
 }
 
 // 注册 SEL 的名字，加锁、深拷贝
@@ -0,0 +1,653 @@
+/*
+ * Copyright (c) 2016 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/***********************************************************************
+* objc-slab.mm
+* Slab allocator for small object instances.
+*
+* Instances up to SLAB_MAX_SIZE bytes are rounded up to a multiple of
+* SLAB_QUANTUM and carved from SLAB_CHUNK_SIZE chunks of one size class.
+* All chunks live in a single virtual region reserved on first use, so
+* a pointer is recognized as a slab block with a range check and its
+* size class is found in a per-chunk table.
+*
+* Each thread keeps a magazine of free blocks per size class. Allocation
+* and deallocation touch only the magazine; the global depot is locked
+* only to refill an empty magazine or to take back half of a full one.
+*
+* The region is registered as a malloc zone, so malloc_size(), free()
+* and realloc() called by code outside the runtime still work on slab
+* instances. Chunks are never returned to the system.
+**********************************************************************/
+
+#include "objc-private.h"
+
+#if SUPPORT_SLAB_ALLOCATOR
+
+#include <malloc/malloc.h>
+#include <sys/mman.h>
+
+#define SLAB_QUANTUM 16
+#define SLAB_MAX_SIZE 256
+#define SLAB_SIZE_CLASSES (SLAB_MAX_SIZE / SLAB_QUANTUM)
+#define SLAB_CHUNK_SHIFT 16
+#define SLAB_CHUNK_SIZE (1UL << SLAB_CHUNK_SHIFT)
+#if __LP64__
+#   define SLAB_REGION_SIZE (1UL << 30)
+#else
+#   define SLAB_REGION_SIZE (64UL << 20)
+#endif
+#define SLAB_CHUNKS (SLAB_REGION_SIZE / SLAB_CHUNK_SIZE)
+
+// Blocks moved between a magazine and the depot at a time.
+#define SLAB_MAGAZINE_BATCH 32
+// Magazines hold at most this many blocks per size class.
+#define SLAB_MAGAZINE_LIMIT (2 * SLAB_MAGAZINE_BATCH)
+
+uintptr_t _objc_slabRegionStart;
+uintptr_t _objc_slabRegionEnd;
+
+struct SlabBlock {
+    SlabBlock *next;
+};
+
+struct SlabMagazine {
+    SlabBlock *head;
+    uint32_t count;
+    intptr_t inUse;  // blocks allocated minus blocks freed by this thread
+};
+
+// A thread's magazines, on the LiveThreads list until the thread exits.
+struct SlabThread {
+    SlabThread *next;
+    SlabThread **prevp;
+    SlabMagazine mags[SLAB_SIZE_CLASSES];
+};
+
+struct SlabSizeClass {
+    spinlock_t lock;
+    SlabBlock *depot;       // free blocks not held by any magazine
+    uintptr_t carveNext;    // unused part of the newest chunk
+    uintptr_t carveEnd;
+    objc_slabStatistics stats;  // inUse counts exited threads only
+};
+
+static SlabSizeClass SizeClasses[SLAB_SIZE_CLASSES];
+
+// Size class + 1 of each chunk in the region, 0 if not carved yet.
+static uint8_t ChunkSizeClass[SLAB_CHUNKS];
+
+static spinlock_t RegionLock;
+static uintptr_t RegionNext;
+
+static spinlock_t ThreadsLock;
+static SlabThread *LiveThreads;
+
+static malloc_zone_t SlabZone;
+
+
+static inline unsigned sizeClassForSize(size_t size)
+{
+    assert(size > 0  &&  size <= SLAB_MAX_SIZE);
+    return (unsigned)((size + SLAB_QUANTUM - 1) / SLAB_QUANTUM) - 1;
+}
+
+static inline size_t blockSize(unsigned sc)
+{
+    return (sc + 1) * SLAB_QUANTUM;
+}
+
+static inline unsigned sizeClassForPointer(const void *p)
+{
+    size_t chunk = ((uintptr_t)p - _objc_slabRegionStart) >> SLAB_CHUNK_SHIFT;
+    assert(ChunkSizeClass[chunk] != 0);
+    return ChunkSizeClass[chunk] - 1;
+}
+
+
+/***********************************************************************
+* reserveRegion
+* Reserve the virtual region and register the malloc zone, once.
+* Returns false if the region could not be reserved.
+* Locking: acquires RegionLock
+**********************************************************************/
+static void registerZone(void);
+
+static bool reserveRegion(void)
+{
+    if (_objc_slabRegionEnd) return true;
+
+    RegionLock.lock();
+    if (!_objc_slabRegionEnd  &&  !RegionNext) {
+        void *region = mmap(nil, SLAB_REGION_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_ANON | MAP_PRIVATE, -1, 0);
+        if (region == MAP_FAILED) {
+            // Don't try again.
+            RegionNext = ~(uintptr_t)0;
+        } else {
+            RegionNext = (uintptr_t)region;
+            _objc_slabRegionStart = (uintptr_t)region;
+            registerZone();
+            OSMemoryBarrier();
+            _objc_slabRegionEnd = (uintptr_t)region + SLAB_REGION_SIZE;
+        }
+    }
+    RegionLock.unlock();
+
+    return _objc_slabRegionEnd != 0;
+}
+
+
+/***********************************************************************
+* carveChunk
+* Give size class sc a fresh chunk to carve blocks from.
+* Returns false if the region is exhausted.
+* Locking: sc's lock must be held. Acquires RegionLock.
+**********************************************************************/
+static bool carveChunk(unsigned sc)
+{
+    SlabSizeClass& klass = SizeClasses[sc];
+
+    RegionLock.lock();
+    uintptr_t chunk = RegionNext;
+    if (chunk >= _objc_slabRegionEnd) {
+        RegionLock.unlock();
+        return false;
+    }
+    RegionNext += SLAB_CHUNK_SIZE;
+    ChunkSizeClass[(chunk - _objc_slabRegionStart) >> SLAB_CHUNK_SHIFT] =
+        (uint8_t)(sc + 1);
+    RegionLock.unlock();
+
+    klass.carveNext = chunk;
+    klass.carveEnd = chunk + SLAB_CHUNK_SIZE;
+    klass.stats.chunks++;
+    return true;
+}
+
+
+/***********************************************************************
+* depotTake
+* Remove up to max blocks from size class sc's depot, carving new
+* blocks when the depot is empty. Returns the number of blocks taken.
+* Locking: acquires sc's lock
+**********************************************************************/
+static uint32_t depotTake(unsigned sc, SlabBlock **outHead, uint32_t max)
+{
+    SlabSizeClass& klass = SizeClasses[sc];
+    size_t size = blockSize(sc);
+    SlabBlock *head = nil;
+    uint32_t count = 0;
+
+    klass.lock.lock();
+
+    while (count < max  &&  klass.depot) {
+        SlabBlock *b = klass.depot;
+        klass.depot = b->next;
+        b->next = head;
+        head = b;
+        count++;
+    }
+    klass.stats.free -= count;
+    klass.stats.refills++;
+
+    while (count < max) {
+        if (klass.carveNext + size > klass.carveEnd  &&  !carveChunk(sc)) {
+            break;
+        }
+        SlabBlock *b = (SlabBlock *)klass.carveNext;
+        klass.carveNext += size;
+        klass.stats.capacity++;
+        b->next = head;
+        head = b;
+        count++;
+    }
+
+    klass.lock.unlock();
+
+    *outHead = head;
+    return count;
+}
+
+
+/***********************************************************************
+* depotPut
+* Return count blocks linked from head to size class sc's depot.
+* Locking: acquires sc's lock
+**********************************************************************/
+static void depotPut(unsigned sc, SlabBlock *head, uint32_t count)
+{
+    if (!head) return;
+
+    SlabBlock *tail = head;
+    while (tail->next) tail = tail->next;
+
+    SlabSizeClass& klass = SizeClasses[sc];
+    klass.lock.lock();
+    tail->next = klass.depot;
+    klass.depot = head;
+    klass.stats.free += count;
+    klass.stats.flushes++;
+    klass.lock.unlock();
+}
+
+
+// Account for blocks allocated or freed outside any live thread's magazine.
+static void addExitedInUse(unsigned sc, intptr_t delta)
+{
+    SlabSizeClass& klass = SizeClasses[sc];
+    klass.lock.lock();
+    klass.stats.inUse += delta;
+    klass.lock.unlock();
+}
+
+
+static SlabMagazine *magazines(bool create)
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(create);
+    if (!data) return nil;
+    if (!data->slabThread  &&  create) {
+        SlabThread *t = (SlabThread *)calloc(1, sizeof(SlabThread));
+        ThreadsLock.lock();
+        t->next = LiveThreads;
+        t->prevp = &LiveThreads;
+        if (LiveThreads) LiveThreads->prevp = &t->next;
+        LiveThreads = t;
+        ThreadsLock.unlock();
+        data->slabThread = t;
+    }
+    return data->slabThread ? data->slabThread->mags : nil;
+}
+
+
+/***********************************************************************
+* _objc_slabCalloc
+* Allocate size zeroed bytes, from a slab if size is small enough.
+* Locking: none on the fast path
+**********************************************************************/
+void *_objc_slabCalloc(size_t size)
+{
+    if (DisableSlabAllocator  ||  size == 0  ||  size > SLAB_MAX_SIZE  ||
+        !reserveRegion())
+    {
+        return calloc(1, size);
+    }
+
+    unsigned sc = sizeClassForSize(size);
+    SlabMagazine *mags = magazines(true);
+    SlabBlock *b;
+
+    if (mags) {
+        SlabMagazine& mag = mags[sc];
+        if (!mag.head) {
+            mag.count = depotTake(sc, &mag.head, SLAB_MAGAZINE_BATCH);
+            if (mag.count == 0) return calloc(1, size);
+        }
+        b = mag.head;
+        mag.head = b->next;
+        mag.count--;
+        mag.inUse++;
+    }
+    else {
+        if (depotTake(sc, &b, 1) == 0) return calloc(1, size);
+        addExitedInUse(sc, 1);
+    }
+
+    bzero(b, blockSize(sc));
+    return b;
+}
+
+
+/***********************************************************************
+* _objc_slabBatchCalloc
+* Allocate up to num zeroed blocks of size bytes into results, 
+* draining this thread's magazine first and taking the rest from the 
+* depot in one locked operation. Returns the number allocated, which 
+* is 0 if size is not served by the slab allocator.
+**********************************************************************/
+unsigned _objc_slabBatchCalloc(size_t size, void **results, unsigned num)
+{
+    if (DisableSlabAllocator  ||  size == 0  ||  size > SLAB_MAX_SIZE  ||
+        !reserveRegion())
+    {
+        return 0;
+    }
+
+    unsigned sc = sizeClassForSize(size);
+    SlabMagazine *mags = magazines(true);
+    unsigned n = 0;
+
+    if (mags) {
+        SlabMagazine& mag = mags[sc];
+        while (n < num  &&  mag.head) {
+            results[n++] = mag.head;
+            mag.head = mag.head->next;
+            mag.count--;
+        }
+    }
+
+    if (n < num) {
+        SlabBlock *head;
+        depotTake(sc, &head, num - n);
+        while (head) {
+            results[n++] = head;
+            head = head->next;
+        }
+    }
+
+    if (mags) mags[sc].inUse += n;
+    else addExitedInUse(sc, n);
+
+    size_t bsize = blockSize(sc);
+    for (unsigned i = 0; i < n; i++) {
+        bzero(results[i], bsize);
+    }
+    return n;
+}
+
+
+/***********************************************************************
+* _objc_slabFree
+* Free a block allocated by _objc_slabCalloc.
+* Locking: none on the fast path
+**********************************************************************/
+void _objc_slabFree(void *p)
+{
+    assert(_objc_isSlabPointer(p));
+
+    unsigned sc = sizeClassForPointer(p);
+    SlabBlock *b = (SlabBlock *)p;
+    // Don't create pthread data for a thread that is exiting.
+    SlabMagazine *mags = magazines(false);
+    if (!mags) {
+        b->next = nil;
+        depotPut(sc, b, 1);
+        addExitedInUse(sc, -1);
+        return;
+    }
+
+    SlabMagazine& mag = mags[sc];
+    b->next = mag.head;
+    mag.head = b;
+    mag.inUse--;
+    if (++mag.count > SLAB_MAGAZINE_LIMIT) {
+        // Keep SLAB_MAGAZINE_BATCH blocks, give the rest back.
+        SlabBlock *keep = mag.head;
+        for (uint32_t i = 1; i < SLAB_MAGAZINE_BATCH; i++) keep = keep->next;
+        SlabBlock *give = keep->next;
+        uint32_t count = mag.count - SLAB_MAGAZINE_BATCH;
+        keep->next = nil;
+        mag.count = SLAB_MAGAZINE_BATCH;
+        depotPut(sc, give, count);
+    }
+}
+
+
+/***********************************************************************
+* _objc_slabSize
+* Size of the slab block containing p, or 0 if p is not a slab block.
+**********************************************************************/
+size_t _objc_slabSize(const void *p)
+{
+    if (!_objc_isSlabPointer(p)) return 0;
+    if ((uintptr_t)p >= RegionNext) return 0;
+    size_t chunk = ((uintptr_t)p - _objc_slabRegionStart) >> SLAB_CHUNK_SHIFT;
+    if (ChunkSizeClass[chunk] == 0) return 0;
+    size_t size = blockSize(ChunkSizeClass[chunk] - 1);
+    if (((uintptr_t)p - _objc_slabRegionStart) % SLAB_CHUNK_SIZE % size) {
+        return 0;  // interior pointer
+    }
+    return size;
+}
+
+
+/***********************************************************************
+* _destroySlabThread
+* Return an exiting thread's cached blocks to the depots.
+* Locking: acquires ThreadsLock and the size class locks
+**********************************************************************/
+void _destroySlabThread(SlabThread *t)
+{
+    if (!t) return;
+
+    ThreadsLock.lock();
+    *t->prevp = t->next;
+    if (t->next) t->next->prevp = t->prevp;
+    ThreadsLock.unlock();
+
+    for (unsigned sc = 0; sc < SLAB_SIZE_CLASSES; sc++) {
+        SlabMagazine& mag = t->mags[sc];
+        depotPut(sc, mag.head, mag.count);
+        addExitedInUse(sc, mag.inUse);
+    }
+    free(t);
+}
+
+
+/***********************************************************************
+* Slab statistics
+* Live threads' magazines are read without stopping the threads, 
+* so the numbers are exact only while no other thread allocates.
+* Locking: acquires ThreadsLock and sc's lock
+**********************************************************************/
+static void copyStats(unsigned sc, objc_slabStatistics *outStats)
+{
+    SlabSizeClass& klass = SizeClasses[sc];
+
+    klass.lock.lock();
+    *outStats = klass.stats;
+    klass.lock.unlock();
+
+    ThreadsLock.lock();
+    for (SlabThread *t = LiveThreads; t; t = t->next) {
+        outStats->inUse += t->mags[sc].inUse;
+        outStats->cached += t->mags[sc].count;
+    }
+    ThreadsLock.unlock();
+
+    outStats->blockSize = blockSize(sc);
+}
+
+unsigned _objc_slabGetStatistics(objc_slabStatistics *outStats, unsigned count)
+{
+    if (outStats) {
+        for (unsigned sc = 0; sc < count  &&  sc < SLAB_SIZE_CLASSES; sc++) {
+            copyStats(sc, &outStats[sc]);
+        }
+    }
+    return SLAB_SIZE_CLASSES;
+}
+
+BOOL _objc_slabGetStatisticsForSize(size_t size, objc_slabStatistics *outStats)
+{
+    if (!outStats  ||  size == 0  ||  size > SLAB_MAX_SIZE) return NO;
+    copyStats(sizeClassForSize(size), outStats);
+    return YES;
+}
+
+
+/***********************************************************************
+* Slab malloc zone
+* Lets malloc_size(), free() and realloc() find slab blocks.
+* New allocations through the zone are forwarded to the default zone.
+**********************************************************************/
+static size_t zone_size(malloc_zone_t *zone __unused, const void *p)
+{
+    return _objc_slabSize(p);
+}
+
+static void *zone_malloc(malloc_zone_t *zone __unused, size_t size)
+{
+    return malloc(size);
+}
+
+static void *zone_calloc(malloc_zone_t *zone __unused, size_t n, size_t size)
+{
+    return calloc(n, size);
+}
+
+static void *zone_valloc(malloc_zone_t *zone __unused, size_t size)
+{
+    return valloc(size);
+}
+
+static void zone_free(malloc_zone_t *zone __unused, void *p)
+{
+    if (p) _objc_slabFree(p);
+}
+
+static void *zone_realloc(malloc_zone_t *zone __unused, void *p, size_t size)
+{
+    if (!p) return malloc(size);
+    size_t oldSize = _objc_slabSize(p);
+    void *result = malloc(size);
+    if (!result) return nil;
+    memcpy(result, p, MIN(oldSize, size));
+    _objc_slabFree(p);
+    return result;
+}
+
+static void zone_destroy(malloc_zone_t *zone __unused)
+{
+    // the slab zone is never destroyed
+}
+
+static kern_return_t
+zone_enumerator(task_t task, void *context, unsigned typeMask,
+                vm_address_t zoneAddress __unused,
+                memory_reader_t reader __unused,
+                vm_range_recorder_t recorder)
+{
+    // Only the carved part of the region in this task is reported.
+    if (task != mach_task_self()) return KERN_SUCCESS;
+    if (!(typeMask & MALLOC_PTR_REGION_RANGE_TYPE)) return KERN_SUCCESS;
+    if (!_objc_slabRegionEnd) return KERN_SUCCESS;
+
+    vm_range_t range;
+    range.address = _objc_slabRegionStart;
+    range.size = MIN(RegionNext, _objc_slabRegionEnd) - _objc_slabRegionStart;
+    recorder(task, context, MALLOC_PTR_REGION_RANGE_TYPE, &range, 1);
+    return KERN_SUCCESS;
+}
+
+static size_t zone_good_size(malloc_zone_t *zone __unused, size_t size)
+{
+    if (size == 0  ||  size > SLAB_MAX_SIZE) return size;
+    return blockSize(sizeClassForSize(size));
+}
+
+static boolean_t zone_check(malloc_zone_t *zone __unused)
+{
+    return true;
+}
+
+static void zone_print(malloc_zone_t *zone __unused, boolean_t verbose __unused)
+{
+    for (unsigned sc = 0; sc < SLAB_SIZE_CLASSES; sc++) {
+        objc_slabStatistics stats;
+        copyStats(sc, &stats);
+        if (stats.chunks == 0) continue;
+        _objc_inform("SLAB: %zu-byte blocks: %zu chunks, %zu in use, "
+                     "%zu cached, %zu free", stats.blockSize, stats.chunks,
+                     stats.inUse, stats.cached, stats.free);
+    }
+}
+
+static void zone_log(malloc_zone_t *zone __unused, void *address __unused)
+{
+}
+
+static void zone_force_lock(malloc_zone_t *zone __unused)
+{
+    // ThreadsLock before the size classes as in _destroySlabThread(), 
+    // so a fork child never inherits it held by a vanished thread.
+    ThreadsLock.lock();
+    // same order as carveChunk()
+    for (unsigned sc = 0; sc < SLAB_SIZE_CLASSES; sc++) {
+        SizeClasses[sc].lock.lock();
+    }
+    RegionLock.lock();
+}
+
+static void zone_force_unlock(malloc_zone_t *zone __unused)
+{
+    RegionLock.unlock();
+    for (unsigned sc = 0; sc < SLAB_SIZE_CLASSES; sc++) {
+        SizeClasses[sc].lock.unlock();
+    }
+    ThreadsLock.unlock();
+}
+
+static void zone_statistics(malloc_zone_t *zone __unused,
+                            malloc_statistics_t *outStats)
+{
+    bzero(outStats, sizeof(*outStats));
+    for (unsigned sc = 0; sc < SLAB_SIZE_CLASSES; sc++) {
+        objc_slabStatistics stats;
+        copyStats(sc, &stats);
+        outStats->blocks_in_use += (unsigned)stats.inUse;
+        outStats->size_in_use += stats.inUse * stats.blockSize;
+        outStats->size_allocated += stats.chunks * SLAB_CHUNK_SIZE;
+    }
+    outStats->max_size_in_use = outStats->size_in_use;
+}
+
+static malloc_introspection_t SlabZoneIntrospect = {
+    zone_enumerator, zone_good_size, zone_check, zone_print,
+    zone_log, zone_force_lock, zone_force_unlock, zone_statistics
+};
+
+static void registerZone(void)
+{
+    SlabZone.size = zone_size;
+    SlabZone.malloc = zone_malloc;
+    SlabZone.calloc = zone_calloc;
+    SlabZone.valloc = zone_valloc;
+    SlabZone.free = zone_free;
+    SlabZone.realloc = zone_realloc;
+    SlabZone.destroy = zone_destroy;
+    SlabZone.zone_name = "ObjCSlabZone";
+    SlabZone.introspect = &SlabZoneIntrospect;
+    // No memalign or free_definite_size.
+    SlabZone.version = 4;
+    malloc_zone_register(&SlabZone);
+}
+
+// SUPPORT_SLAB_ALLOCATOR
+#else
+// not SUPPORT_SLAB_ALLOCATOR
+
+unsigned _objc_slabGetStatistics(objc_slabStatistics *outStats __unused,
+                                 unsigned count __unused)
+{
+    return 0;
+}
+
+BOOL _objc_slabGetStatisticsForSize(size_t size __unused,
+                                     objc_slabStatistics *outStats __unused)
+{
+    return NO;
+}
+
+// not SUPPORT_SLAB_ALLOCATOR
+#endif
@@ -103,6 +103,30 @@ OBJC_EXPORT  int objc_sync_enter(id obj)
 OBJC_EXPORT  int objc_sync_exit(id obj)
     __OSX_AVAILABLE_STARTING(__MAC_10_3, __IPHONE_2_0);
 
+/**
+ * Begin synchronizing on 'obj' in shared mode.
+ * Any number of threads may hold 'obj' shared at once. Shared holders 
+ * exclude holders from objc_sync_enter(), and vice versa.
+ * A thread holding 'obj' exclusively may also enter it shared. 
+ * A thread holding 'obj' only shared must not call objc_sync_enter() on it.
+ *
+ * @param obj The object to begin synchronizing on.
+ *
+ * @return OBJC_SYNC_SUCCESS once lock is acquired.
+ */
+OBJC_EXPORT  int objc_sync_enter_shared(id obj)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
+/**
+ * End synchronizing on 'obj' in shared mode.
+ *
+ * @param obj The object to end synchronizing on.
+ *
+ * @return OBJC_SYNC_SUCCESS or OBJC_SYNC_NOT_OWNING_THREAD_ERROR
+ */
+OBJC_EXPORT  int objc_sync_exit_shared(id obj)
+    __OSX_AVAILABLE_STARTING(__MAC_10_11, __IPHONE_9_0);
+
 
 
 // The wait/notify functions have never worked correctly and no longer exist.
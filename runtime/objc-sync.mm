@@ -34,13 +34,18 @@ typedef struct SyncData { // 同步数据结构体
     struct SyncData* nextData; // 指向下一个 SyncData，看来是链表
     DisguisedPtr<objc_object> object; // 锁住的对象
     int32_t threadCount;  // 使用这个block(???)的线程数  number of THREADS using this block
+    int32_t sharedCount;  // number of THREADS holding this block shared
+    volatile bool sharedWaiter;  // an exclusive acquirer waits for sharedCount
     recursive_mutex_t mutex; // 递归锁
+    monitor_t handoff;    // a thin holder or the last shared holder 
+                          // wakes a waiting monitor acquirer
 } SyncData;
 
 
 typedef struct {
     SyncData *data;
     unsigned int lockCount;  // number of times THIS THREAD locked this block
+    bool shared;             // lockCount counts shared rather than exclusive holds
 } SyncCacheItem;
 
 
@@ -56,13 +61,18 @@ typedef struct SyncCache {
   a single object at a time.
   SYNC_DATA_DIRECT_KEY  == SyncCacheItem.data
   SYNC_COUNT_DIRECT_KEY == SyncCacheItem.lockCount
+  The fast cache only records exclusive holds. A thread holding an 
+  object both ways has two SyncCacheItems for it, one per mode.
  */
 
 struct SyncList {
     SyncData *data;
     spinlock_t lock; // 自旋锁
+    int32_t monitorUsers;  // threads using any SyncData in this list
+    uint32_t length;       // SyncData in this list, guarded by lock
+    uint32_t maxLength;    // largest length so far, guarded by lock
 
-    SyncList() : data(nil) { }
+    SyncList() : data(nil), monitorUsers(0), length(0), maxLength(0) { }
 };
 
 // Use multiple parallel lists to decrease contention among unrelated objects.
@@ -70,13 +80,190 @@ struct SyncList {
 #define LIST_FOR_OBJ(obj) sDataLists[obj].data
 static StripedMap<SyncList> sDataLists;
 
+
+/*
+  Thin locks: an uncontended @synchronized takes no SyncData. 
+  ThinLockWords is a fixed table of lock words indexed by object 
+  address. A thread owns the thin lock of obj if it swapped its word 
+  from 0 to obj, and records it in its _objc_pthread_data with separate 
+  counts of exclusive and shared holds, so recursive enter and exit 
+  touch no shared state. The word is released when both reach 0.
+
+  Any other use goes through the SyncData monitor ("inflated"): 
+  contention on the word, a word taken by another object, a tagged 
+  pointer, or a thread already holding SYNC_THIN_LOCK_CACHE thin locks. 
+  The two schemes exclude each other with two counters:
+  - a thin acquirer backs off after its swap if monitorUsers of the 
+    object's SyncList is nonzero;
+  - a monitor acquirer, holding the mutex, waits until the word no 
+    longer names the object.
+  Each side publishes itself with a barrier before checking the other, 
+  so at least one of them sees the other. While monitors are in use 
+  in a stripe its objects stay inflated; once they are idle, enters 
+  use thin locks again and the idle SyncData are reclaimed.
+
+  A monitor acquirer that finds the word held sets THIN_LOCK_INFLATED 
+  in it and sleeps on the SyncData's handoff monitor. The thin holder's 
+  exit then fails to swap the word back to 0, clears it under that 
+  monitor instead, and wakes the acquirer. Nobody polls for a thin 
+  holder.
+ */
+
+#if TARGET_OS_EMBEDDED
+#   define THIN_LOCK_COUNT 256
+#else
+#   define THIN_LOCK_COUNT 1024
+#endif
+
+// Set in a held thin lock word by a monitor acquirer waiting for it.
+#define THIN_LOCK_INFLATED ((uintptr_t)1)
+
+static void * volatile ThinLockWords[THIN_LOCK_COUNT];
+
+static SyncData *syncDataForObject(id object);
+
+static inline void * volatile *thinLockWordForObject(id object)
+{
+    uintptr_t addr = (uintptr_t)object;
+    return &ThinLockWords[((addr >> 4) ^ (addr >> 14)) % THIN_LOCK_COUNT];
+}
+
+// Give up object's thin lock word, waking a monitor acquirer 
+// that inflated it while this thread held it.
+static void thinLockRelease(id object, void * volatile *word)
+{
+    if (OSAtomicCompareAndSwapPtrBarrier(object, nil, word)) return;
+
+    // The inflating acquirer holds a use of its SyncData until 
+    // the word is cleared, so the SyncData can't go away here.
+    SyncData *data = syncDataForObject(object);
+    if (!data) _objc_fatal("thin lock %p inflated without a monitor", 
+                           (void *)object);
+    monitor_locker_t lock(data->handoff);
+    *word = nil;
+    data->handoff.notifyAll();
+}
+
+// Acquire or re-acquire object's thin lock. 
+// Returns false if the caller must use the monitor instead.
+static bool thinLockEnter(id object)
+{
+    if (object->isTaggedPointer()) return false;
+
+    _objc_pthread_data *data = _objc_fetch_pthread_data(YES);
+    if (!data) return false;
+
+    SyncThinLockItem *freeItem = nil;
+    for (unsigned int i = 0; i < SYNC_THIN_LOCK_CACHE; i++) {
+        SyncThinLockItem *item = &data->syncThinLocks[i];
+        if (item->object == (objc_object *)object) {
+            item->lockCount++;
+            return true;
+        }
+        if (!item->object  &&  !freeItem) freeItem = item;
+    }
+    if (!freeItem) return false;
+
+    void * volatile *word = thinLockWordForObject(object);
+    if (!OSAtomicCompareAndSwapPtrBarrier(nil, object, word)) return false;
+
+    if (sDataLists[object].monitorUsers != 0) {
+        // The monitor may be held. Let it win.
+        thinLockRelease(object, word);
+        return false;
+    }
+
+    freeItem->object = (objc_object *)object;
+    freeItem->lockCount = 1;
+    freeItem->sharedCount = 0;
+    return true;
+}
+
+// Nest a shared hold inside this thread's thin lock of object, 
+// if it holds it.
+static bool thinLockRecurse(id object)
+{
+    if (object->isTaggedPointer()) return false;
+
+    _objc_pthread_data *data = _objc_fetch_pthread_data(NO);
+    if (!data) return false;
+
+    for (unsigned int i = 0; i < SYNC_THIN_LOCK_CACHE; i++) {
+        SyncThinLockItem *item = &data->syncThinLocks[i];
+        if (item->object == (objc_object *)object) {
+            item->sharedCount++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Release one exclusive or shared hold of object's thin lock. 
+// Returns false if this thread has no such hold.
+static bool thinLockExit(id object, bool shared)
+{
+    if (object->isTaggedPointer()) return false;
+
+    _objc_pthread_data *data = _objc_fetch_pthread_data(NO);
+    if (!data) return false;
+
+    for (unsigned int i = 0; i < SYNC_THIN_LOCK_CACHE; i++) {
+        SyncThinLockItem *item = &data->syncThinLocks[i];
+        if (item->object != (objc_object *)object) continue;
+        uintptr_t& count = shared ? item->sharedCount : item->lockCount;
+        if (count == 0) return false;
+        if (--count == 0  &&  
+            item->lockCount == 0  &&  item->sharedCount == 0) 
+        {
+            item->object = nil;
+            thinLockRelease(object, thinLockWordForObject(object));
+        }
+        return true;
+    }
+    return false;
+}
+
+// Called by a monitor acquirer holding data's mutex: 
+// wait out a thin holder that acquired before the monitor was in use.
+// Returns true if there was a thin holder to wait for.
+static bool thinLockWait(id object, SyncData *data)
+{
+    if (object->isTaggedPointer()) return false;
+
+    void * volatile *word = thinLockWordForObject(object);
+    void *inflated = (void *)((uintptr_t)object | THIN_LOCK_INFLATED);
+    OSMemoryBarrier();
+    do {
+        // Only the mutex holder inflates, so the word is never 
+        // inflated for this object here.
+        if (*word != (void *)object) return false;
+    } while (!OSAtomicCompareAndSwapPtrBarrier(object, inflated, word));
+
+    // Sleep until thinLockRelease() clears the word.
+    monitor_locker_t lock(data->handoff);
+    while (*word == inflated) data->handoff.wait();
+    return true;
+}
+
 // id2data() 中有用到，SyncData 的用途
 enum usage {
     ACQUIRE, // 获得锁
     RELEASE, // 释放锁
-    CHECK    // 检查锁
+    CHECK,   // 检查锁
+    ACQUIRE_SHARED, 
+    RELEASE_SHARED
 };
 
+static inline bool usageIsShared(enum usage why) {
+    return why == ACQUIRE_SHARED  ||  why == RELEASE_SHARED;
+}
+static inline bool usageIsAcquire(enum usage why) {
+    return why == ACQUIRE  ||  why == ACQUIRE_SHARED;
+}
+static inline bool usageIsRelease(enum usage why) {
+    return why == RELEASE  ||  why == RELEASE_SHARED;
+}
+
 static SyncCache *fetch_cache(bool create)
 {
     _objc_pthread_data *data;
@@ -113,7 +300,33 @@ void _destroySyncCache(struct SyncCache *cache)
 }
 
 
-static SyncData* id2data(id object, enum usage why)
+// The SyncData some thread is using for object, or nil.
+static SyncData *syncDataForObject(id object)
+{
+    spinlock_t& lock = LOCK_FOR_OBJ(object);
+    lock.lock();
+    SyncData *p;
+    for (p = LIST_FOR_OBJ(object); p; p = p->nextData) {
+        if (p->object == object  &&  p->threadCount > 0) break;
+    }
+    lock.unlock();
+    return p;
+}
+
+
+// Last RELEASE of data by this thread: called after its mutex 
+// is unlocked, because data may be reclaimed once threadCount is 0.
+static void releaseSyncData(id object, SyncData *data)
+{
+    OSAtomicDecrement32Barrier(&sDataLists[object].monitorUsers);
+    OSAtomicDecrement32Barrier(&data->threadCount);
+}
+
+
+// *outerUse is set by the thread's outermost acquire or release of the 
+// result in the given mode. After the outermost RELEASE the caller 
+// must call releaseSyncData() once it is done with the result.
+static SyncData* id2data(id object, enum usage why, bool *outerUse = nil)
 {
     spinlock_t *lockp = &LOCK_FOR_OBJ(object);
     SyncData **listp = &LIST_FOR_OBJ(object);
@@ -126,7 +339,7 @@ static SyncData* id2data(id object, enum usage why)
     if (data) {
         fastCacheOccupied = YES;
 
-        if (data->object == object) {
+        if (data->object == object  &&  !usageIsShared(why)) {
             // Found a match in fast cache.
             uintptr_t lockCount;
 
@@ -148,11 +361,11 @@ static SyncData* id2data(id object, enum usage why)
                 if (lockCount == 0) {
                     // remove from fast cache
                     tls_set_direct(SYNC_DATA_DIRECT_KEY, NULL);
-                    // atomic because may collide with concurrent ACQUIRE
-                    OSAtomicDecrement32Barrier(&result->threadCount);
+                    // threadCount is dropped by releaseSyncData()
+                    *outerUse = true;
                 }
                 break;
-            case CHECK:
+            default:
                 // do nothing
                 break;
             }
@@ -169,6 +382,7 @@ static SyncData* id2data(id object, enum usage why)
         for (i = 0; i < cache->used; i++) {
             SyncCacheItem *item = &cache->list[i];
             if (item->data->object != object) continue;
+            if (why != CHECK  &&  item->shared != usageIsShared(why)) continue;
 
             // Found a match.
             result = item->data;
@@ -178,15 +392,17 @@ static SyncData* id2data(id object, enum usage why)
                 
             switch(why) {
             case ACQUIRE:
+            case ACQUIRE_SHARED:
                 item->lockCount++;
                 break;
             case RELEASE:
+            case RELEASE_SHARED:
                 item->lockCount--;
                 if (item->lockCount == 0) {
                     // remove from per-thread cache
                     cache->list[i] = cache->list[--cache->used];
-                    // atomic because may collide with concurrent ACQUIRE
-                    OSAtomicDecrement32Barrier(&result->threadCount);
+                    // threadCount is dropped by releaseSyncData()
+                    *outerUse = true;
                 }
                 break;
             case CHECK:
@@ -209,20 +425,34 @@ static SyncData* id2data(id object, enum usage why)
 
     {
         SyncData* p;
+        SyncData **pp = listp;
         SyncData* firstUnused = NULL;
-        for (p = *listp; p != NULL; p = p->nextData) {
+        while ((p = *pp) != NULL) {
             if ( p->object == object ) {
                 result = p;
-                // atomic because may collide with concurrent RELEASE
-                OSAtomicIncrement32Barrier(&result->threadCount);
+                if (usageIsAcquire(why)) {
+                    // atomic because may collide with concurrent RELEASE
+                    OSAtomicIncrement32Barrier(&result->threadCount);
+                }
                 goto done;
             }
-            if ( (firstUnused == NULL) && (p->threadCount == 0) )
-                firstUnused = p;
+            if (p->threadCount == 0) {
+                if (firstUnused == NULL) {
+                    firstUnused = p;
+                } else {
+                    // Reclaim idle monitors beyond one spare per list. 
+                    // Nobody else can reach a SyncData with no threads.
+                    *pp = p->nextData;
+                    free(p);
+                    sDataLists[object].length--;
+                    continue;
+                }
+            }
+            pp = &p->nextData;
         }
     
         // no SyncData currently associated with object
-        if ( (why == RELEASE) || (why == CHECK) )
+        if ( usageIsRelease(why) || (why == CHECK) )
             goto done;
     
         // an unused one was found, use it
@@ -237,30 +467,40 @@ static SyncData* id2data(id object, enum usage why)
     // malloc a new SyncData and add to list.
     // XXX calling malloc with a global lock held is bad practice,
     // might be worth releasing the lock, mallocing, and searching again.
-    // But since we never free these guys we won't be stuck in malloc very often.
+    // But since we rarely free these guys we won't be stuck in malloc very often.
     result = (SyncData*)calloc(sizeof(SyncData), 1);
     result->object = (objc_object *)object;
     result->threadCount = 1;
     new (&result->mutex) recursive_mutex_t();
+    new (&result->handoff) monitor_t();
     result->nextData = *listp;
     *listp = result;
+    {
+        SyncList& list = sDataLists[object];
+        if (++list.length > list.maxLength) list.maxLength = list.length;
+    }
     
  done:
+    if (result  &&  usageIsAcquire(why)) {
+        // Published before the caller checks for a thin lock holder.
+        OSAtomicIncrement32Barrier(&sDataLists[object].monitorUsers);
+    }
     lockp->unlock();
     if (result) {
         // Only new ACQUIRE should get here.
         // All RELEASE and CHECK and recursive ACQUIRE are 
         // handled by the per-thread caches above.
-        if (why == RELEASE) {
+        if (usageIsRelease(why)) {
             // Probably some thread is incorrectly exiting 
             // while the object is held by another thread.
             return nil;
         }
-        if (why != ACQUIRE) _objc_fatal("id2data is buggy");
+        if (!usageIsAcquire(why)) _objc_fatal("id2data is buggy");
         if (result->object != object) _objc_fatal("id2data is buggy");
+        if (outerUse) *outerUse = true;
 
 #if SUPPORT_DIRECT_THREAD_KEYS
-        if (!fastCacheOccupied) {
+        if (!fastCacheOccupied  &&  why == ACQUIRE) {
             // Save in fast thread cache
             tls_set_direct(SYNC_DATA_DIRECT_KEY, result);
             tls_set_direct(SYNC_COUNT_DIRECT_KEY, (void*)1);
@@ -271,6 +511,7 @@ static SyncData* id2data(id object, enum usage why)
             if (!cache) cache = fetch_cache(YES);
             cache->list[cache->used].data = result;
             cache->list[cache->used].lockCount = 1;
+            cache->list[cache->used].shared = usageIsShared(why);
             cache->used++;
         }
     }
@@ -279,6 +520,350 @@ static SyncData* id2data(id object, enum usage why)
 }
 
 
+/*
+  Shared holds: readers of a SyncData pass through its mutex only to 
+  register in sharedCount, then drop it, so they do not serialize 
+  for the length of their critical sections. An outermost exclusive 
+  acquirer keeps the mutex, which stops new readers, and sleeps on the 
+  handoff monitor until sharedCount drains; the reader whose exit takes 
+  sharedCount to 0 wakes it. A thread's nested shared holds, and shared 
+  holds inside its thin lock, take no lock at all. A shared hold 
+  cannot be upgraded to exclusive.
+ */
+
+// Called by an outermost exclusive acquirer holding the mutex: 
+// wait for shared holders to leave. Returns true if there were any.
+static bool sharedLockWait(SyncData *data)
+{
+    OSMemoryBarrier();
+    if (data->sharedCount == 0) return false;
+
+    SyncCache *cache = fetch_cache(NO);
+    for (unsigned int i = 0; cache  &&  i < cache->used; i++) {
+        if (cache->list[i].data == data  &&  cache->list[i].shared) {
+            _objc_fatal("objc_sync_enter(%p): this thread holds the object "
+                        "with objc_sync_enter_shared(), which cannot be "
+                        "upgraded", (void *)data->object);
+        }
+    }
+
+    // sharedWaiter and sharedCount are each written before the other 
+    // is read, with barriers, so either the last reader sees the flag 
+    // or this thread sees the count reach 0.
+    monitor_locker_t lock(data->handoff);
+    data->sharedWaiter = true;
+    OSMemoryBarrier();
+    while (data->sharedCount > 0) data->handoff.wait();
+    data->sharedWaiter = false;
+    return true;
+}
+
+// Drop one outermost shared hold, waking an exclusive acquirer 
+// waiting in sharedLockWait() if this was the last one.
+static void sharedLockExit(SyncData *data)
+{
+    if (OSAtomicDecrement32Barrier(&data->sharedCount) != 0) return;
+    if (!data->sharedWaiter) return;
+
+    monitor_locker_t lock(data->handoff);
+    data->handoff.notifyAll();
+}
+
+// Acquire obj exclusive. Returns true if another thread made us wait.
+static inline bool syncEnter(id obj)
+{
+    // Uncontended: one compare-and-swap, no SyncData.
+    if (thinLockEnter(obj)) return false;
+
+    bool outerUse = false;
+    bool contended = false;
+    SyncData* data = id2data(obj, ACQUIRE, &outerUse); // 为 obj 对象绑定一个递归锁
+    assert(data);
+    if (!data->mutex.tryLock()) { // 递归锁加锁
+        contended = true;
+        data->mutex.lock();
+    }
+    if (thinLockWait(obj, data)) contended = true;
+    if (outerUse  &&  sharedLockWait(data)) contended = true;
+    return contended;
+}
+
+// Acquire obj shared. Returns true if another thread made us wait.
+static bool syncEnterShared(id obj)
+{
+    // A thin holder already excludes everyone else.
+    if (thinLockRecurse(obj)) return false;
+
+    bool outerUse = false;
+    bool contended = false;
+    SyncData* data = id2data(obj, ACQUIRE_SHARED, &outerUse);
+    assert(data);
+    if (!outerUse) return false;
+
+    if (!data->mutex.tryLock()) {
+        contended = true;
+        data->mutex.lock();
+    }
+    if (thinLockWait(obj, data)) contended = true;
+    OSAtomicIncrement32Barrier(&data->sharedCount);
+    data->mutex.unlock();
+    return contended;
+}
+
+
+/***********************************************************************
+* @synchronized statistics
+* Recorded when OBJC_RECORD_SYNC_STATISTICS or OBJC_PRINT_SYNC_STATISTICS 
+* is set. Records are keyed by the locked object's class and the caller 
+* of objc_sync_enter(), in a fixed open-addressed table. A record is 
+* claimed under SyncStatsLock; its counters are updated atomically. 
+* Each thread keeps a small stack of the objects it holds, so the 
+* outermost exit can compute the hold time.
+**********************************************************************/
+
+#define SYNC_STATS_COUNT 1024  // power of 2
+#define SYNC_STATS_HELD 16
+
+struct SyncStatsRecord {
+    Class volatile cls;
+    const void * volatile caller;
+    volatile bool used;
+    int64_t acquisitions;
+    int64_t contended;
+    int64_t waitTime;
+    int64_t maxHoldTime;
+};
+
+struct SyncStatsHeld {
+    id object;
+    uintptr_t lockCount;
+    uint64_t start;
+    SyncStatsRecord *record;
+};
+
+struct SyncStatsThread {
+    unsigned int count;
+    SyncStatsHeld held[SYNC_STATS_HELD];
+};
+
+static bool RecordSyncStats;
+static spinlock_t SyncStatsLock;
+// The extra last record collects everything once the table is full.
+static SyncStatsRecord SyncStats[SYNC_STATS_COUNT + 1];
+
+static SyncStatsRecord *syncStatsRecord(Class cls, const void *caller)
+{
+    uintptr_t hash = ((uintptr_t)cls >> 4) ^ ((uintptr_t)caller >> 2);
+    for (unsigned int n = 0; n < SYNC_STATS_COUNT; n++) {
+        SyncStatsRecord *record = 
+            &SyncStats[(hash + n) & (SYNC_STATS_COUNT - 1)];
+        if (!record->used) {
+            SyncStatsLock.lock();
+            if (!record->used) {
+                record->cls = cls;
+                record->caller = caller;
+                OSMemoryBarrier();
+                record->used = true;
+                SyncStatsLock.unlock();
+                return record;
+            }
+            SyncStatsLock.unlock();
+        }
+        if (record->cls == cls  &&  record->caller == caller) return record;
+    }
+    return &SyncStats[SYNC_STATS_COUNT];
+}
+
+static void syncStatsMax(int64_t *value, int64_t candidate)
+{
+    int64_t old;
+    while (candidate > (old = *value)) {
+        if (OSAtomicCompareAndSwap64Barrier(old, candidate, value)) return;
+    }
+}
+
+static SyncStatsThread *syncStatsThread()
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(YES);
+    if (!data) return nil;
+    if (!data->syncStats) {
+        data->syncStats = (SyncStatsThread *)calloc(1, sizeof(SyncStatsThread));
+    }
+    return data->syncStats;
+}
+
+void _destroySyncStats(SyncStatsThread *stats)
+{
+    if (stats) free(stats);
+}
+
+// objc_sync_enter() or objc_sync_enter_shared() with statistics.
+static void syncStatsEnter(id object, const void *caller, bool shared)
+{
+    SyncStatsRecord *record = syncStatsRecord(object->getIsa(), caller);
+    uint64_t start = mach_absolute_time();
+    bool contended = shared ? syncEnterShared(object) : syncEnter(object);
+
+    uint64_t now = mach_absolute_time();
+    OSAtomicIncrement64Barrier(&record->acquisitions);
+    if (contended) {
+        OSAtomicIncrement64Barrier(&record->contended);
+        OSAtomicAdd64Barrier((int64_t)(now - start), &record->waitTime);
+    }
+
+    SyncStatsThread *stats = syncStatsThread();
+    if (!stats) return;
+    for (unsigned int i = 0; i < stats->count; i++) {
+        if (stats->held[i].object == object) {
+            stats->held[i].lockCount++;
+            return;
+        }
+    }
+    // Too many objects held at once: this one's hold time is not recorded.
+    if (stats->count == SYNC_STATS_HELD) return;
+    SyncStatsHeld& held = stats->held[stats->count++];
+    held.object = object;
+    held.lockCount = 1;
+    held.start = now;
+    held.record = record;
+}
+
+// Called by objc_sync_exit() and objc_sync_exit_shared() 
+// before the lock is released.
+static void syncStatsExit(id object)
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(NO);
+    if (!data  ||  !data->syncStats) return;
+    SyncStatsThread *stats = data->syncStats;
+
+    for (unsigned int i = 0; i < stats->count; i++) {
+        SyncStatsHeld& held = stats->held[i];
+        if (held.object != object) continue;
+        if (--held.lockCount == 0) {
+            syncStatsMax(&held.record->maxHoldTime, 
+                         (int64_t)(mach_absolute_time() - held.start));
+            held = stats->held[--stats->count];
+        }
+        return;
+    }
+}
+
+static int syncStatsCompare(const void *a, const void *b)
+{
+    uint64_t wa = ((const objc_syncStatistics *)a)->waitTime;
+    uint64_t wb = ((const objc_syncStatistics *)b)->waitTime;
+    return (wa > wb) ? -1 : (wa < wb) ? 1 : 0;
+}
+
+
+/***********************************************************************
+* _objc_syncCopyStatistics
+* Every record, sorted by total wait time, longest first.
+* Returns NULL if not recording. The caller must free() the result.
+**********************************************************************/
+objc_syncStatistics *_objc_syncCopyStatistics(unsigned int *outCount)
+{
+    if (outCount) *outCount = 0;
+    if (!RecordSyncStats) return nil;
+
+    objc_syncStatistics *result = (objc_syncStatistics *)
+        calloc(SYNC_STATS_COUNT + 1, sizeof(objc_syncStatistics));
+    unsigned int count = 0;
+    for (unsigned int i = 0; i <= SYNC_STATS_COUNT; i++) {
+        SyncStatsRecord *record = &SyncStats[i];
+        if (i < SYNC_STATS_COUNT  &&  !record->used) continue;
+        if (i == SYNC_STATS_COUNT  &&  !record->acquisitions) continue;
+        objc_syncStatistics& s = result[count++];
+        s.cls = record->cls;
+        s.caller = record->caller;
+        s.acquisitions = record->acquisitions;
+        s.contended = record->contended;
+        s.waitTime = record->waitTime;
+        s.maxHoldTime = record->maxHoldTime;
+    }
+    qsort(result, count, sizeof(objc_syncStatistics), syncStatsCompare);
+
+    if (outCount) *outCount = count;
+    return result;
+}
+
+
+/***********************************************************************
+* _objc_syncCopyListStatistics
+* SyncData list lengths for every stripe of sDataLists.
+* The caller must free() the result.
+**********************************************************************/
+objc_syncListStatistics *_objc_syncCopyListStatistics(unsigned int *outCount)
+{
+    unsigned int count = StripedMap<SyncList>::stripeCount();
+    objc_syncListStatistics *result = (objc_syncListStatistics *)
+        calloc(count, sizeof(objc_syncListStatistics));
+
+    for (unsigned int i = 0; i < count; i++) {
+        SyncList& list = sDataLists.stripeAt(i);
+        list.lock.lock();
+        result[i].length = list.length;
+        result[i].maxLength = list.maxLength;
+        for (SyncData *p = list.data; p; p = p->nextData) {
+            if (p->threadCount > 0) result[i].inUse++;
+        }
+        list.lock.unlock();
+    }
+
+    if (outCount) *outCount = count;
+    return result;
+}
+
+
+// Exit-time dump for OBJC_PRINT_SYNC_STATISTICS. 
+// Printed as plain JSON like OBJC_PRINT_POOL_STATISTICS. 
+// Times are in nanoseconds.
+static void printSyncStats(void)
+{
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+#define NS(t) ((unsigned long long)((t) * timebase.numer / timebase.denom))
+
+    unsigned int count;
+    objc_syncStatistics *all = _objc_syncCopyStatistics(&count);
+
+    fprintf(stderr, "{\"pid\": %d, \"sync_statistics\": [\n", getpid());
+    for (unsigned int i = 0; i < count; i++) {
+        const objc_syncStatistics& s = all[i];
+        Dl_info dl;
+        const char *symbol = nil;
+        if (s.caller  &&  dladdr(s.caller, &dl)) symbol = dl.dli_sname;
+        fprintf(stderr, "  {\"class\": \"%s\", \"caller\": \"%p\", "
+                "\"symbol\": \"%s\", \"acquisitions\": %llu, "
+                "\"contended\": %llu, \"wait_ns\": %llu, "
+                "\"max_hold_ns\": %llu}%s\n", 
+                s.cls ? class_getName(s.cls) : "", s.caller, 
+                symbol ? symbol : "", s.acquisitions, s.contended, 
+                NS(s.waitTime), NS(s.maxHoldTime), 
+                (i == count-1) ? "" : ",");
+    }
+    free(all);
+
+    objc_syncListStatistics *lists = _objc_syncCopyListStatistics(&count);
+    fprintf(stderr, "], \"sync_lists\": [");
+    for (unsigned int i = 0; i < count; i++) {
+        fprintf(stderr, "%s\n  {\"length\": %u, \"in_use\": %u, "
+                "\"max_length\": %u}", i ? "," : "", 
+                lists[i].length, lists[i].inUse, lists[i].maxLength);
+    }
+    fprintf(stderr, "\n]}\n");
+    free(lists);
+#undef NS
+}
+
+
+void sync_init(void)
+{
+    RecordSyncStats = RecordSyncStatistics || PrintSyncStatistics;
+    if (PrintSyncStatistics) atexit(printSyncStats);
+}
+
+
 BREAKPOINT_FUNCTION(
     void objc_sync_nil(void)
 );
@@ -295,9 +880,11 @@ int objc_sync_enter(id obj)
     int result = OBJC_SYNC_SUCCESS; // 用来记录结果，默认成功
 
     if (obj) { // obj 必须非空，
-        SyncData* data = id2data(obj, ACQUIRE); // 为 obj 对象绑定一个递归锁
-        assert(data);
-        data->mutex.lock(); // 递归锁加锁
+        if (RecordSyncStats) {
+            syncStatsEnter(obj, __builtin_return_address(0), false);
+        } else {
+            syncEnter(obj);
+        }
     }
     else { // 否则 @synchronized 啥也不干
         // @synchronized(nil) does nothing
@@ -320,7 +907,12 @@ int objc_sync_exit(id obj)
     int result = OBJC_SYNC_SUCCESS;
     
     if (obj) {
-        SyncData* data = id2data(obj, RELEASE); // 为 obj 解绑递归锁
+        if (RecordSyncStats) syncStatsExit(obj);
+
+        if (thinLockExit(obj, false)) return result;
+
+        bool outerUse = false;
+        SyncData* data = id2data(obj, RELEASE, &outerUse); // 为 obj 解绑递归锁
         if (!data) {
             result = OBJC_SYNC_NOT_OWNING_THREAD_ERROR; // 压根儿没有 objc_sync_enter 过
         } else {
@@ -328,6 +920,7 @@ int objc_sync_exit(id obj)
             if (!okay) {
                 result = OBJC_SYNC_NOT_OWNING_THREAD_ERROR; // 解锁失败
             }
+            if (outerUse) releaseSyncData(obj, data);
         }
     } else {
         // @synchronized(nil) does nothing
@@ -337,3 +930,52 @@ int objc_sync_exit(id obj)
     return result;
 }
 
+
+// Begin synchronizing on 'obj' in shared mode. 
+// Shared holders exclude objc_sync_enter() but not each other.
+// Returns OBJC_SYNC_SUCCESS once lock is acquired.
+int objc_sync_enter_shared(id obj)
+{
+    int result = OBJC_SYNC_SUCCESS;
+
+    if (obj) {
+        if (RecordSyncStats) {
+            syncStatsEnter(obj, __builtin_return_address(0), true);
+        } else {
+            syncEnterShared(obj);
+        }
+    } else {
+        if (DebugNilSync) {
+            _objc_inform("NIL SYNC DEBUG: @synchronized(nil); set a breakpoint on objc_sync_nil to debug");
+        }
+        objc_sync_nil();
+    }
+
+    return result;
+}
+
+
+// End synchronizing on 'obj' in shared mode. 
+// Returns OBJC_SYNC_SUCCESS or OBJC_SYNC_NOT_OWNING_THREAD_ERROR
+int objc_sync_exit_shared(id obj)
+{
+    int result = OBJC_SYNC_SUCCESS;
+
+    if (obj) {
+        if (RecordSyncStats) syncStatsExit(obj);
+
+        if (thinLockExit(obj, true)) return result;
+
+        bool outerUse = false;
+        SyncData* data = id2data(obj, RELEASE_SHARED, &outerUse);
+        if (!data) {
+            result = OBJC_SYNC_NOT_OWNING_THREAD_ERROR;
+        } else if (outerUse) {
+            sharedLockExit(data);
+            releaseSyncData(obj, data);
+        }
+    }
+
+    return result;
+}
+
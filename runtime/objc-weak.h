@@ -100,6 +100,37 @@ struct weak_table_t {
     uintptr_t max_hash_displacement;
 };
 
+/**
+ * A cell shared by all weak variables pointing to one instance of a 
+ * class that uses weak cells. Those variables hold the cell's address 
+ * plus WEAK_CELL_TAG instead of the object. The cell's referent field 
+ * is itself a weak variable registered in the weak table, so dealloc 
+ * clears a single referrer however many variables point to the cell.
+ */
+#define WEAK_CELL_TAG  2UL
+#define WEAK_CELL_MASK 15UL
+struct weak_cell_t {
+    objc_object *referent;   // nil once the object is deallocating
+    int32_t refcount;        // weak variables and loads holding this cell
+};
+
+// A cell value is neither a tagged pointer nor 16-byte aligned.
+static inline bool weak_is_cell(id value) 
+{
+    return !((objc_object *)value)->isTaggedPointer()  &&  
+        ((uintptr_t)value & WEAK_CELL_MASK) == WEAK_CELL_TAG;
+}
+
+static inline weak_cell_t *weak_cell_for_value(id value) 
+{
+    return (weak_cell_t *)((uintptr_t)value & ~WEAK_CELL_MASK);
+}
+
+static inline id weak_value_for_cell(weak_cell_t *cell) 
+{
+    return (id)((uintptr_t)cell | WEAK_CELL_TAG);
+}
+
 /// Adds an (object, weak pointer) pair to the weak table.
 // 在 weak_table 中注册 referrer 对 referent 的弱引用
 id weak_register_no_lock(weak_table_t *weak_table, id referent, 
@@ -109,6 +140,10 @@ id weak_register_no_lock(weak_table_t *weak_table, id referent,
 // 解除 referrer 指针对 referent 的弱引用
 void weak_unregister_no_lock(weak_table_t *weak_table, id referent, id *referrer);
 
+/// Moves an (object, weak pointer) pair to another weak pointer.
+bool weak_move_no_lock(weak_table_t *weak_table, id referent, 
+                       id *old_referrer, id *new_referrer);
+
 #if DEBUG
 /// Returns true if an object is weakly referenced somewhere.
 bool weak_is_registered_no_lock(weak_table_t *weak_table, id referent);
@@ -124,6 +159,19 @@ id weak_read_no_lock(weak_table_t *weak_table, id *referrer);
 // 在 sidetable_clearDeallocating 和 clearDeallocating_slow 被调用
 void weak_clear_no_lock(weak_table_t *weak_table, id referent);
 
+/// Loads and retains a weak referent with default RR without locking.
+/// Returns false if the caller must use weak_read_no_lock() instead.
+bool weak_read_lock_free(id *referrer, id *result);
+
+/// Brackets a lock-free read of a weak pointer. Writers waiting in 
+/// weak_read_wait_all() wait until weak_read_exit().
+uint32_t weak_read_enter(id *referrer);
+void weak_read_exit(id *referrer, uint32_t token);
+
+/// Waits out every lock-free reader. Called before freeing anything 
+/// a reader may have loaded. Must be called with no side table locked.
+void weak_read_wait_all(void);
+
 __END_DECLS
 
 #endif /* _OBJC_WEAK_H_ */
@@ -27,6 +27,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sched.h>
 #include <sys/types.h>
 #include <libkern/OSAtomic.h>
 
@@ -468,6 +469,58 @@ weak_unregister_no_lock(weak_table_t *weak_table, // 全局的弱引用表
     // value not change.
 }
 
+/** 
+ * Moves a registered weak reference to referent from old_referrer to 
+ * new_referrer. The entry is updated in place: inline referrers keep 
+ * their slot, out-of-line referrers are rehashed within the entry.
+ * Does not change the storage of either referrer.
+ * 
+ * @param weak_table The global weak table.
+ * @param referent The object.
+ * @param old_referrer The weak reference currently registered.
+ * @param new_referrer The weak reference to register instead.
+ * 
+ * @return false if referent has no entry holding old_referrer.
+ */
+bool
+weak_move_no_lock(weak_table_t *weak_table, id referent_id, 
+                  id *old_referrer_id, id *new_referrer_id)
+{
+    objc_object *referent = (objc_object *)referent_id;
+    objc_object **old_referrer = (objc_object **)old_referrer_id;
+    objc_object **new_referrer = (objc_object **)new_referrer_id;
+
+    if (!referent) return false;
+
+    weak_entry_t *entry = weak_entry_for_referent(weak_table, referent);
+    if (!entry) return false;
+
+    if (! entry->out_of_line) {
+        for (size_t i = 0; i < WEAK_INLINE_COUNT; i++) {
+            if (entry->inline_referrers[i] == old_referrer) {
+                entry->inline_referrers[i] = new_referrer;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Not remove_referrer(): a missing referrer is not an error here.
+    size_t index = w_hash_pointer(old_referrer) & (entry->mask);
+    size_t hash_displacement = 0;
+    while (entry->referrers[index] != old_referrer) {
+        index = (index+1) & entry->mask;
+        hash_displacement++;
+        if (hash_displacement > entry->max_hash_displacement) return false;
+    }
+
+    // Removing first keeps append_referrer() from growing the entry.
+    entry->referrers[index] = nil;
+    entry->num_refs--;
+    append_referrer(entry, new_referrer);
+    return true;
+}
+
 /** 
  * Registers a new (object, weak pointer) pair. Creates a new weak
  * object entry if it does not exist.
@@ -681,3 +734,123 @@ weak_read_no_lock(weak_table_t *weak_table, id *referrer_id)
     return (id)referent;
 }
 
+
+/***********************************************************************
+* Lock-free weak loads
+* objc_loadWeakRetained() reads weak variables without the side table 
+* lock when the referent uses the default retain/release. Such a read 
+* loads *referrer and retains the referent with rootTryRetain() while 
+* its memory must stay valid, so each reader announces itself in a 
+* counter striped by the address of the weak variable.
+*
+* The side that frees a referent waits out the readers, not the side 
+* that stores over it: a reader may have loaded the object from any 
+* weak variable, including ones that were unregistered or rebound 
+* before the dealloc. So clearDeallocating of an object that was ever 
+* weakly referenced calls weak_read_wait_all() after dropping the side 
+* table lock. It returns once every reader that might have loaded the 
+* object has finished with it. Each stripe has two reader counters; 
+* the waiter flips new readers to the other counter and drains the 
+* old one, twice, so a continuous stream of readers cannot starve it.
+* Stripes with no readers cost one load each.
+*
+* Readers that find a custom-RR referent, or whose rootTryRetain() 
+* fails because of a dealloc race, fall back to the locked path.
+* Locking: readers take no locks. Writers must not hold any side 
+* table lock while waiting, because rootTryRetain() may take one.
+**********************************************************************/
+
+#define WEAK_READ_STRIPE_COUNT 64
+
+struct alignas(64) weak_read_stripe_t {
+    uint32_t index;
+    int32_t readers[2];
+    spinlock_t flipLock;
+};
+
+static weak_read_stripe_t WeakReadStripes[WEAK_READ_STRIPE_COUNT];
+
+static inline unsigned int weak_read_stripe_index(id *referrer)
+{
+    uintptr_t addr = (uintptr_t)referrer;
+    return ((addr >> 4) ^ (addr >> 9)) % WEAK_READ_STRIPE_COUNT;
+}
+
+/** 
+ * Loads and retains the referent of a weak variable without locking.
+ * 
+ * @param referrer The weak pointer address.
+ * @param result On success, the retained referent or nil.
+ * 
+ * @return false if the caller must use the locked path instead.
+ */
+bool 
+weak_read_lock_free(id *referrer_id, id *result)
+{
+    objc_object **referrer = (objc_object **)referrer_id;
+    uint32_t token = weak_read_enter(referrer_id);
+
+    bool done = true;
+    objc_object *referent = *referrer;
+    if (referent  &&  !referent->isTaggedPointer()) {
+        if (weak_is_cell((id)referent)  ||  
+            referent->ISA()->hasCustomRR()  ||  !referent->rootTryRetain()) 
+        {
+            done = false;
+        }
+    }
+
+    weak_read_exit(referrer_id, token);
+
+    if (done) *result = (id)referent;
+    return done;
+}
+
+
+uint32_t 
+weak_read_enter(id *referrer)
+{
+    weak_read_stripe_t& stripe = 
+        WeakReadStripes[weak_read_stripe_index(referrer)];
+    uint32_t index = stripe.index & 1;
+    OSAtomicIncrement32Barrier(&stripe.readers[index]);
+    return index;
+}
+
+
+void 
+weak_read_exit(id *referrer, uint32_t token)
+{
+    weak_read_stripe_t& stripe = 
+        WeakReadStripes[weak_read_stripe_index(referrer)];
+    OSAtomicDecrement32Barrier(&stripe.readers[token]);
+}
+
+
+/** 
+ * Waits until no lock-free reader of any weak variable can still be 
+ * using a value it loaded before this call. Called before memory that 
+ * such a reader may have loaded is freed.
+ */
+void 
+weak_read_wait_all(void)
+{
+    // Pairs with the barrier in weak_read_lock_free(): a reader either 
+    // sees the new value of the weak variable or is visible here.
+    OSMemoryBarrier();
+
+    for (unsigned int i = 0; i < WEAK_READ_STRIPE_COUNT; i++) {
+        weak_read_stripe_t& stripe = WeakReadStripes[i];
+        if (stripe.readers[0] == 0  &&  stripe.readers[1] == 0) continue;
+
+        stripe.flipLock.lock();
+        for (int pass = 0; pass < 2; pass++) {
+            uint32_t old = stripe.index & 1;
+            OSAtomicXor32Barrier(1, (volatile uint32_t *)&stripe.index);
+            while (((volatile int32_t *)stripe.readers)[old] != 0) {
+                sched_yield();
+            }
+        }
+        stripe.flipLock.unlock();
+    }
+}
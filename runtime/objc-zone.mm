@@ -0,0 +1,551 @@
+/*
+ * Copyright (c) 2016 Apple Inc.  All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/***********************************************************************
+* objc-zone.mm
+* Arena-backed malloc zones for object allocation.
+*
+* An arena zone hands out memory by bumping a pointer through arenas
+* of a fixed size. Each block carries a small header with its size so
+* malloc_size() and free() work as for any other zone. Freed blocks
+* are not reused individually; when the last live block is freed, the
+* zone rewinds to its first arena and releases the others, or releases
+* everything if _objc_destroyArenaZoneWhenEmpty() was called. Once that 
+* has been called, new allocations come from the default zone instead.
+*
+* A destroyed zone is retired rather than freed: its arenas are released 
+* but the zone itself stays, owning nothing, because free() and 
+* malloc_zone_from_ptr() on other threads may still be asking it for 
+* sizes while it is unregistered.
+*
+* free() asks every registered zone for the size of a pointer until one 
+* claims it. A zone rejects pointers outside the address range of its 
+* arenas without taking its lock, and finds the arena of the others by 
+* binary search over its arenas sorted by address.
+*
+* The zone is registered with malloc, so allocWithZone:,
+* class_createInstanceFromZone(), object_copyFromZone() and free()
+* all work with it unchanged.
+**********************************************************************/
+
+#include "objc-private.h"
+
+#if SUPPORT_ARENA_ZONES
+
+#include <malloc/malloc.h>
+#include <sys/mman.h>
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_DEFAULT_SIZE (1024*1024)
+#define ARENA_HEADER_MAGIC 0x0b1ea4e4
+#define ARENA_FREED_MAGIC  0x0b1efee0
+
+struct ArenaHeader {
+    uint32_t magic;
+    uint32_t size;
+    uint64_t reserved;  // keeps blocks ARENA_ALIGNMENT-aligned
+};
+static_assert(sizeof(ArenaHeader) == ARENA_ALIGNMENT,
+              "arena headers must preserve block alignment");
+
+struct Arena {
+    Arena *next;
+    size_t size;
+    uint64_t reserved;
+    uint64_t reserved2;
+    // blocks follow
+    uintptr_t start() { return (uintptr_t)(this + 1); }
+    uintptr_t end() { return (uintptr_t)this + size; }
+    bool contains(uintptr_t p) { return p >= start()  &&  p < end(); }
+};
+static_assert(sizeof(Arena) % ARENA_ALIGNMENT == 0,
+              "arena headers must preserve block alignment");
+
+struct ArenaZone {
+    malloc_zone_t zone;  // must be first
+    spinlock_t lock;
+    Arena *arenas;       // newest first
+    Arena **sorted;      // the same arenas by address
+    size_t sortedCount;
+    size_t sortedCapacity;
+    // Bounds of every arena ever mapped. Only ever widen until the 
+    // zone is retired, so they may be read without the lock.
+    volatile uintptr_t low;
+    volatile uintptr_t high;
+    uintptr_t next;      // bump pointer in arenas
+    uintptr_t end;
+    size_t arenaSize;
+    bool destroyWhenEmpty;
+    bool retired;        // arenas released; the zone owns nothing
+    char *name;
+    objc_arenaZoneStatistics stats;
+};
+
+static malloc_introspection_t ArenaZoneIntrospect;
+
+
+static Arena *newArena(size_t size)
+{
+    void *mem = mmap(nil, size, PROT_READ | PROT_WRITE,
+                     MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (mem == MAP_FAILED) return nil;
+    Arena *arena = (Arena *)mem;
+    arena->size = size;
+    return arena;
+}
+
+static void freeArena(Arena *arena)
+{
+    munmap(arena, arena->size);
+}
+
+static inline size_t roundBlock(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+
+// Returns false if p cannot be in any of the zone's arenas.
+// Locking: none
+static inline bool mayContain(ArenaZone *z, const void *p)
+{
+    uintptr_t addr = (uintptr_t)p;
+    return addr >= z->low  &&  addr < z->high;
+}
+
+
+// Add a new arena to the zone's list and sorted array.
+// Returns false if the sorted array could not grow.
+// Locking: zone's lock must be held
+static bool addArena(ArenaZone *z, Arena *arena)
+{
+    if (z->sortedCount == z->sortedCapacity) {
+        size_t capacity = z->sortedCapacity ? z->sortedCapacity * 2 : 8;
+        Arena **sorted = (Arena **)
+            realloc(z->sorted, capacity * sizeof(Arena *));
+        if (!sorted) return false;
+        z->sorted = sorted;
+        z->sortedCapacity = capacity;
+    }
+
+    size_t i = z->sortedCount;
+    while (i > 0  &&  z->sorted[i-1] > arena) {
+        z->sorted[i] = z->sorted[i-1];
+        i--;
+    }
+    z->sorted[i] = arena;
+    z->sortedCount++;
+
+    arena->next = z->arenas;
+    z->arenas = arena;
+
+    if (!z->low  ||  arena->start() < z->low) z->low = arena->start();
+    if (arena->end() > z->high) z->high = arena->end();
+    return true;
+}
+
+
+// Returns the header of the live block p, or nil if p is not one.
+// Locking: zone's lock must be held
+static ArenaHeader *headerForPointer(ArenaZone *z, const void *p)
+{
+    uintptr_t addr = (uintptr_t)p;
+    if (addr % ARENA_ALIGNMENT) return nil;
+    if (!mayContain(z, p)) return nil;
+
+    // Find the last arena that starts at or below addr.
+    size_t lo = 0, hi = z->sortedCount;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((uintptr_t)z->sorted[mid] <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return nil;
+    Arena *arena = z->sorted[lo-1];
+
+    if (!arena->contains(addr)) return nil;
+    if (addr - sizeof(ArenaHeader) < arena->start()) return nil;
+    if (arena == z->arenas  &&  addr >= z->next) return nil;
+    ArenaHeader *h = (ArenaHeader *)(addr - sizeof(ArenaHeader));
+    return h->magic == ARENA_HEADER_MAGIC ? h : nil;
+}
+
+
+// Release every arena and leave the zone claiming no pointers. 
+// The zone itself is never freed; see above.
+// Returns false if the zone was already retired.
+// Locking: zone's lock must be held
+static bool retireZone(ArenaZone *z)
+{
+    if (z->retired) return false;
+    z->retired = true;
+
+    // Unlocked size queries now answer no.
+    z->low = 0;
+    z->high = 0;
+
+    Arena *arena = z->arenas;
+    while (arena) {
+        Arena *next = arena->next;
+        freeArena(arena);
+        arena = next;
+    }
+    z->arenas = nil;
+    free(z->sorted);
+    z->sorted = nil;
+    z->sortedCount = 0;
+    z->sortedCapacity = 0;
+    z->next = 0;
+    z->end = 0;
+    z->stats.arenas = 0;
+    z->stats.bytesReserved = 0;
+    return true;
+}
+
+
+/***********************************************************************
+* Zone callbacks
+**********************************************************************/
+static size_t arena_size(malloc_zone_t *zone, const void *p)
+{
+    ArenaZone *z = (ArenaZone *)zone;
+    // free() and malloc_zone_from_ptr() ask every zone. 
+    // Don't make them wait for the lock to hear no.
+    if (!mayContain(z, p)) return 0;
+
+    z->lock.lock();
+    ArenaHeader *h = headerForPointer(z, p);
+    size_t size = h ? h->size : 0;
+    z->lock.unlock();
+    return size;
+}
+
+static void *arena_calloc(malloc_zone_t *zone, size_t count, size_t size)
+{
+    ArenaZone *z = (ArenaZone *)zone;
+
+    size_t bytes;
+    if (__builtin_mul_overflow(count, size, &bytes)) return nil;
+    if (bytes == 0) bytes = 1;
+    if (bytes > UINT32_MAX) return nil;
+    size_t needed = sizeof(ArenaHeader) + roundBlock(bytes);
+
+    z->lock.lock();
+
+    if (z->destroyWhenEmpty) {
+        // The zone goes away when its last block is freed. 
+        // Don't keep it alive with new ones.
+        z->lock.unlock();
+        return malloc_zone_calloc(malloc_default_zone(), count, size);
+    }
+
+    if (z->next + needed > z->end) {
+        size_t arenaSize = MAX(z->arenaSize, needed + sizeof(Arena));
+        Arena *arena = newArena(arenaSize);
+        if (!arena) {
+            z->lock.unlock();
+            return nil;
+        }
+        if (!addArena(z, arena)) {
+            z->lock.unlock();
+            freeArena(arena);
+            return nil;
+        }
+        z->next = arena->start();
+        z->end = arena->end();
+        z->stats.arenas++;
+        z->stats.bytesReserved += arenaSize;
+    }
+
+    ArenaHeader *h = (ArenaHeader *)z->next;
+    z->next += needed;
+    h->magic = ARENA_HEADER_MAGIC;
+    h->size = (uint32_t)roundBlock(bytes);
+    z->stats.liveObjects++;
+    z->stats.liveBytes += h->size;
+    z->stats.allocations++;
+
+    z->lock.unlock();
+
+    // Rewound arenas still hold old contents.
+    void *result = h + 1;
+    bzero(result, h->size);
+    return result;
+}
+
+static void *arena_malloc(malloc_zone_t *zone, size_t size)
+{
+    return arena_calloc(zone, 1, size);
+}
+
+static void *arena_valloc(malloc_zone_t *zone __unused, size_t size)
+{
+    // Page-aligned blocks would waste most of an arena.
+    return valloc(size);
+}
+
+static void arena_free(malloc_zone_t *zone, void *p)
+{
+    if (!p) return;
+    ArenaZone *z = (ArenaZone *)zone;
+
+    z->lock.lock();
+
+    ArenaHeader *h = headerForPointer(z, p);
+    if (!h) {
+        z->lock.unlock();
+        _objc_fatal("pointer %p being freed was not allocated "
+                    "by arena zone %p", p, z);
+    }
+    h->magic = ARENA_FREED_MAGIC;
+    z->stats.liveObjects--;
+    z->stats.liveBytes -= h->size;
+    z->stats.frees++;
+
+    bool retired = false;
+    if (z->stats.liveObjects == 0) {
+        if (z->destroyWhenEmpty) {
+            retired = retireZone(z);
+        } else {
+            // Release all but the oldest arena and start over.
+            Arena *oldest = z->arenas;
+            while (oldest->next) {
+                Arena *dead = oldest;
+                oldest = oldest->next;
+                z->stats.bytesReserved -= dead->size;
+                z->stats.arenas--;
+                freeArena(dead);
+            }
+            z->arenas = oldest;
+            z->sorted[0] = oldest;
+            z->sortedCount = 1;
+            z->next = oldest->start();
+            z->end = oldest->end();
+            z->stats.rewinds++;
+        }
+    }
+
+    z->lock.unlock();
+
+    if (retired) malloc_zone_unregister(&z->zone);
+}
+
+static void *arena_realloc(malloc_zone_t *zone, void *p, size_t size)
+{
+    if (!p) return arena_malloc(zone, size);
+    size_t oldSize = arena_size(zone, p);
+    if (!oldSize) {
+        // Allocated from the default zone after destroyWhenEmpty.
+        return malloc_zone_realloc(malloc_default_zone(), p, size);
+    }
+    void *result = arena_malloc(zone, size);
+    if (!result) return nil;
+    memcpy(result, p, MIN(oldSize, size));
+    arena_free(zone, p);
+    return result;
+}
+
+static void arena_destroy(malloc_zone_t *zone)
+{
+    // malloc_destroy_zone() has already unregistered the zone.
+    // Any objects still alive in it are gone.
+    ArenaZone *z = (ArenaZone *)zone;
+    z->lock.lock();
+    z->destroyWhenEmpty = true;
+    retireZone(z);
+    z->lock.unlock();
+}
+
+static size_t arena_good_size(malloc_zone_t *zone __unused, size_t size)
+{
+    return roundBlock(size);
+}
+
+static boolean_t arena_check(malloc_zone_t *zone __unused)
+{
+    return true;
+}
+
+static void arena_print(malloc_zone_t *zone, boolean_t verbose __unused)
+{
+    objc_arenaZoneStatistics stats;
+    _objc_getArenaZoneStatistics(zone, &stats);
+    _objc_inform("ARENA ZONE: %p %s: %zu arenas, %zu bytes reserved, "
+                 "%zu objects (%zu bytes) live", zone, malloc_get_zone_name(zone),
+                 stats.arenas, stats.bytesReserved,
+                 stats.liveObjects, stats.liveBytes);
+}
+
+static void arena_log(malloc_zone_t *zone __unused, void *address __unused)
+{
+}
+
+static void arena_force_lock(malloc_zone_t *zone)
+{
+    ((ArenaZone *)zone)->lock.lock();
+}
+
+static void arena_force_unlock(malloc_zone_t *zone)
+{
+    ((ArenaZone *)zone)->lock.unlock();
+}
+
+static void arena_statistics(malloc_zone_t *zone, malloc_statistics_t *outStats)
+{
+    objc_arenaZoneStatistics stats;
+    _objc_getArenaZoneStatistics(zone, &stats);
+    bzero(outStats, sizeof(*outStats));
+    outStats->blocks_in_use = (unsigned)stats.liveObjects;
+    outStats->size_in_use = stats.liveBytes;
+    outStats->max_size_in_use = stats.liveBytes;
+    outStats->size_allocated = stats.bytesReserved;
+}
+
+static kern_return_t
+arena_enumerator(task_t task, void *context, unsigned typeMask,
+                 vm_address_t zoneAddress, memory_reader_t reader __unused,
+                 vm_range_recorder_t recorder)
+{
+    // Only arenas in this task are reported.
+    if (task != mach_task_self()) return KERN_SUCCESS;
+    if (!(typeMask & MALLOC_PTR_REGION_RANGE_TYPE)) return KERN_SUCCESS;
+
+    ArenaZone *z = (ArenaZone *)zoneAddress;
+    for (Arena *arena = z->arenas; arena; arena = arena->next) {
+        vm_range_t range = { (vm_address_t)arena, arena->size };
+        recorder(task, context, MALLOC_PTR_REGION_RANGE_TYPE, &range, 1);
+    }
+    return KERN_SUCCESS;
+}
+
+
+/***********************************************************************
+* _objc_createArenaZone
+* Create and register an arena zone. arenaSize 0 picks the default.
+**********************************************************************/
+void *_objc_createArenaZone(const char *name, size_t arenaSize)
+{
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        ArenaZoneIntrospect.enumerator = arena_enumerator;
+        ArenaZoneIntrospect.good_size = arena_good_size;
+        ArenaZoneIntrospect.check = arena_check;
+        ArenaZoneIntrospect.print = arena_print;
+        ArenaZoneIntrospect.log = arena_log;
+        ArenaZoneIntrospect.force_lock = arena_force_lock;
+        ArenaZoneIntrospect.force_unlock = arena_force_unlock;
+        ArenaZoneIntrospect.statistics = arena_statistics;
+    });
+
+    ArenaZone *z = (ArenaZone *)calloc(1, sizeof(ArenaZone));
+    new (&z->lock) spinlock_t();
+    z->arenaSize = arenaSize ? round_page(arenaSize) : ARENA_DEFAULT_SIZE;
+    z->name = strdup(name ? name : "ObjCArenaZone");
+
+    z->zone.size = arena_size;
+    z->zone.malloc = arena_malloc;
+    z->zone.calloc = arena_calloc;
+    z->zone.valloc = arena_valloc;
+    z->zone.free = arena_free;
+    z->zone.realloc = arena_realloc;
+    z->zone.destroy = arena_destroy;
+    z->zone.zone_name = z->name;
+    z->zone.introspect = &ArenaZoneIntrospect;
+    // No memalign or free_definite_size.
+    z->zone.version = 4;
+
+    malloc_zone_register(&z->zone);
+    return z;
+}
+
+
+/***********************************************************************
+* _objc_isArenaZone
+**********************************************************************/
+bool _objc_isArenaZone(void *zone)
+{
+    return zone  &&  ((malloc_zone_t *)zone)->size == arena_size;
+}
+
+
+/***********************************************************************
+* _objc_destroyArenaZoneWhenEmpty
+* Retire the zone and release all of its arenas once the last object in it
+* has been freed, or now if it is already empty. Allocations from the 
+* zone after this call come from the default zone, so the live count 
+* only falls and the decision to destroy, made under the lock, stands.
+**********************************************************************/
+void _objc_destroyArenaZoneWhenEmpty(void *zone)
+{
+    if (!_objc_isArenaZone(zone)) return;
+    ArenaZone *z = (ArenaZone *)zone;
+
+    z->lock.lock();
+    z->destroyWhenEmpty = true;
+    bool retired = (z->stats.liveObjects == 0)  &&  retireZone(z);
+    z->lock.unlock();
+
+    if (retired) malloc_zone_unregister(&z->zone);
+}
+
+
+/***********************************************************************
+* _objc_getArenaZoneStatistics
+**********************************************************************/
+BOOL _objc_getArenaZoneStatistics(void *zone, objc_arenaZoneStatistics *outStats)
+{
+    if (!_objc_isArenaZone(zone)  ||  !outStats) return NO;
+    ArenaZone *z = (ArenaZone *)zone;
+
+    z->lock.lock();
+    *outStats = z->stats;
+    z->lock.unlock();
+    return YES;
+}
+
+// SUPPORT_ARENA_ZONES
+#else
+// not SUPPORT_ARENA_ZONES
+
+void *_objc_createArenaZone(const char *name __unused, size_t arenaSize __unused)
+{
+    return nil;
+}
+
+bool _objc_isArenaZone(void *zone __unused)
+{
+    return false;
+}
+
+void _objc_destroyArenaZoneWhenEmpty(void *zone __unused)
+{
+}
+
+BOOL _objc_getArenaZoneStatistics(void *zone __unused,
+                                  objc_arenaZoneStatistics *outStats __unused)
+{
+    return NO;
+}
+
+// not SUPPORT_ARENA_ZONES
+#endif
@@ -0,0 +1,158 @@
+// TEST_CONFIG MEM=mrc
+// Atomic object properties without locks: concurrent getters never
+// see a deallocated value and every value swapped out is released,
+// either by a later store or when the setting thread exits.
+// Timings of many threads on hot properties against one thread are
+// reported with testprintf.
+
+#include "test.h"
+#include <objc/runtime.h>
+#include <objc/NSObject.h>
+#include <libkern/OSAtomic.h>
+
+static int ValueDealloc;
+
+@interface Value : NSObject @end
+@implementation Value
+-(void) dealloc {
+    OSAtomicIncrement32(&ValueDealloc);
+    [super dealloc];
+}
+@end
+
+@interface Holder : NSObject {
+  @public
+    id _value;
+}
+@property(atomic, retain) id value;
+@end
+
+@implementation Holder
+@synthesize value = _value;
+-(void) dealloc {
+    self.value = nil;
+    [super dealloc];
+}
+@end
+
+#define THREADS 4
+#define CYCLES 20000
+#define HOT 4
+#define ITERATIONS 200000
+
+static Holder *holders[HOT];
+static volatile int stop;
+
+static void *getter(void *arg __unused)
+{
+    while (!stop) {
+        void *pool = objc_autoreleasePoolPush();
+        for (int i = 0; i < 100; i++) {
+            id value = holders[i % HOT].value;
+            if (value) testassert(object_getClass(value) == [Value class]);
+        }
+        objc_autoreleasePoolPop(pool);
+    }
+    return NULL;
+}
+
+static void *hotGetter(void *arg)
+{
+    Holder *holder = (Holder *)arg;
+    for (int i = 0; i < ITERATIONS; i += 100) {
+        void *pool = objc_autoreleasePoolPush();
+        for (int j = 0; j < 100; j++) {
+            testassert(holder.value != nil);
+        }
+        objc_autoreleasePoolPop(pool);
+    }
+    return NULL;
+}
+
+int main()
+{
+    testprintf("Get and set\n");
+    Holder *holder = [Holder new];
+    id value = [Value new];
+    holder.value = value;
+    testassert([value retainCount] == 2);
+    PUSH_POOL {
+        testassert(holder.value == value);
+    } POP_POOL;
+    [value release];
+    holder.value = nil;
+    testassert(ValueDealloc == 1);
+    [holder release];
+
+    testprintf("Concurrent getters and setters\n");
+    for (int h = 0; h < HOT; h++) holders[h] = [Holder new];
+    pthread_t th[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, getter, NULL);
+    }
+    ValueDealloc = 0;
+    for (int c = 0; c < CYCLES; c++) {
+        value = [Value new];
+        holders[c % HOT].value = value;
+        [value release];
+    }
+    stop = 1;
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+    for (int h = 0; h < HOT; h++) holders[h].value = nil;
+    // Values deferred behind a getter are released by later stores.
+    testassert(ValueDealloc == CYCLES);
+
+    testprintf("Values deferred by an exiting setter are released\n");
+    stop = 0;
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, getter, NULL);
+    }
+    ValueDealloc = 0;
+    testonthread(^{
+        for (int c = 0; c < CYCLES; c++) {
+            id v = [Value new];
+            holders[c % HOT].value = v;
+            [v release];
+        }
+    });
+    // Everything but the values still set, including any the thread 
+    // deferred and never stored past again.
+    testassert(ValueDealloc == CYCLES - HOT);
+    stop = 1;
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+    for (int h = 0; h < HOT; h++) holders[h].value = nil;
+    testassert(ValueDealloc == CYCLES);
+
+    testprintf("Benchmark: %d threads on %d hot properties versus one thread\n",
+               THREADS, HOT);
+    for (int h = 0; h < HOT; h++) {
+        value = [NSObject new];
+        holders[h].value = value;
+        [value release];
+    }
+
+    uint64_t startTime, serialTime, parallelTime;
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) hotGetter(holders[t % HOT]);
+    serialTime = mach_absolute_time() - startTime;
+
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, hotGetter, holders[t % HOT]);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+    parallelTime = mach_absolute_time() - startTime;
+
+    testprintf("time: %d threads %llu, one thread %llu\n",
+               THREADS, parallelTime, serialTime);
+
+    for (int h = 0; h < HOT; h++) [holders[h] release];
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,93 @@
+// TEST_CONFIG MEM=mrc
+// objc_alloc_init: [[cls alloc] init] with no message sends
+// when neither method is overridden.
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/NSObject.h>
+#include <objc/objc-internal.h>
+
+#define COUNT 1000000
+
+static int initCount;
+static int allocCount;
+
+@interface Plain : NSObject { @public long ivar; } @end
+@implementation Plain @end
+
+@interface CustomInit : NSObject { @public long ivar; } @end
+@implementation CustomInit
+-(id) init {
+    if ((self = [super init])) { initCount++; ivar = 42; }
+    return self;
+}
+@end
+
+@interface CustomInitSub : CustomInit @end
+@implementation CustomInitSub @end
+
+@interface CustomAlloc : NSObject @end
+@implementation CustomAlloc
++(id) allocWithZone:(struct _NSZone *)zone {
+    allocCount++;
+    return [super allocWithZone:zone];
+}
+@end
+
+int main()
+{
+    testassert(objc_alloc_init(Nil) == nil);
+
+    testprintf("Default alloc and init\n");
+    for (int i = 0; i < 3; i++) {
+        Plain *p = objc_alloc_init([Plain class]);
+        testassert(object_getClass(p) == [Plain class]);
+        testassert(p->ivar == 0);
+        [p release];
+    }
+
+    testprintf("Overridden init is still called\n");
+    for (int i = 0; i < 3; i++) {
+        initCount = 0;
+        CustomInit *c = objc_alloc_init([CustomInit class]);
+        testassert(initCount == 1);
+        testassert(c->ivar == 42);
+        [c release];
+
+        initCount = 0;
+        c = objc_alloc_init([CustomInitSub class]);
+        testassert(object_getClass(c) == [CustomInitSub class]);
+        testassert(initCount == 1);
+        [c release];
+    }
+
+    testprintf("Overridden alloc is still called\n");
+    allocCount = 0;
+    [objc_alloc_init([CustomAlloc class]) release];
+    testassert(allocCount == 1);
+
+    testprintf("Root classes other than NSObject\n");
+    TestRootInit = 0;
+    TestRootDealloc = 0;
+    [objc_alloc_init([TestRoot class]) release];
+    testassert(TestRootInit == 1);
+    testassert(TestRootDealloc == 1);
+
+    testprintf("Timing\n");
+    uint64_t start, fused, separate;
+    start = mach_absolute_time();
+    for (int i = 0; i < COUNT; i++) {
+        [objc_alloc_init([Plain class]) release];
+    }
+    fused = mach_absolute_time() - start;
+    start = mach_absolute_time();
+    for (int i = 0; i < COUNT; i++) {
+        [[[Plain alloc] init] release];
+    }
+    separate = mach_absolute_time() - start;
+    testprintf("time: objc_alloc_init %llu, alloc+init %llu\n", fused, separate);
+    timecheck("objc_alloc_init", fused, 0, separate * 1.5);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,119 @@
+// TEST_CONFIG MEM=mrc OS=macosx
+// Arena zones: allocation through allocWithZone: and 
+// class_createInstanceFromZone, normal frees, rewind and bulk release,
+// and size queries racing with destruction.
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/objc-internal.h>
+#include <malloc/malloc.h>
+
+#define COUNT 10000
+
+@interface Big : TestRoot { char bytes[200]; } @end
+@implementation Big @end
+
+static volatile bool raceDone;
+
+// Asks every registered zone, including any being destroyed.
+static void *sizer(void *arg __unused)
+{
+    int local;
+    while (!raceDone) {
+        testassert(malloc_zone_from_ptr(&local) == NULL);
+    }
+    return NULL;
+}
+
+int main()
+{
+    objc_arenaZoneStatistics stats;
+    void *zone = _objc_createArenaZone("test", 64*1024);
+    testassert(zone);
+    testassert(_objc_getArenaZoneStatistics(zone, &stats));
+    testassert(stats.liveObjects == 0);
+
+    testprintf("Objects come from the zone and free normally\n");
+    id obj = [TestRoot allocWithZone:(struct _NSZone *)zone];
+    testassert(malloc_zone_from_ptr(obj) == zone);
+    testassert(malloc_size(obj) >= class_getInstanceSize([TestRoot class]));
+    id obj2 = class_createInstanceFromZone([Big class], 0, zone);
+    testassert(malloc_zone_from_ptr(obj2) == zone);
+    testassert((char *)obj2 > (char *)obj);
+    testassert(_objc_getArenaZoneStatistics(zone, &stats));
+    testassert(stats.liveObjects == 2);
+    testassert(stats.allocations == 2);
+
+    TestRootDealloc = 0;
+    [obj release];
+    [obj2 release];
+    testassert(TestRootDealloc == 2);
+    testassert(_objc_getArenaZoneStatistics(zone, &stats));
+    testassert(stats.liveObjects == 0);
+    testassert(stats.liveBytes == 0);
+    testassert(stats.rewinds == 1);
+
+    testprintf("Emptying the zone keeps only one arena\n");
+    static id objs[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        objs[i] = [Big allocWithZone:(struct _NSZone *)zone];
+    }
+    testassert(_objc_getArenaZoneStatistics(zone, &stats));
+    testassert(stats.arenas > 1);
+    testassert(stats.liveObjects == COUNT);
+    for (int i = 0; i < COUNT; i++) [objs[i] release];
+    testassert(_objc_getArenaZoneStatistics(zone, &stats));
+    testassert(stats.arenas == 1);
+    testassert(stats.liveObjects == 0);
+
+    testprintf("Pointers outside the zone are not claimed\n");
+    obj = [TestRoot new];
+    testassert(malloc_zone_from_ptr(obj) != zone);
+    testassert(((malloc_zone_t *)zone)->size((malloc_zone_t *)zone, obj) == 0);
+    [obj release];
+
+    testprintf("Copies land in the requested zone\n");
+    obj = [TestRoot new];
+    obj2 = object_copyFromZone(obj, 0, zone);
+    testassert(malloc_zone_from_ptr(obj2) == zone);
+    [obj release];
+
+    testprintf("Deferred destruction\n");
+    _objc_destroyArenaZoneWhenEmpty(zone);
+    testassert(_objc_getArenaZoneStatistics(zone, &stats));
+    testassert(stats.liveObjects == 1);
+    obj = [TestRoot allocWithZone:(struct _NSZone *)zone];
+    testassert(malloc_zone_from_ptr(obj) == malloc_default_zone());
+    testassert(_objc_getArenaZoneStatistics(zone, &stats));
+    testassert(stats.liveObjects == 1);
+    [obj2 release];
+    // The zone is retired: it owns nothing but can still be asked.
+    testassert(_objc_getArenaZoneStatistics(zone, &stats));
+    testassert(stats.arenas == 0);
+    testassert(stats.bytesReserved == 0);
+    testassert(((malloc_zone_t *)zone)->size((malloc_zone_t *)zone, obj2) == 0);
+    [obj release];
+
+    testprintf("Size queries racing with destruction\n");
+    raceDone = false;
+    pthread_t th;
+    pthread_create(&th, NULL, sizer, NULL);
+    for (int i = 0; i < 1000; i++) {
+        void *z = _objc_createArenaZone("race", 0);
+        obj = [TestRoot allocWithZone:(struct _NSZone *)z];
+        _objc_destroyArenaZoneWhenEmpty(z);
+        [obj release];
+    }
+    raceDone = true;
+    pthread_join(th, NULL);
+
+    testprintf("Other zones are still ignored\n");
+    malloc_zone_t *other = malloc_create_zone(0, 0);
+    obj = [TestRoot allocWithZone:(struct _NSZone *)other];
+    testassert(malloc_zone_from_ptr(obj) == malloc_default_zone());
+    [obj release];
+    malloc_destroy_zone(other);
+
+    succeed(__FILE__);
+}
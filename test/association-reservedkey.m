@@ -0,0 +1,35 @@
+// TEST_CONFIG MEM=mrc
+// TEST_CRASHES
+/*
+TEST_RUN_OUTPUT
+objc\[\d+\]: objc_setAssociatedObject: key 0x[0-9a-f]+ is reserved and cannot be used as an association key
+CRASHED: SIG(ILL|TRAP)
+END
+*/
+// The association table's empty and tombstone keys are rejected,
+// not silently confused with free slots. Lookups with them find nothing.
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/runtime.h>
+
+static char keys[8];
+
+int main()
+{
+    id obj = [TestRoot new];
+    id value = [TestRoot new];
+
+    // Enough keys to move the object's associations to a hash map.
+    for (int i = 0; i < 8; i++) {
+        objc_setAssociatedObject(obj, &keys[i], value, OBJC_ASSOCIATION_RETAIN);
+    }
+    testassert(objc_getAssociatedObject(obj, (void *)(uintptr_t)-1) == nil);
+    testassert(objc_getAssociatedObject(obj, (void *)(uintptr_t)-2) == nil);
+    testassert(objc_getAssociatedObject(obj, &keys[7]) == value);
+
+    objc_setAssociatedObject(obj, (void *)(uintptr_t)-1, value,
+                             OBJC_ASSOCIATION_RETAIN);
+
+    fail("reserved association key was accepted");
+}
@@ -0,0 +1,111 @@
+// TEST_CONFIG MEM=mrc
+// Associations are sharded by object and kept inline for a few keys.
+// Correctness across the inline-to-hash-map switch, and a multi-threaded
+// get/set benchmark of threads working on different objects. The
+// benchmark's times are printed, not checked.
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/runtime.h>
+
+#define KEYCOUNT 20
+#define THREADS 4
+#define OBJCOUNT 64
+#define ITERATIONS 20000
+
+static char keys[KEYCOUNT];
+
+static void *worker(void *arg)
+{
+    id *objs = (id *)arg;
+    for (int i = 0; i < ITERATIONS; i++) {
+        id obj = objs[i % OBJCOUNT];
+        objc_setAssociatedObject(obj, &keys[i % 3], obj, OBJC_ASSOCIATION_ASSIGN);
+        testassert(objc_getAssociatedObject(obj, &keys[i % 3]) == obj);
+    }
+    return NULL;
+}
+
+static id *newObjects(void)
+{
+    id *objs = (id *)malloc(OBJCOUNT * sizeof(id));
+    for (int i = 0; i < OBJCOUNT; i++) objs[i] = [TestRoot new];
+    return objs;
+}
+
+static void freeObjects(id *objs)
+{
+    for (int i = 0; i < OBJCOUNT; i++) [objs[i] release];
+    free(objs);
+}
+
+int main()
+{
+    testprintf("Inline and hash map associations\n");
+    id obj = [TestRoot new];
+    id values[KEYCOUNT];
+    for (int i = 0; i < KEYCOUNT; i++) {
+        values[i] = [TestRoot new];
+        objc_setAssociatedObject(obj, &keys[i], values[i], OBJC_ASSOCIATION_RETAIN);
+        [values[i] release];
+        for (int j = 0; j <= i; j++) {
+            testassert(objc_getAssociatedObject(obj, &keys[j]) == values[j]);
+        }
+    }
+
+    testprintf("Replace and remove\n");
+    TestRootDealloc = 0;
+    objc_setAssociatedObject(obj, &keys[0], nil, OBJC_ASSOCIATION_RETAIN);
+    testassert(TestRootDealloc == 1);
+    testassert(objc_getAssociatedObject(obj, &keys[0]) == nil);
+    id replacement = [TestRoot new];
+    objc_setAssociatedObject(obj, &keys[1], replacement, OBJC_ASSOCIATION_RETAIN);
+    [replacement release];
+    testassert(TestRootDealloc == 2);
+    testassert(objc_getAssociatedObject(obj, &keys[1]) == replacement);
+
+    testprintf("Dealloc releases every association\n");
+    TestRootDealloc = 0;
+    [obj release];
+    // obj itself plus the KEYCOUNT-1 values still associated
+    testassert(TestRootDealloc == 1 + (KEYCOUNT-1));
+
+    testprintf("Removing one of a few inline keys\n");
+    obj = [TestRoot new];
+    for (int i = 0; i < 3; i++) {
+        objc_setAssociatedObject(obj, &keys[i], obj, OBJC_ASSOCIATION_ASSIGN);
+    }
+    objc_setAssociatedObject(obj, &keys[0], nil, OBJC_ASSOCIATION_ASSIGN);
+    testassert(objc_getAssociatedObject(obj, &keys[0]) == nil);
+    testassert(objc_getAssociatedObject(obj, &keys[1]) == obj);
+    testassert(objc_getAssociatedObject(obj, &keys[2]) == obj);
+    objc_removeAssociatedObjects(obj);
+    testassert(objc_getAssociatedObject(obj, &keys[2]) == nil);
+    [obj release];
+
+    testprintf("Benchmark: %d threads versus one thread\n", THREADS);
+    id *objs[THREADS];
+    for (int t = 0; t < THREADS; t++) objs[t] = newObjects();
+
+    uint64_t startTime, serialTime, parallelTime;
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) worker(objs[t]);
+    serialTime = mach_absolute_time() - startTime;
+
+    pthread_t th[THREADS];
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, worker, objs[t]);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+    parallelTime = mach_absolute_time() - startTime;
+
+    for (int t = 0; t < THREADS; t++) freeObjects(objs[t]);
+
+    testprintf("time: %d threads %llu, one thread %llu\n",
+               THREADS, parallelTime, serialTime);
+
+    succeed(__FILE__);
+}
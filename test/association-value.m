@@ -0,0 +1,85 @@
+// TEST_CONFIG MEM=mrc
+// Raw-value associations are stored without boxing or retain/release.
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/runtime.h>
+#include <objc/objc-internal.h>
+
+static char intKey, structKey, objKey, bigKey;
+
+typedef struct {
+    uint64_t a;
+    uint32_t b;
+    uint16_t c;
+} Small;
+
+int main()
+{
+    TestRoot *obj = [TestRoot new];
+
+    testprintf("Scalars and structs\n");
+    int i = 42;
+    testassert(objc_setAssociatedValue(obj, &intKey, &i, sizeof(i)));
+    Small s = { 1, 2, 3 };
+    testassert(objc_setAssociatedValue(obj, &structKey, &s, sizeof(s)));
+
+    int outInt = 0;
+    testassert(objc_getAssociatedValue(obj, &intKey, &outInt, sizeof(outInt)) == sizeof(int));
+    testassert(outInt == 42);
+    Small outSmall = { 0, 0, 0 };
+    testassert(objc_getAssociatedValue(obj, &structKey, &outSmall, sizeof(outSmall)) == sizeof(Small));
+    testassert(outSmall.a == 1  &&  outSmall.b == 2  &&  outSmall.c == 3);
+
+    testprintf("Short buffer gets a prefix and the full size\n");
+    uint64_t prefix = 0;
+    testassert(objc_getAssociatedValue(obj, &structKey, &prefix, sizeof(prefix)) == sizeof(Small));
+    testassert(prefix == 1);
+
+    testprintf("Too big is rejected\n");
+    char big[OBJC_ASSOCIATED_VALUE_MAX + 1] = {0};
+    testassert(!objc_setAssociatedValue(obj, &bigKey, big, sizeof(big)));
+    testassert(objc_getAssociatedValue(obj, &bigKey, big, sizeof(big)) == 0);
+
+    testprintf("Raw values do not retain or release\n");
+    TestRootRetain = 0;
+    TestRootRelease = 0;
+    i = 7;
+    objc_setAssociatedValue(obj, &intKey, &i, sizeof(i));
+    objc_getAssociatedValue(obj, &intKey, &outInt, sizeof(outInt));
+    testassert(outInt == 7);
+    testassert(TestRootRetain == 0  &&  TestRootRelease == 0);
+
+    testprintf("Objects and raw values replace each other\n");
+    id value = [TestRoot new];
+    objc_setAssociatedObject(obj, &objKey, value, OBJC_ASSOCIATION_RETAIN);
+    testassert(objc_getAssociatedValue(obj, &objKey, &outInt, sizeof(outInt)) == 0);
+    TestRootDealloc = 0;
+    [value release];
+    objc_setAssociatedValue(obj, &objKey, &i, sizeof(i));
+    testassert(TestRootDealloc == 1);
+    testassert(objc_getAssociatedObject(obj, &objKey) == nil);
+
+    testprintf("Removal\n");
+    objc_setAssociatedValue(obj, &intKey, NULL, 0);
+    testassert(objc_getAssociatedValue(obj, &intKey, &outInt, sizeof(outInt)) == 0);
+
+    testprintf("Dealloc frees raw values\n");
+    TestRootDealloc = 0;
+    [obj release];
+    testassert(TestRootDealloc == 1);
+
+    // The first pass allocates the association tables.
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass) leak_mark();
+        for (int n = 0; n < 1000; n++) {
+            obj = [TestRoot new];
+            objc_setAssociatedValue(obj, &intKey, &n, sizeof(n));
+            objc_setAssociatedValue(obj, &structKey, &s, sizeof(s));
+            [obj release];
+        }
+    }
+    leak_check(0);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,95 @@
+// TEST_CONFIG MEM=mrc
+// Classes opted in to asynchronous deallocation: weak references read nil
+// once release returns, and C++ destructors, weak reference and association
+// cleanup, and free() run in the background in objc_destructInstance order.
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/objc-internal.h>
+#include <objc/runtime.h>
+#include <pthread.h>
+
+static pthread_t dtorThread;
+static volatile int dtors;
+
+struct Recorder {
+    ~Recorder() { dtorThread = pthread_self(); dtors++; }
+};
+
+@interface Async : TestRoot {
+    Recorder recorder;
+}
+@end
+@implementation Async
+@end
+
+@interface AsyncSub : Async @end
+@implementation AsyncSub @end
+
+int main()
+{
+    _class_setDeallocatesAsynchronously([Async class]);
+    objc_asyncDeallocStatistics before, after;
+    _objc_getAsyncDeallocStatistics(&before);
+
+    testprintf("Weak references read nil once release returns\n");
+    id obj = [Async new];
+    id weak = nil;
+    objc_storeWeak(&weak, obj);
+    id loaded = objc_loadWeakRetained(&weak);
+    testassert(loaded == obj);
+    [loaded release];
+    TestRootDealloc = 0;
+    [obj release];
+    testassert(TestRootDealloc == 1);
+    testassert(objc_loadWeak(&weak) == nil);
+
+    _objc_waitForAsyncDealloc();
+    testassert(dtors == 1);
+    testassert(!pthread_equal(dtorThread, pthread_self()));
+    testassert(weak == nil);
+    _objc_getAsyncDeallocStatistics(&after);
+    testassert(after.depth == 0);
+    testassert(after.enqueued + after.throttled ==
+               before.enqueued + before.throttled + 1);
+
+    testprintf("Associated objects are released in the background\n");
+    obj = [Async new];
+    id value = [TestRoot new];
+    objc_setAssociatedObject(obj, &weak, value, OBJC_ASSOCIATION_RETAIN);
+    [value release];
+    TestRootDealloc = 0;
+    [obj release];
+    _objc_waitForAsyncDealloc();
+    testassert(TestRootDealloc == 2);
+
+    testprintf("Subclasses inherit the setting\n");
+    obj = [AsyncSub new];
+    [obj release];
+    _objc_waitForAsyncDealloc();
+    testassert(dtors == 3);
+    testassert(!pthread_equal(dtorThread, pthread_self()));
+
+    testprintf("Other classes are unaffected\n");
+    obj = [TestRoot new];
+    _objc_getAsyncDeallocStatistics(&before);
+    [obj release];
+    _objc_getAsyncDeallocStatistics(&after);
+    testassert(after.enqueued == before.enqueued);
+    testassert(after.throttled == before.throttled);
+
+    testprintf("Bursts beyond the queue are freed inline\n");
+    leak_mark();
+    for (int i = 0; i < 100000; i++) {
+        [[Async new] release];
+    }
+    _objc_waitForAsyncDealloc();
+    testassert(dtors == 100003);
+    _objc_getAsyncDeallocStatistics(&after);
+    testassert(after.depth == 0);
+    testassert(after.maxDepth <= 4096);
+    leak_check(0);
+
+    succeed(__FILE__);
+}
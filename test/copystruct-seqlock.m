@@ -0,0 +1,87 @@
+// TEST_CONFIG
+// Atomic objc_copyStruct without strong references: readers never see a
+// torn value. Verbose runs also print how long threads reading one hot
+// property take compared with one thread.
+
+#include "test.h"
+#include <objc/objc-abi.h>
+
+typedef struct {
+    double x, y, width, height;
+} Rect;
+
+#define THREADS 4
+#define ITERATIONS 1000000
+
+static Rect shared;
+static Rect sharedCopy;
+static volatile int stop;
+
+static void *writer(void *arg __unused)
+{
+    for (double n = 0; !stop; n++) {
+        Rect r = { n, n, n, n };
+        objc_copyStruct(&shared, &r, sizeof(r), YES, NO);
+        // Shared to shared, as when copying between two objects' ivars.
+        objc_copyStruct(&sharedCopy, &shared, sizeof(r), YES, NO);
+    }
+    return NULL;
+}
+
+static void *checker(void *arg __unused)
+{
+    for (int i = 0; i < ITERATIONS / 10; i++) {
+        Rect r;
+        objc_copyStruct(&r, &shared, sizeof(r), YES, NO);
+        testassert(r.x == r.y  &&  r.y == r.width  &&  r.width == r.height);
+        objc_copyStruct(&r, &sharedCopy, sizeof(r), YES, NO);
+        testassert(r.x == r.y  &&  r.y == r.width  &&  r.width == r.height);
+    }
+    return NULL;
+}
+
+static void *reader(void *arg __unused)
+{
+    Rect r;
+    for (int i = 0; i < ITERATIONS; i++) {
+        objc_copyStruct(&r, &shared, sizeof(r), YES, NO);
+    }
+    testassert(r.x == r.height);
+    return NULL;
+}
+
+int main()
+{
+    testprintf("Readers never see torn writes\n");
+    pthread_t th[THREADS];
+    pthread_t w;
+    pthread_create(&w, NULL, writer, NULL);
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, checker, NULL);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+    stop = 1;
+    pthread_join(w, NULL);
+
+    testprintf("Benchmark: %d readers versus one\n", THREADS);
+    uint64_t startTime, serialTime, parallelTime;
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) reader(NULL);
+    serialTime = mach_absolute_time() - startTime;
+
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, reader, NULL);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+    parallelTime = mach_absolute_time() - startTime;
+
+    testprintf("time: %d threads %llu, one thread %llu\n",
+               THREADS, parallelTime, serialTime);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,81 @@
+// TEST_CONFIG MEM=mrc
+// class_createInstances: isa, zeroing, and one C++ constructor per object.
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/objc-internal.h>
+#include <objc/runtime.h>
+
+#define COUNT 1000
+
+static int ctors;
+static int dtors;
+
+struct Counter {
+    int value;
+    Counter() : value(42) { ctors++; }
+    ~Counter() { dtors++; }
+};
+
+@interface Plain : TestRoot { long ivars[4]; } @end
+@implementation Plain @end
+
+@interface WithCtor : TestRoot { Counter counter; } @end
+@implementation WithCtor
+-(int) value { return counter.value; }
+@end
+
+@interface SlabWithCtor : WithCtor @end
+@implementation SlabWithCtor @end
+
+static void check(Class cls, bool hasCtor)
+{
+    static id objs[COUNT];
+    ctors = dtors = 0;
+    TestRootDealloc = 0;
+
+    unsigned count = class_createInstances(cls, 0, objs, COUNT);
+    testassert(count > 0  &&  count <= COUNT);
+    for (unsigned i = 0; i < count; i++) {
+        testassert(object_getClass(objs[i]) == cls);
+        testassert(malloc_size(objs[i]) >= class_getInstanceSize(cls));
+        if (hasCtor) testassert([(WithCtor *)objs[i] value] == 42);
+        else {
+            long *ivars = (long *)((char *)objs[i] + sizeof(id));
+            for (unsigned j = 0; j < 4; j++) testassert(ivars[j] == 0);
+        }
+        // Instances must retain and release like any other.
+        [objs[i] retain];
+        [objs[i] release];
+    }
+    testassert(ctors == (hasCtor ? (int)count : 0));
+
+    for (unsigned i = 0; i < count; i++) [objs[i] release];
+    testassert(TestRootDealloc == (int)count);
+    testassert(dtors == (hasCtor ? (int)count : 0));
+}
+
+int main()
+{
+    _class_setUsesSlabAllocator([SlabWithCtor class]);
+
+    testprintf("Plain class\n");
+    check([Plain class], false);
+    testprintf("C++ constructors\n");
+    check([WithCtor class], true);
+    testprintf("Slab-allocated class\n");
+    check([SlabWithCtor class], true);
+
+    leak_mark();
+    for (int i = 0; i < 10; i++) {
+        check([Plain class], false);
+        check([SlabWithCtor class], true);
+    }
+    leak_check(0);
+
+    id obj;
+    testassert(class_createInstances(Nil, 0, &obj, 1) == 0);
+
+    succeed(__FILE__);
+}
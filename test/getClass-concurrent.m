@@ -0,0 +1,133 @@
+// TEST_CONFIG
+// objc_getClass and objc_getProtocol without runtimeLock: classes and
+// protocols are found by name while another thread adds and disposes
+// classes and the name index grows. Lookup times for many threads and
+// for one are printed for comparison.
+
+#include "test.h"
+#include "testroot.i"
+#include <string.h>
+#include <objc/runtime.h>
+
+@protocol ConcurrentProto @end
+
+@interface ConcurrentSub : TestRoot <ConcurrentProto> @end
+@implementation ConcurrentSub @end
+
+#define THREADS 4
+#define CHURN 5000
+#define ITERATIONS 1000000
+
+static volatile int stop;
+
+static void *churn(void *arg __unused)
+{
+    char name[64];
+    for (int i = 0; i < CHURN; i++) {
+        snprintf(name, sizeof(name), "ConcurrentChurn%d", i);
+        Class cls = objc_allocateClassPair([TestRoot class], name, 0);
+        testassert(cls);
+        testassert(!objc_getClass(name));
+        objc_registerClassPair(cls);
+        testassert(objc_getClass(name) == cls);
+        if (i % 2) {
+            objc_disposeClassPair(cls);
+            testassert(!objc_getClass(name));
+        }
+    }
+    return NULL;
+}
+
+static void *checker(void *arg __unused)
+{
+    char name[64];
+    for (int i = 0; !stop; i++) {
+        testassert(objc_getClass("ConcurrentSub") == [ConcurrentSub class]);
+        testassert(objc_getProtocol("ConcurrentProto") ==
+                   @protocol(ConcurrentProto));
+        // Even-numbered churned classes are never disposed, 
+        // so once found they stay valid.
+        snprintf(name, sizeof(name), "ConcurrentChurn%d", (i * 2) % CHURN);
+        Class found = objc_lookUpClass(name);
+        if (found) testassert(0 == strcmp(class_getName(found), name));
+    }
+    return NULL;
+}
+
+static void *lookUp(void *arg __unused)
+{
+    for (int i = 0; i < ITERATIONS; i++) {
+        testassert(objc_getClass("ConcurrentSub") == [ConcurrentSub class]);
+    }
+    return NULL;
+}
+
+int main()
+{
+    testprintf("Classes and protocols by name\n");
+    testassert(objc_getClass("ConcurrentSub") == [ConcurrentSub class]);
+    testassert(objc_lookUpClass("TestRoot") == [TestRoot class]);
+    testassert(!objc_getClass("ConcurrentNoSuchClass"));
+    testassert(objc_getProtocol("ConcurrentProto") ==
+               @protocol(ConcurrentProto));
+    testassert(!objc_getProtocol("ConcurrentNoSuchProto"));
+
+    Protocol *proto = objc_allocateProtocol("ConcurrentRuntimeProto");
+    testassert(proto);
+    testassert(!objc_getProtocol("ConcurrentRuntimeProto"));
+    objc_registerProtocol(proto);
+    testassert(objc_getProtocol("ConcurrentRuntimeProto") == proto);
+
+    testprintf("Disposed classes and reused names\n");
+    Class cls = objc_allocateClassPair([TestRoot class], "ConcurrentReused", 0);
+    objc_registerClassPair(cls);
+    testassert(objc_getClass("ConcurrentReused") == cls);
+    objc_disposeClassPair(cls);
+    testassert(!objc_getClass("ConcurrentReused"));
+    cls = objc_allocateClassPair([ConcurrentSub class], "ConcurrentReused", 0);
+    objc_registerClassPair(cls);
+    testassert(objc_getClass("ConcurrentReused") == cls);
+    testassert(class_getSuperclass(objc_getClass("ConcurrentReused")) ==
+               [ConcurrentSub class]);
+
+    testprintf("Lookups while classes are added and disposed\n");
+    pthread_t th[THREADS];
+    pthread_t writer;
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, checker, NULL);
+    }
+    pthread_create(&writer, NULL, churn, NULL);
+    pthread_join(writer, NULL);
+    stop = 1;
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+
+    char name[64];
+    for (int i = 0; i < CHURN; i++) {
+        snprintf(name, sizeof(name), "ConcurrentChurn%d", i);
+        Class found = objc_getClass(name);
+        if (i % 2) testassert(!found);
+        else testassert(found  &&  0 == strcmp(class_getName(found), name));
+    }
+
+    testprintf("Benchmark: %d threads looking up versus one\n", THREADS);
+    uint64_t startTime, serialTime, parallelTime;
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) lookUp(NULL);
+    serialTime = mach_absolute_time() - startTime;
+
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, lookUp, NULL);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+    parallelTime = mach_absolute_time() - startTime;
+
+    testprintf("time: %d threads %llu, one thread %llu\n",
+               THREADS, parallelTime, serialTime);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,89 @@
+/*
+TEST_CONFIG
+TEST_ENV OBJC_PROFILE_LOCKS=YES
+*/
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/runtime.h>
+#include <objc/objc-internal.h>
+
+#define THREADS 4
+#define COUNT 2000
+
+static id method(id self, SEL _cmd __unused) { return self; }
+
+static void *worker(void *arg)
+{
+    char name[64];
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(name, sizeof(name), "lockprofile_%d_%d", (int)(intptr_t)arg, i);
+        SEL sel = sel_registerName(name);
+        testassert(class_addMethod([TestRoot class], sel, (IMP)method, "@@:"));
+        testassert(class_getInstanceMethod([TestRoot class], sel));
+    }
+    return NULL;
+}
+
+static objc_lockProfile *find(objc_lockProfile *all, unsigned int count,
+                              const char *name)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        if (0 == strcmp(all[i].name, name)) return &all[i];
+    }
+    return NULL;
+}
+
+int main()
+{
+    pthread_t th[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, worker, (void *)(intptr_t)t);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+
+    unsigned int count;
+    objc_lockProfile *all = _objc_copyLockProfiles(&count);
+    testassert(all);
+    testassert(count >= 5);
+
+#if __OBJC2__
+    const char *names[] = { "runtimeLock", "selLock", "cacheUpdateLock", 
+                            "loadMethodLock", "classInitLock" };
+#else
+    const char *names[] = { "selLock", "classLock", "methodListLock", 
+                            "cacheUpdateLock", "loadMethodLock", 
+                            "classInitLock" };
+#endif
+    for (unsigned int i = 0; i < sizeof(names)/sizeof(names[0]); i++) {
+        objc_lockProfile *p = find(all, count, names[i]);
+        testassert(p);
+        testassert(p->contended <= p->acquisitions);
+        uint64_t holds = 0;
+        uint64_t waits = 0;
+        for (int b = 0; b < OBJC_LOCK_PROFILE_BUCKETS; b++) {
+            holds += p->holdHistogram[b];
+            waits += p->waitHistogram[b];
+        }
+        testassert(holds <= p->acquisitions);
+        testassert(waits == p->contended);
+        testprintf("%s: %llu acquisitions, %llu contended, "
+                   "wait %llu ns, hold %llu ns\n", p->name, 
+                   p->acquisitions, p->contended, p->waitTime, p->holdTime);
+    }
+
+    // Every worker added methods. sel_registerName takes no lock, 
+    // but image loading still takes selLock.
+    objc_lockProfile *sel = find(all, count, "selLock");
+    testassert(sel->acquisitions > 0);
+#if __OBJC2__
+    objc_lockProfile *runtime = find(all, count, "runtimeLock");
+    testassert(runtime->acquisitions >= THREADS * COUNT);
+    testassert(runtime->holdTime > 0);
+#endif
+    free(all);
+
+    succeed(__FILE__);
+}
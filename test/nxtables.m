@@ -0,0 +1,396 @@
+// TEST_CFLAGS -Wno-deprecated-declarations
+// NXMapTable and NXHashTable: insert, replace, remove, iterate, and grow
+// through tombstones. Benchmarks insert, lookup and iteration against
+// the chained and linear-probing tables they replaced.
+
+#include "test.h"
+#include <string.h>
+#include <objc/hashtable2.h>
+#include <objc/maptable.h>
+
+#define COUNT 20000
+#define LOOKUPS 10
+
+static char *names[COUNT];
+
+
+/***********************************************************************
+* The old NXMapTable: linear probing, xor-folded string hash.
+**********************************************************************/
+
+typedef struct { const char *key; const void *value; } LegacyPair;
+typedef struct { unsigned count; unsigned mask; LegacyPair *pairs; } LegacyMap;
+
+static unsigned legacyStrHash(const char *s)
+{
+    unsigned hash = 0;
+    for (int shift = 0; *s; shift = (shift + 8) % 32) {
+        hash ^= (unsigned)(unsigned char)*s++ << shift;
+    }
+    unsigned xored = (hash & 0xffff) ^ (hash >> 16);
+    return (xored * 65521) + hash;
+}
+
+static void legacyMapInsert(LegacyMap *map, const char *key, const void *value);
+
+static void legacyMapGrow(LegacyMap *map)
+{
+    LegacyPair *old = map->pairs;
+    unsigned nb = map->mask + 1;
+    map->mask = nb * 2 - 1;
+    map->count = 0;
+    map->pairs = (LegacyPair *)calloc(nb * 2, sizeof(LegacyPair));
+    for (unsigned i = 0; i < nb; i++) {
+        if (old[i].key) legacyMapInsert(map, old[i].key, old[i].value);
+    }
+    free(old);
+}
+
+static void legacyMapInsert(LegacyMap *map, const char *key, const void *value)
+{
+    unsigned i = legacyStrHash(key) & map->mask;
+    while (map->pairs[i].key) {
+        if (0 == strcmp(map->pairs[i].key, key)) {
+            map->pairs[i].value = value;
+            return;
+        }
+        i = (i + 1) & map->mask;
+    }
+    map->pairs[i].key = key;
+    map->pairs[i].value = value;
+    if (++map->count * 4 > (map->mask + 1) * 3) legacyMapGrow(map);
+}
+
+// One call per element, like NXNextMapState.
+static __attribute__((noinline))
+int legacyMapNext(LegacyMap *map, int *index, const char **key, const void **value)
+{
+    while ((*index)--) {
+        LegacyPair *pair = &map->pairs[*index];
+        if (pair->key) {
+            *key = pair->key;
+            *value = pair->value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static const void *legacyMapGet(LegacyMap *map, const char *key)
+{
+    unsigned i = legacyStrHash(key) & map->mask;
+    while (map->pairs[i].key) {
+        if (0 == strcmp(map->pairs[i].key, key)) return map->pairs[i].value;
+        i = (i + 1) & map->mask;
+    }
+    return NULL;
+}
+
+
+/***********************************************************************
+* The old NXHashTable: chained buckets, modulo of 2**n-1 buckets.
+**********************************************************************/
+
+typedef struct { unsigned count; const char **elements; } LegacyBucket;
+typedef struct { unsigned count; unsigned nbBuckets; LegacyBucket *buckets; } LegacyHash;
+
+static void legacyHashInsert(LegacyHash *table, const char *data);
+
+static void legacyHashGrow(LegacyHash *table)
+{
+    LegacyBucket *old = table->buckets;
+    unsigned nb = table->nbBuckets;
+    table->nbBuckets = nb * 2 + 1;
+    table->count = 0;
+    table->buckets = (LegacyBucket *)calloc(table->nbBuckets, sizeof(LegacyBucket));
+    for (unsigned i = 0; i < nb; i++) {
+        for (unsigned j = 0; j < old[i].count; j++) {
+            legacyHashInsert(table, old[i].elements[j]);
+        }
+        free(old[i].elements);
+    }
+    free(old);
+}
+
+static void legacyHashInsert(LegacyHash *table, const char *data)
+{
+    LegacyBucket *bucket =
+        &table->buckets[NXStrHash(NULL, data) % table->nbBuckets];
+    for (unsigned j = 0; j < bucket->count; j++) {
+        if (0 == strcmp(bucket->elements[j], data)) return;
+    }
+    // Each insertion reallocates the chain, as the old table did.
+    const char **elements =
+        (const char **)malloc((bucket->count + 1) * sizeof(char *));
+    if (bucket->count) {
+        memcpy(elements + 1, bucket->elements, bucket->count * sizeof(char *));
+    }
+    elements[0] = data;
+    free(bucket->elements);
+    bucket->elements = elements;
+    bucket->count++;
+    if (++table->count > table->nbBuckets) legacyHashGrow(table);
+}
+
+// One call per element, like NXNextHashState.
+static __attribute__((noinline))
+int legacyHashNext(LegacyHash *table, int *i, int *j, const char **data)
+{
+    while (*j == 0) {
+        if (*i == 0) return 0;
+        (*i)--;
+        *j = table->buckets[*i].count;
+    }
+    (*j)--;
+    *data = table->buckets[*i].elements[*j];
+    return 1;
+}
+
+static const char *legacyHashGet(LegacyHash *table, const char *data)
+{
+    LegacyBucket *bucket =
+        &table->buckets[NXStrHash(NULL, data) % table->nbBuckets];
+    for (unsigned j = 0; j < bucket->count; j++) {
+        if (0 == strcmp(bucket->elements[j], data)) return bucket->elements[j];
+    }
+    return NULL;
+}
+
+
+static void testMapTable(void)
+{
+    NXMapTable *map = NXCreateMapTable(NXStrValueMapPrototype, 0);
+    for (int i = 0; i < COUNT; i++) {
+        testassert(NXMapInsert(map, names[i], (void *)(intptr_t)(i+1)) == NULL);
+    }
+    testassert(NXCountMapTable(map) == COUNT);
+
+    // Replace
+    testassert(NXMapInsert(map, names[7], (void *)1000000) == (void *)8);
+    testassert(NXMapGet(map, names[7]) == (void *)1000000);
+    testassert(NXCountMapTable(map) == COUNT);
+
+    // A copy of the key finds the original
+    char *copy = strdup(names[9]);
+    void *value;
+    testassert(NXMapMember(map, copy, &value) == names[9]);
+    testassert(value == (void *)10);
+    free(copy);
+    testassert(NXMapMember(map, "not a key", &value) == NX_MAPNOTAKEY);
+
+    // Remove every other key, then reinsert them many times over so
+    // the table reuses and clears its tombstones.
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < COUNT; i += 2) {
+            testassert(NXMapRemove(map, names[i]) != NULL);
+            testassert(NXMapGet(map, names[i]) == NULL);
+        }
+        testassert(NXCountMapTable(map) == COUNT / 2);
+        for (int i = 1; i < COUNT; i += 2) {
+            testassert(NXMapGet(map, names[i]) != NULL);
+        }
+        for (int i = 0; i < COUNT; i += 2) {
+            NXMapInsert(map, names[i], (void *)(intptr_t)(i+1));
+        }
+    }
+    testassert(NXCountMapTable(map) == COUNT);
+
+    // Iterate
+    NXMapState state = NXInitMapState(map);
+    const void *key;
+    const void *v;
+    unsigned seen = 0;
+    while (NXNextMapState(map, &state, &key, &v)) {
+        testassert(NXMapGet(map, key) == v);
+        seen++;
+    }
+    testassert(seen == COUNT);
+
+    NXResetMapTable(map);
+    testassert(NXCountMapTable(map) == 0);
+    testassert(NXMapGet(map, names[0]) == NULL);
+    NXMapInsert(map, names[0], (void *)1);
+    testassert(NXMapGet(map, names[0]) == (void *)1);
+    NXFreeMapTable(map);
+
+    // Pointer keys
+    map = NXCreateMapTable(NXPtrValueMapPrototype, 4);
+    for (int i = 0; i < COUNT; i++) NXMapInsert(map, names[i], names[i]);
+    for (int i = 0; i < COUNT; i++) testassert(NXMapGet(map, names[i]) == names[i]);
+    NXFreeMapTable(map);
+}
+
+static void testHashTable(void)
+{
+    NXHashTable *table = NXCreateHashTable(NXStrPrototype, 0, NULL);
+    for (int i = 0; i < COUNT; i++) {
+        testassert(NXHashInsertIfAbsent(table, names[i]) == names[i]);
+    }
+    testassert(NXCountHashTable(table) == COUNT);
+
+    char *copy = strdup(names[3]);
+    testassert(NXHashGet(table, copy) == names[3]);
+    testassert(NXHashInsertIfAbsent(table, copy) == names[3]);
+    testassert(NXHashInsert(table, copy) == names[3]);
+    testassert(NXHashGet(table, names[3]) == copy);
+    testassert(NXHashInsert(table, names[3]) == copy);
+    free(copy);
+    testassert(!NXHashMember(table, "not a member"));
+
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < COUNT; i += 2) {
+            testassert(NXHashRemove(table, names[i]) == names[i]);
+            testassert(!NXHashMember(table, names[i]));
+        }
+        testassert(NXCountHashTable(table) == COUNT / 2);
+        for (int i = 0; i < COUNT; i += 2) NXHashInsert(table, names[i]);
+    }
+    testassert(NXCountHashTable(table) == COUNT);
+
+    NXHashTable *copyTable = NXCopyHashTable(table);
+    testassert(NXCompareHashTables(table, copyTable));
+    NXHashRemove(copyTable, names[0]);
+    testassert(!NXCompareHashTables(table, copyTable));
+    testassert(NXHashMember(table, names[0]));
+    NXFreeHashTable(copyTable);
+
+    NXHashState state = NXInitHashState(table);
+    void *data;
+    unsigned seen = 0;
+    while (NXNextHashState(table, &state, &data)) {
+        testassert(NXHashGet(table, data) == data);
+        seen++;
+    }
+    testassert(seen == COUNT);
+
+    NXEmptyHashTable(table);
+    testassert(NXCountHashTable(table) == 0);
+    testassert(!NXHashMember(table, names[0]));
+    NXFreeHashTable(table);
+}
+
+static void benchmark(void)
+{
+    uint64_t start, newTime, legacyTime;
+
+    testprintf("Benchmark: NXMapTable versus linear probing\n");
+    start = mach_absolute_time();
+    NXMapTable *map = NXCreateMapTable(NXStrValueMapPrototype, 0);
+    for (int i = 0; i < COUNT; i++) NXMapInsert(map, names[i], names[i]);
+    newTime = mach_absolute_time() - start;
+
+    start = mach_absolute_time();
+    LegacyMap legacyMap = { 0, 1, (LegacyPair *)calloc(2, sizeof(LegacyPair)) };
+    for (int i = 0; i < COUNT; i++) legacyMapInsert(&legacyMap, names[i], names[i]);
+    legacyTime = mach_absolute_time() - start;
+    timecheck("NXMapTable insert", newTime, 0, legacyTime * 1.25);
+
+    start = mach_absolute_time();
+    for (int n = 0; n < LOOKUPS; n++) {
+        for (int i = 0; i < COUNT; i++) testassert(NXMapGet(map, names[i]));
+    }
+    newTime = mach_absolute_time() - start;
+
+    start = mach_absolute_time();
+    for (int n = 0; n < LOOKUPS; n++) {
+        for (int i = 0; i < COUNT; i++) testassert(legacyMapGet(&legacyMap, names[i]));
+    }
+    legacyTime = mach_absolute_time() - start;
+    timecheck("NXMapTable lookup", newTime, 0, legacyTime);
+
+    start = mach_absolute_time();
+    const void *key;
+    const void *value;
+    unsigned seen = 0;
+    for (int n = 0; n < LOOKUPS; n++) {
+        NXMapState state = NXInitMapState(map);
+        while (NXNextMapState(map, &state, &key, &value)) seen++;
+    }
+    newTime = mach_absolute_time() - start;
+    testassert(seen == COUNT * LOOKUPS);
+
+    start = mach_absolute_time();
+    seen = 0;
+    const char *legacyKey;
+    for (int n = 0; n < LOOKUPS; n++) {
+        int index = legacyMap.mask + 1;
+        while (legacyMapNext(&legacyMap, &index, &legacyKey, &value)) seen++;
+    }
+    legacyTime = mach_absolute_time() - start;
+    testassert(seen == COUNT * LOOKUPS);
+    // The old table's weak hash packed keys into runs, 
+    // which made its slot-by-slot scan easy to predict.
+    timecheck("NXMapTable iterate", newTime, 0, legacyTime * 2);
+
+    NXFreeMapTable(map);
+    free(legacyMap.pairs);
+
+    testprintf("Benchmark: NXHashTable versus chained buckets\n");
+    start = mach_absolute_time();
+    NXHashTable *table = NXCreateHashTable(NXStrPrototype, 0, NULL);
+    for (int i = 0; i < COUNT; i++) NXHashInsert(table, names[i]);
+    newTime = mach_absolute_time() - start;
+
+    start = mach_absolute_time();
+    LegacyHash legacyHash = { 0, 1, (LegacyBucket *)calloc(1, sizeof(LegacyBucket)) };
+    for (int i = 0; i < COUNT; i++) legacyHashInsert(&legacyHash, names[i]);
+    legacyTime = mach_absolute_time() - start;
+    timecheck("NXHashTable insert", newTime, 0, legacyTime);
+
+    start = mach_absolute_time();
+    for (int n = 0; n < LOOKUPS; n++) {
+        for (int i = 0; i < COUNT; i++) testassert(NXHashGet(table, names[i]));
+    }
+    newTime = mach_absolute_time() - start;
+
+    start = mach_absolute_time();
+    for (int n = 0; n < LOOKUPS; n++) {
+        for (int i = 0; i < COUNT; i++) testassert(legacyHashGet(&legacyHash, names[i]));
+    }
+    legacyTime = mach_absolute_time() - start;
+    timecheck("NXHashTable lookup", newTime, 0, legacyTime);
+
+    start = mach_absolute_time();
+    seen = 0;
+    void *data;
+    for (int n = 0; n < LOOKUPS; n++) {
+        NXHashState state = NXInitHashState(table);
+        while (NXNextHashState(table, &state, &data)) seen++;
+    }
+    newTime = mach_absolute_time() - start;
+    testassert(seen == COUNT * LOOKUPS);
+
+    start = mach_absolute_time();
+    seen = 0;
+    const char *legacyData;
+    for (int n = 0; n < LOOKUPS; n++) {
+        int i = legacyHash.nbBuckets;
+        int j = 0;
+        while (legacyHashNext(&legacyHash, &i, &j, &legacyData)) seen++;
+    }
+    legacyTime = mach_absolute_time() - start;
+    testassert(seen == COUNT * LOOKUPS);
+    timecheck("NXHashTable iterate", newTime, 0, legacyTime * 1.25);
+
+    NXFreeHashTable(table);
+    for (unsigned i = 0; i < legacyHash.nbBuckets; i++) {
+        free(legacyHash.buckets[i].elements);
+    }
+    free(legacyHash.buckets);
+}
+
+int main()
+{
+    // Names shaped like class names, with long shared prefixes.
+    for (int i = 0; i < COUNT; i++) {
+        asprintf(&names[i], "_TtC10SomeModule%dViewController", i);
+    }
+
+    testMapTable();
+    testHashTable();
+    benchmark();
+
+    for (int i = 0; i < COUNT; i++) free(names[i]);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,43 @@
+// TEST_CONFIG MEM=mrc
+// Autorelease pool pages retired by pop are cached per thread and reused.
+
+#include "test.h"
+#include "testroot.i"
+
+// More than one pool page's worth of objects.
+#define PAGE_OBJECTS (PAGE_MAX_SIZE / sizeof(id) + 16)
+
+static void cycle(int count)
+{
+    for (int i = 0; i < count; i++) {
+        void *pool = objc_autoreleasePoolPush();
+        for (size_t j = 0; j < PAGE_OBJECTS; j++) {
+            [[TestRoot new] autorelease];
+        }
+        objc_autoreleasePoolPop(pool);
+    }
+}
+
+int main()
+{
+    // warm up
+    cycle(10);
+    testonthread(^{ cycle(10); });
+
+    TestRootDealloc = 0;
+    leak_mark();
+
+    cycle(1000);
+    testassert(TestRootDealloc == 1000 * PAGE_OBJECTS);
+
+    // A thread's cached pages must be freed when it exits.
+    for (int i = 0; i < 100; i++) {
+        testonthread(^{ cycle(10); });
+    }
+    testassert(TestRootDealloc == 2000 * PAGE_OBJECTS);
+
+    // Allow for this thread's own pages and page cache.
+    leak_check(8 * PAGE_MAX_SIZE);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,63 @@
+/*
+TEST_CONFIG MEM=mrc
+TEST_ENV OBJC_RECORD_POOL_STATISTICS=YES
+*/
+
+#include "test.h"
+#include "testroot.i"
+
+int main()
+{
+    objc_autoreleasePoolStatistics before, after;
+
+    testassert(_objc_autoreleasePoolGetStatistics(&before));
+
+    testprintf("Push, autorelease, pop\n");
+    void *outer = objc_autoreleasePoolPush();
+    void *inner = objc_autoreleasePoolPush();
+    for (int i = 0; i < 5; i++) {
+        [[TestRoot new] autorelease];
+    }
+    testassert(_objc_autoreleasePoolGetStatistics(&after));
+    testassert(after.pushes == before.pushes + 2);
+    testassert(after.depth == before.depth + 2);
+    testassert(after.pending == before.pending + 5);
+    testassert(after.highWater >= after.pending);
+    testassert(after.pages >= 1);
+
+    // Popping the outer pool pops the inner pool too.
+    objc_autoreleasePoolPop(outer);
+    (void)inner;
+    testassert(_objc_autoreleasePoolGetStatistics(&after));
+    testassert(after.pops == before.pops + 1);
+    testassert(after.depth == before.depth);
+    testassert(after.pending == before.pending);
+    // 5 objects released by one pop land in bucket 3 (4..7)
+    testassert(after.releasesPerPop[3] == before.releasesPerPop[3] + 1);
+
+    testprintf("Empty pop\n");
+    objc_autoreleasePoolPop(objc_autoreleasePoolPush());
+    testassert(_objc_autoreleasePoolGetStatistics(&before));
+    testassert(before.releasesPerPop[0] == after.releasesPerPop[0] + 1);
+
+    testprintf("Exited threads are combined\n");
+    testonthread(^{
+        void *pool = objc_autoreleasePoolPush();
+        [[TestRoot new] autorelease];
+        objc_autoreleasePoolPop(pool);
+    });
+
+    unsigned int count;
+    objc_autoreleasePoolStatistics *all =
+        _objc_autoreleasePoolCopyStatistics(&count);
+    testassert(all);
+    testassert(count >= 2);
+    objc_autoreleasePoolStatistics exited = all[count-1];
+    testassert(exited.thread == 0);
+    testassert(exited.threadCount >= 1);
+    testassert(exited.pushes >= 1);
+    testassert(exited.pops >= 1);
+    free(all);
+
+    succeed(__FILE__);
+}
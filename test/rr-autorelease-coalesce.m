@@ -0,0 +1,93 @@
+// TEST_CONFIG MEM=mrc
+// Consecutive autoreleases of one object may share a pool entry,
+// but every autorelease must still be balanced by one release.
+// Objects without custom RR take an entry's releases in one go.
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/NSObject.h>
+
+#define COUNT 100000
+
+static int PlainDealloc;
+
+// No custom RR, so a coalesced entry is released in one go.
+@interface Plain : NSObject @end
+@implementation Plain
+-(void) dealloc {
+    PlainDealloc++;
+    [super dealloc];
+}
+@end
+
+int main()
+{
+    TestRoot *obj = [TestRoot new];
+
+    testprintf("Coalesced autoreleases release once each\n");
+    void *pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < COUNT; i++) {
+        [[obj retain] autorelease];
+    }
+    TestRootRelease = 0;
+    objc_autoreleasePoolPop(pool);
+    testassert(TestRootRelease == COUNT);
+    testassert(TestRootDealloc == 0);
+
+    testprintf("Pool boundaries are not coalesced\n");
+    void *outer = objc_autoreleasePoolPush();
+    [[obj retain] autorelease];
+    [[obj retain] autorelease];
+    void *inner = objc_autoreleasePoolPush();
+    [[obj retain] autorelease];
+    TestRootRelease = 0;
+    objc_autoreleasePoolPop(inner);
+    testassert(TestRootRelease == 1);
+    objc_autoreleasePoolPop(outer);
+    testassert(TestRootRelease == 3);
+    testassert(TestRootDealloc == 0);
+
+    testprintf("Interleaved objects\n");
+    TestRoot *other = [TestRoot new];
+    pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < 1000; i++) {
+        [[obj retain] autorelease];
+        [[obj retain] autorelease];
+        [[other retain] autorelease];
+    }
+    TestRootRelease = 0;
+    objc_autoreleasePoolPop(pool);
+    testassert(TestRootRelease == 3000);
+    testassert(TestRootDealloc == 0);
+
+    testprintf("Last autorelease deallocates\n");
+    pool = objc_autoreleasePoolPush();
+    [obj autorelease];
+    [other autorelease];
+    [other retain];
+    [other autorelease];
+    objc_autoreleasePoolPop(pool);
+    testassert(TestRootDealloc == 2);
+
+    testprintf("Default RR releases a coalesced entry at once\n");
+    // COUNT is large enough to spill into the side table.
+    Plain *plain = [Plain new];
+    pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < COUNT; i++) {
+        [[plain retain] autorelease];
+    }
+    testassert([plain retainCount] == COUNT + 1);
+    objc_autoreleasePoolPop(pool);
+    testassert([plain retainCount] == 1);
+    testassert(PlainDealloc == 0);
+
+    pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < COUNT; i++) {
+        [[plain retain] autorelease];
+    }
+    [plain autorelease];
+    objc_autoreleasePoolPop(pool);
+    testassert(PlainDealloc == 1);
+
+    succeed(__FILE__);
+}
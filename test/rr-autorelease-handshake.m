@@ -0,0 +1,189 @@
+// TEST_CONFIG MEM=mrc
+// TEST_CFLAGS -Os
+// TEST_ENV OBJC_USE_RETURN_HANDSHAKE=YES OBJC_RECORD_POOL_STATISTICS=YES
+// Optimized return handshake: claims by the caller that parked the result,
+// correctness of unclaimed results,
+// and timing of the optimized round trip versus autorelease+retain.
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/objc-internal.h>
+#include <objc/objc-abi.h>
+
+#if __i386__
+
+int main()
+{
+    // no optimization on i386 (neither Mac nor Simulator)
+    succeed(__FILE__);
+}
+
+#else
+
+#ifdef __arm__
+#   define MAGIC      asm volatile("mov r7, r7")
+#elif __arm64__
+#   define MAGIC      asm volatile("mov x29, x29")
+#else
+#   define MAGIC      asm volatile("")
+#endif
+
+#define COUNT 1000000
+
+static id __attribute__((noinline)) callee(id obj)
+{
+    return objc_autoreleaseReturnValue(obj);
+}
+
+// Not the call site callee() returned to.
+static id __attribute__((noinline)) otherFrame(id obj)
+{
+    id result = objc_retainAutoreleasedReturnValue(obj);
+    asm volatile("");
+    return result;
+}
+
+// An MRC caller that ignores the result, leaving it parked.
+static void __attribute__((noinline)) ignoreResult(id obj)
+{
+    callee(obj);
+    asm volatile("");
+}
+
+// An ARC caller at the same stack depth as ignoreResult().
+static id __attribute__((noinline)) claimResult(id obj)
+{
+    testprintf("claiming %p\n", obj);
+    id result = objc_retainAutoreleasedReturnValue(obj);
+    asm volatile("");
+    return result;
+}
+
+static uint64_t pendingAutoreleases()
+{
+    objc_autoreleasePoolStatistics stats;
+    testassert(_objc_autoreleasePoolGetStatistics(&stats));
+    return stats.pending;
+}
+
+int main()
+{
+    TestRoot *obj, *tmp;
+
+    testprintf("Unclaimed result belongs to the enclosing pool\n");
+    TestRootDealloc = 0;
+    void *outer = objc_autoreleasePoolPush();
+    obj = [TestRoot new];
+    tmp = callee(obj);
+    testassert(tmp == obj);
+    void *inner = objc_autoreleasePoolPush();
+    objc_autoreleasePoolPop(inner);
+    testassert(TestRootDealloc == 0);
+    objc_autoreleasePoolPop(outer);
+    testassert(TestRootDealloc == 1);
+
+    testprintf("Claimed result is +1 and never reaches the pool\n");
+    TestRootDealloc = 0;
+    outer = objc_autoreleasePoolPush();
+    obj = [TestRoot new];
+    uint64_t pending = pendingAutoreleases();
+    tmp = callee(obj);
+    MAGIC;
+    tmp = objc_retainAutoreleasedReturnValue(tmp);
+    testassert(tmp == obj);
+    testassert([tmp retainCount] == 1);
+    objc_autoreleasePoolPush();  // flushes anything still parked
+    testassert(pendingAutoreleases() == pending);
+    [tmp release];
+    testassert(TestRootDealloc == 1);
+    objc_autoreleasePoolPop(outer);
+    testassert(TestRootDealloc == 1);
+
+    testprintf("A later return flushes an unclaimed one\n");
+    TestRootDealloc = 0;
+    outer = objc_autoreleasePoolPush();
+    TestRoot *first = [TestRoot new];
+    TestRoot *second = [TestRoot new];
+    callee(first);
+    tmp = callee(second);
+    MAGIC;
+    tmp = objc_retainAutoreleasedReturnValue(tmp);
+    testassert(tmp == second);
+    [tmp release];
+    objc_autoreleasePoolPop(outer);
+    testassert(TestRootDealloc == 2);
+
+    testprintf("Another frame does not claim an unclaimed result\n");
+    TestRootDealloc = 0;
+    outer = objc_autoreleasePoolPush();
+    obj = [TestRoot new];
+    callee(obj);
+    tmp = otherFrame(obj);
+    testassert(tmp == obj);
+    testassert([tmp retainCount] == 2);
+    [tmp release];
+    testassert(TestRootDealloc == 0);
+    objc_autoreleasePoolPop(outer);
+    testassert(TestRootDealloc == 1);
+
+    testprintf("A stale result is not claimed by a caller at the same depth\n");
+    TestRootDealloc = 0;
+    outer = objc_autoreleasePoolPush();
+    obj = [TestRoot new];
+    pending = pendingAutoreleases();
+    ignoreResult(obj);
+    tmp = claimResult(obj);
+    testassert(tmp == obj);
+    testassert([tmp retainCount] == 2);
+    objc_autoreleasePoolPush();  // flushes the stale result into the pool
+    testassert(pendingAutoreleases() == pending + 1);
+    [tmp release];
+    testassert(TestRootDealloc == 0);
+    objc_autoreleasePoolPop(outer);
+    testassert(TestRootDealloc == 1);
+
+    testprintf("Unclaimed result at thread exit\n");
+    TestRootDealloc = 0;
+    testonthread(^{
+        callee([TestRoot new]);
+    });
+    testassert(TestRootDealloc == 1);
+
+    // Timing: optimized round trip versus explicit autorelease + retain.
+    obj = [TestRoot new];
+    uint64_t startTime, handshakeTime, slowTime;
+
+    outer = objc_autoreleasePoolPush();
+    startTime = mach_absolute_time();
+    for (int i = 0; i < COUNT; i++) {
+        [obj retain];
+        tmp = callee(obj);
+        MAGIC;
+        tmp = objc_retainAutoreleasedReturnValue(tmp);
+        [tmp release];
+    }
+    handshakeTime = mach_absolute_time() - startTime;
+    objc_autoreleasePoolPop(outer);
+
+    outer = objc_autoreleasePoolPush();
+    startTime = mach_absolute_time();
+    for (int i = 0; i < COUNT; i++) {
+        [obj retain];
+        tmp = objc_autorelease(obj);
+        tmp = objc_retain(tmp);
+        [tmp release];
+    }
+    objc_autoreleasePoolPop(outer);
+    slowTime = mach_absolute_time() - startTime;
+
+    testprintf("time: handshake %llu, autorelease+retain %llu\n",
+               handshakeTime, slowTime);
+    timecheck("handshake", handshakeTime, 0, slowTime * 1.5);
+
+    [obj release];
+
+    succeed(__FILE__);
+}
+
+#endif
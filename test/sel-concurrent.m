@@ -0,0 +1,103 @@
+// TEST_CONFIG
+// sel_registerName from many threads at once: every thread gets the same 
+// SEL for a name while the table grows. The time to look up existing 
+// selectors from many threads and from one is printed, not asserted.
+
+#include "test.h"
+#include <string.h>
+#include <objc/runtime.h>
+
+#define THREADS 4
+#define NAMES 20000
+#define ITERATIONS 1000000
+
+static SEL sels[THREADS][NAMES];
+
+static void *registerNames(void *arg)
+{
+    int t = (int)(intptr_t)arg;
+    char name[64];
+    for (int i = 0; i < NAMES; i++) {
+        // Threads register the same names in different orders.
+        int n = (t % 2) ? NAMES - 1 - i : i;
+        snprintf(name, sizeof(name), "concurrentSelector%d:", n);
+        SEL sel = sel_registerName(name);
+        testassert(0 == strcmp(name, sel_getName(sel)));
+        sels[t][n] = sel;
+    }
+    return NULL;
+}
+
+static void *lookUp(void *arg __unused)
+{
+    for (int i = 0; i < ITERATIONS; i++) {
+        testassert(sel_registerName("concurrentSelector7:") == sels[0][7]);
+    }
+    return NULL;
+}
+
+int main()
+{
+    testprintf("Concurrent registration\n");
+    pthread_t th[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, registerNames, (void *)(intptr_t)t);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+
+    char name[64];
+    for (int i = 0; i < NAMES; i++) {
+        for (int t = 1; t < THREADS; t++) {
+            testassert(sels[t][i] == sels[0][i]);
+        }
+        testassert(sel_isMapped(sels[0][i]));
+        snprintf(name, sizeof(name), "concurrentSelector%d:", i);
+        testassert(sel_getUid(name) == sels[0][i]);
+    }
+
+    testprintf("Names too long to share an arena chunk\n");
+    size_t longLength = 100000;
+    char *longName = (char *)malloc(longLength + 1);
+    memset(longName, 'x', longLength);
+    longName[longLength] = 0;
+    SEL longSel = sel_registerName(longName);
+    testassert(longSel != (SEL)longName);
+    testassert(0 == strcmp(longName, sel_getName(longSel)));
+    longName[0] = 'y';
+    testassert(sel_registerName(longName) != longSel);
+    longName[0] = 'x';
+    testassert(sel_registerName(longName) == longSel);
+    free(longName);
+
+    testprintf("Selectors in the shared cache and in images\n");
+    testassert(sel_registerName("alloc") == @selector(alloc));
+    testassert(sel_registerName("concurrentSelectorFromImage") == 
+               @selector(concurrentSelectorFromImage));
+    testassert(sel_isMapped(@selector(alloc)));
+    // A copy of a name is not a registered selector.
+    char *copy = strdup("concurrentSelector7:");
+    testassert(!sel_isMapped((SEL)copy));
+    free(copy);
+
+    testprintf("Benchmark: %d threads looking up versus one\n", THREADS);
+    uint64_t startTime, serialTime, parallelTime;
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) lookUp(NULL);
+    serialTime = mach_absolute_time() - startTime;
+
+    startTime = mach_absolute_time();
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&th[t], NULL, lookUp, NULL);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(th[t], NULL);
+    }
+    parallelTime = mach_absolute_time() - startTime;
+
+    testprintf("time: %d threads %llu, one thread %llu\n",
+               THREADS, parallelTime, serialTime);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,162 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_DISABLE_NONPOINTER_ISA=YES
+// Side table retain counts: without non-pointer isa every retain count
+// lives in a SideTable's RefcountMap. Retain counts stay right while
+// the maps grow past their inline buckets and shrink back. Benchmarks
+// insert (including grow), find and erase for a few objects per stripe
+// and for many, with objects allocated back to back or scattered.
+
+#include "test.h"
+#include <objc/runtime.h>
+#include <objc/NSObject.h>
+
+@interface Counted : NSObject @end
+@implementation Counted @end
+
+// Enough for a few entries per stripe up to many hundreds.
+#define MAX_OBJECTS 32768
+#define FIND_ROUNDS 4
+
+static id objects[MAX_OBJECTS];
+static uint32_t seed = 1;
+
+static uint32_t nextRandom(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void shuffle(id *list, int count)
+{
+    for (int i = count - 1; i > 0; i--) {
+        int j = nextRandom() % (i + 1);
+        id tmp = list[i];
+        list[i] = list[j];
+        list[j] = tmp;
+    }
+}
+
+// Allocate count objects. Scattered objects are every fourth of a
+// larger allocation, in random order, like objects that survive
+// among short-lived ones.
+static void allocate(int count, bool scattered)
+{
+    if (!scattered) {
+        for (int i = 0; i < count; i++) objects[i] = [Counted new];
+        return;
+    }
+
+    static id spare[MAX_OBJECTS * 3];
+    int s = 0;
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < 3; j++) spare[s++] = [Counted new];
+        objects[i] = [Counted new];
+    }
+    for (int i = 0; i < s; i++) [spare[i] release];
+    shuffle(objects, count);
+}
+
+struct times {
+    uint64_t insert;
+    uint64_t find;
+    uint64_t erase;
+};
+
+// Per-object times in mach_absolute_time units times 1000.
+static struct times measure(int count, bool scattered)
+{
+    struct times result;
+    uint64_t startTime;
+
+    allocate(count, scattered);
+
+    // Insert: the first extra retain adds each object to its stripe,
+    // growing maps that start out empty.
+    startTime = mach_absolute_time();
+    for (int i = 0; i < count; i++) [objects[i] retain];
+    result.insert = (mach_absolute_time() - startTime) * 1000 / count;
+
+    // Find: retain and release objects already in the table.
+    startTime = mach_absolute_time();
+    for (int r = 0; r < FIND_ROUNDS; r++) {
+        for (int i = 0; i < count; i++) {
+            [objects[i] retain];
+            [objects[i] release];
+        }
+    }
+    result.find = (mach_absolute_time() - startTime) * 1000 /
+        (count * FIND_ROUNDS * 2);
+
+    for (int i = 0; i < count; i++) {
+        testassert([objects[i] retainCount] == 2);
+        [objects[i] release];
+    }
+
+    // Erase: deallocation removes each object from its stripe.
+    startTime = mach_absolute_time();
+    for (int i = 0; i < count; i++) [objects[i] release];
+    result.erase = (mach_absolute_time() - startTime) * 1000 / count;
+
+    return result;
+}
+
+int main()
+{
+    testprintf("Retain counts through grow and shrink\n");
+    for (int count = 1; count <= 4096; count *= 4) {
+        allocate(count, false);
+        for (int i = 0; i < count; i++) {
+            for (int j = 0; j <= i % 5; j++) [objects[i] retain];
+        }
+        for (int i = 0; i < count; i++) {
+            testassert([objects[i] retainCount] == (NSUInteger)(i % 5 + 2));
+        }
+        // Release every other object completely first, leaving
+        // tombstones among live entries.
+        for (int i = 0; i < count; i += 2) {
+            for (int j = 0; j <= i % 5; j++) [objects[i] release];
+            [objects[i] release];
+        }
+        for (int i = 1; i < count; i += 2) {
+            testassert([objects[i] retainCount] == (NSUInteger)(i % 5 + 2));
+            for (int j = 0; j <= i % 5; j++) [objects[i] release];
+            testassert([objects[i] retainCount] == 1);
+            [objects[i] release];
+        }
+    }
+
+    // Warm up malloc and the side tables.
+    measure(MAX_OBJECTS, false);
+
+    static const int counts[] = { 64, 256, 1024, MAX_OBJECTS };
+    struct times small = {0, 0, 0};
+    struct times large = {0, 0, 0};
+    for (int scattered = 0; scattered < 2; scattered++) {
+        for (unsigned c = 0; c < sizeof(counts)/sizeof(counts[0]); c++) {
+            int count = counts[c];
+            struct times t = measure(count, scattered);
+            testprintf("Benchmark: %5d %s objects: insert %llu, find %llu, "
+                       "erase %llu\n", count,
+                       scattered ? "scattered" : "adjacent ",
+                       t.insert, t.find, t.erase);
+            if (count == counts[0]) {
+                small.insert += t.insert;
+                small.find += t.find;
+                small.erase += t.erase;
+            }
+            if (count == MAX_OBJECTS) {
+                large.insert += t.insert;
+                large.find += t.find;
+                large.erase += t.erase;
+            }
+        }
+    }
+
+    // A few objects per stripe fit in the inline buckets, so per object
+    // they must not cost more than tables that have spilled to the heap.
+    timecheck("side table insert", small.insert, 0, large.insert * 1.5);
+    timecheck("side table find", small.find, 0, large.find * 1.5);
+    timecheck("side table erase", small.erase, 0, large.erase * 1.5);
+
+    succeed(__FILE__);
+}
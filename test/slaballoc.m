@@ -0,0 +1,98 @@
+// TEST_CONFIG MEM=mrc
+// Instances of classes opted in to the slab allocator.
+
+#include "test.h"
+#include "testroot.i"
+
+#include <objc/objc-internal.h>
+#include <malloc/malloc.h>
+
+#define COUNT 10000
+
+@interface Slab : TestRoot {
+    id ivar;
+}
+@end
+@implementation Slab @end
+
+@interface SlabSub : Slab {
+    long more[4];
+}
+@end
+@implementation SlabSub @end
+
+// Statistics of Slab's size class, shared with any class of that size.
+static BOOL slabStatistics(objc_slabStatistics *outStats)
+{
+    return _objc_slabGetStatisticsForSize(class_getInstanceSize([Slab class]), 
+                                          outStats);
+}
+
+int main()
+{
+    _class_setUsesSlabAllocator([Slab class]);
+
+    objc_slabStatistics before, after;
+    testassert(slabStatistics(&before));
+
+    testprintf("malloc_size and free work on slab instances\n");
+    id obj = [Slab new];
+    testassert(malloc_size(obj) >= class_getInstanceSize([Slab class]));
+    testassert(malloc_zone_from_ptr(obj) != malloc_default_zone());
+    testassert(slabStatistics(&after));
+    testassert(after.inUse == before.inUse + 1);
+    TestRootDealloc = 0;
+    [obj release];
+    testassert(TestRootDealloc == 1);
+    testassert(slabStatistics(&after));
+    testassert(after.inUse == before.inUse);
+
+    testprintf("Instances are zeroed when reused\n");
+    for (int i = 0; i < 10; i++) {
+        Slab *s = [Slab new];
+        testassert(object_getIvar(s, class_getInstanceVariable([Slab class], "ivar")) == nil);
+        object_setIvar(s, class_getInstanceVariable([Slab class], "ivar"), (id)(uintptr_t)0x1234);
+        object_setIvar(s, class_getInstanceVariable([Slab class], "ivar"), nil);
+        [s release];
+    }
+
+    testprintf("Subclasses inherit the setting\n");
+    obj = [SlabSub new];
+    testassert(malloc_zone_from_ptr(obj) != malloc_default_zone());
+    [obj release];
+
+    testprintf("Weak references and associated objects\n");
+    obj = [Slab new];
+    id weak = nil;
+    objc_storeWeak(&weak, obj);
+    id value = [TestRoot new];
+    objc_setAssociatedObject(obj, &weak, value, OBJC_ASSOCIATION_RETAIN);
+    [value release];
+    TestRootDealloc = 0;
+    [obj release];
+    testassert(TestRootDealloc == 2);
+    testassert(objc_loadWeak(&weak) == nil);
+
+    testprintf("Blocks freed by another thread are reused\n");
+    static id objs[COUNT];
+    for (int i = 0; i < COUNT; i++) objs[i] = [Slab new];
+    testassert(slabStatistics(&before));
+    testonthread(^{
+        for (int i = 0; i < COUNT; i++) [objs[i] release];
+    });
+    testassert(slabStatistics(&after));
+    testassert(after.inUse + COUNT == before.inUse);
+    leak_mark();
+    for (int i = 0; i < COUNT; i++) objs[i] = [Slab new];
+    for (int i = 0; i < COUNT; i++) [objs[i] release];
+    testassert(slabStatistics(&before));
+    testassert(before.capacity == after.capacity);
+    leak_check(0);
+
+    testprintf("Other classes are unaffected\n");
+    obj = [TestRoot new];
+    testassert(malloc_zone_from_ptr(obj) == malloc_default_zone());
+    [obj release];
+
+    succeed(__FILE__);
+}
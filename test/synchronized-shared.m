@@ -0,0 +1,131 @@
+// TEST_CONFIG
+// objc_sync_enter_shared: readers hold an object together,
+// objc_sync_enter excludes them, and both modes nest.
+
+#include "test.h"
+
+#include <pthread.h>
+#include <libkern/OSAtomic.h>
+#include <objc/runtime.h>
+#include <objc/objc-sync.h>
+#include <Foundation/NSObject.h>
+
+#define READERS 4
+#define WRITERS 2
+#define COUNT 20000
+
+static id lock;
+static volatile int32_t inside;
+static volatile int32_t writerHolds;
+static volatile long a, b;
+
+static void *concurrentReader(void *arg __unused)
+{
+    objc_registerThreadWithCollector();
+    testassert(objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    OSAtomicIncrement32Barrier(&inside);
+    // Every reader must get in while the others still hold the lock.
+    for (int i = 0; i < 5000  &&  inside < READERS; i++) usleep(1000);
+    testassert(inside == READERS);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    return NULL;
+}
+
+static void *blockedWriter(void *arg __unused)
+{
+    objc_registerThreadWithCollector();
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    OSAtomicIncrement32Barrier(&writerHolds);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    return NULL;
+}
+
+static void *reader(void *arg __unused)
+{
+    objc_registerThreadWithCollector();
+    for (int n = 0; n < COUNT; n++) {
+        testassert(objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+        testassert(a == b);
+        testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    }
+    return NULL;
+}
+
+static void *writer(void *arg __unused)
+{
+    objc_registerThreadWithCollector();
+    for (int n = 0; n < COUNT; n++) {
+        testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+        a++;
+        b++;
+        testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    }
+    return NULL;
+}
+
+int main()
+{
+    pthread_t threads[READERS + WRITERS];
+    lock = [[NSObject alloc] init];
+
+    testprintf("Nesting\n");
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    testassert(objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+
+    // Exclusive then shared, released in either order.
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+
+    // Each exit consumes only holds of its own mode.
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+
+    testprintf("Readers hold the lock together\n");
+    for (int t = 0; t < READERS; t++) {
+        pthread_create(&threads[t], NULL, concurrentReader, NULL);
+    }
+    for (int t = 0; t < READERS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    testprintf("A writer waits for readers\n");
+    testassert(objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    pthread_create(&threads[0], NULL, blockedWriter, NULL);
+    sleep(1);
+    testassert(writerHolds == 0);
+    testassert(objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    pthread_join(threads[0], NULL);
+    testassert(writerHolds == 1);
+
+    testprintf("Readers and writers\n");
+    for (int t = 0; t < READERS + WRITERS; t++) {
+        pthread_create(&threads[t], NULL, t < READERS ? reader : writer, NULL);
+    }
+    for (int t = 0; t < READERS + WRITERS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    testassert(a == WRITERS * COUNT);
+    testassert(b == WRITERS * COUNT);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,142 @@
+// TEST_CONFIG
+// Uncontended @synchronized uses a thin lock word. Contention, recursion
+// past the thread's thin cache, and mixed thin and monitor holders must
+// all still give mutual exclusion, and a thin holder hands off to a
+// waiting monitor acquirer on exit.
+
+#include "test.h"
+
+#include <pthread.h>
+#include <objc/runtime.h>
+#include <objc/objc-sync.h>
+#include <Foundation/NSObject.h>
+
+#define THREADS 8
+#define COUNT 20000
+#define NESTED 8
+
+static id locks[NESTED];
+static int counts[NESTED];
+
+static void *threadfn(void *arg)
+{
+    int depth = 1 + (int)(intptr_t)arg % NESTED;
+
+    objc_registerThreadWithCollector();
+
+    for (int n = 0; n < COUNT; n++) {
+        // Holding more objects than fit in the thin cache at once
+        // forces the later ones onto the monitor path.
+        for (int d = 0; d < depth; d++) {
+            int err = objc_sync_enter(locks[d]);
+            testassert(err == OBJC_SYNC_SUCCESS);
+        }
+        for (int d = 0; d < depth; d++) {
+            counts[d]++;
+        }
+        for (int d = depth - 1; d >= 0; d--) {
+            int err = objc_sync_exit(locks[d]);
+            testassert(err == OBJC_SYNC_SUCCESS);
+        }
+    }
+
+    return NULL;
+}
+
+static volatile int released;
+
+static void *waiterfn(void *arg)
+{
+    id obj = (id)arg;
+    objc_registerThreadWithCollector();
+    testassert(objc_sync_enter(obj) == OBJC_SYNC_SUCCESS);
+    testassert(released);
+    testassert(objc_sync_exit(obj) == OBJC_SYNC_SUCCESS);
+    return NULL;
+}
+
+int main()
+{
+    int err;
+    id obj = [[NSObject alloc] init];
+
+    testprintf("Uncontended and recursive\n");
+    for (int i = 0; i < 10; i++) {
+        err = objc_sync_enter(obj);
+        testassert(err == OBJC_SYNC_SUCCESS);
+    }
+    for (int i = 0; i < 10; i++) {
+        err = objc_sync_exit(obj);
+        testassert(err == OBJC_SYNC_SUCCESS);
+    }
+    err = objc_sync_exit(obj);
+    testassert(err == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+
+    testprintf("Many objects held at once\n");
+    id many[NESTED * 4];
+    for (int i = 0; i < NESTED * 4; i++) {
+        many[i] = [[NSObject alloc] init];
+        err = objc_sync_enter(many[i]);
+        testassert(err == OBJC_SYNC_SUCCESS);
+    }
+    // Out of order release of thin and monitor holds.
+    for (int i = 0; i < NESTED * 4; i += 2) {
+        err = objc_sync_exit(many[i]);
+        testassert(err == OBJC_SYNC_SUCCESS);
+    }
+    for (int i = 1; i < NESTED * 4; i += 2) {
+        err = objc_sync_exit(many[i]);
+        testassert(err == OBJC_SYNC_SUCCESS);
+    }
+    for (int i = 0; i < NESTED * 4; i++) {
+        err = objc_sync_exit(many[i]);
+        testassert(err == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+        [many[i] release];
+    }
+
+    testprintf("Contention\n");
+    for (int d = 0; d < NESTED; d++) {
+        locks[d] = [[NSObject alloc] init];
+    }
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, &threadfn, (void*)(intptr_t)t);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    for (int d = 0; d < NESTED; d++) {
+        int expected = 0;
+        for (int t = 0; t < THREADS; t++) {
+            if (1 + t % NESTED > d) expected += COUNT;
+        }
+        testassert(counts[d] == expected);
+    }
+
+    testprintf("A monitor acquirer sleeps until a thin holder hands off\n");
+    err = objc_sync_enter(obj);
+    testassert(err == OBJC_SYNC_SUCCESS);
+    pthread_t waiter;
+    pthread_create(&waiter, NULL, &waiterfn, obj);
+    usleep(100000);
+    released = 1;
+    err = objc_sync_exit(obj);
+    testassert(err == OBJC_SYNC_SUCCESS);
+    pthread_join(waiter, NULL);
+    err = objc_sync_enter(obj);
+    testassert(err == OBJC_SYNC_SUCCESS);
+    err = objc_sync_exit(obj);
+    testassert(err == OBJC_SYNC_SUCCESS);
+
+    testprintf("Thin and monitor locks are released for reuse\n");
+    for (int d = 0; d < NESTED; d++) {
+        err = objc_sync_enter(locks[d]);
+        testassert(err == OBJC_SYNC_SUCCESS);
+        err = objc_sync_exit(locks[d]);
+        testassert(err == OBJC_SYNC_SUCCESS);
+        [locks[d] release];
+    }
+    [obj release];
+
+    succeed(__FILE__);
+}
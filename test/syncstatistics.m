@@ -0,0 +1,115 @@
+/*
+TEST_CONFIG MEM=mrc
+TEST_ENV OBJC_RECORD_SYNC_STATISTICS=YES
+*/
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/objc-sync.h>
+
+@interface Contended : TestRoot @end
+@implementation Contended @end
+
+@interface Uncontended : TestRoot @end
+@implementation Uncontended @end
+
+static id lock;
+static semaphore_t go;
+static semaphore_t locked;
+
+// Totals of every record for cls. Each call site has its own record.
+static objc_syncStatistics total(objc_syncStatistics *all, unsigned int count,
+                                 Class cls, unsigned int *outRecords)
+{
+    objc_syncStatistics result = { cls, NULL, 0, 0, 0, 0 };
+    *outRecords = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (all[i].cls != cls) continue;
+        (*outRecords)++;
+        result.acquisitions += all[i].acquisitions;
+        result.contended += all[i].contended;
+        result.waitTime += all[i].waitTime;
+        if (all[i].maxHoldTime > result.maxHoldTime) {
+            result.maxHoldTime = all[i].maxHoldTime;
+        }
+    }
+    return result;
+}
+
+static void *holder(void *arg __unused)
+{
+    objc_registerThreadWithCollector();
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    semaphore_signal(locked);
+    semaphore_wait(go);
+    sleep(1);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    return NULL;
+}
+
+int main()
+{
+    semaphore_create(mach_task_self(), &go, 0, 0);
+    semaphore_create(mach_task_self(), &locked, 0, 0);
+
+    testprintf("Uncontended and recursive\n");
+    id obj = [Uncontended new];
+    for (int i = 0; i < 3; i++) {
+        testassert(objc_sync_enter(obj) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_enter(obj) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_exit(obj) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_exit(obj) == OBJC_SYNC_SUCCESS);
+    }
+
+    testprintf("Contended\n");
+    lock = [Contended new];
+    pthread_t th;
+    pthread_create(&th, NULL, holder, NULL);
+    semaphore_wait(locked);
+    semaphore_signal(go);
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    pthread_join(th, NULL);
+
+    unsigned int count;
+    objc_syncStatistics *all = _objc_syncCopyStatistics(&count);
+    testassert(all);
+
+    unsigned int records;
+    objc_syncStatistics u = total(all, count, [Uncontended class], &records);
+    testassert(records == 2);
+    testassert(u.acquisitions == 6);
+    testassert(u.contended == 0);
+    testassert(u.waitTime == 0);
+
+    // The holder and main thread call from different sites.
+    objc_syncStatistics c = total(all, count, [Contended class], &records);
+    testassert(records == 2);
+    testassert(c.acquisitions == 2);
+    testassert(c.contended == 1);
+    testassert(c.maxHoldTime > 0);
+    // Sorted by wait time: the contended acquisition comes first.
+    testassert(all[0].cls == [Contended class]);
+    testassert(all[0].contended == 1);
+    testassert(all[0].waitTime > 0);
+    free(all);
+
+    testprintf("Monitor lists\n");
+    objc_syncListStatistics *lists = _objc_syncCopyListStatistics(&count);
+    testassert(lists);
+    testassert(count > 0);
+    uint32_t maxLength = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        testassert(lists[i].inUse <= lists[i].length);
+        testassert(lists[i].length <= lists[i].maxLength);
+        if (lists[i].maxLength > maxLength) maxLength = lists[i].maxLength;
+    }
+    // The contended lock needed a monitor.
+    testassert(maxLength >= 1);
+    free(lists);
+
+    [obj release];
+    [lock release];
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,162 @@
+// TEST_CONFIG MEM=mrc
+// Lock-free weak loads: default-RR referents are loaded without the
+// side table lock, custom-RR referents still use retainWeakReference,
+// and concurrent loads never retain a deallocated object, even when the
+// variable was re-stored before another thread released the old value.
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/NSObject.h>
+
+static int DefaultDealloc;
+
+@interface DefaultRR : NSObject @end
+@implementation DefaultRR
+-(void) dealloc {
+    OSAtomicIncrement32(&DefaultDealloc);
+    [super dealloc];
+}
+@end
+
+#define VARCOUNT 64
+#define CYCLES 2000
+static id vars[VARCOUNT];
+static volatile int stop;
+
+// One weak variable re-stored by one thread while another thread 
+// releases the objects it used to hold.
+#define RESTORES 20000
+static id shared;
+static id volatile handoff;
+static volatile int restoring;
+
+static void *restorer(void *arg __unused)
+{
+    id current = [DefaultRR new];
+    objc_storeWeak(&shared, current);
+    for (int c = 0; c < RESTORES; c++) {
+        id next = [DefaultRR new];
+        objc_storeWeak(&shared, next);
+        while (!OSAtomicCompareAndSwapPtrBarrier(nil, current, 
+                                                 (void * volatile *)&handoff))
+        {
+            sched_yield();
+        }
+        current = next;
+    }
+    objc_storeWeak(&shared, nil);
+    [current release];
+    restoring = 0;
+    return NULL;
+}
+
+static void *releaser(void *arg __unused)
+{
+    while (restoring  ||  handoff) {
+        id old = handoff;
+        if (!old) continue;
+        testassert(OSAtomicCompareAndSwapPtrBarrier(old, nil, 
+                                                    (void * volatile *)&handoff));
+        [old release];
+    }
+    return NULL;
+}
+
+static void *sharedReader(void *arg __unused)
+{
+    while (restoring) {
+        id obj = objc_loadWeakRetained(&shared);
+        if (obj) {
+            testassert([obj class] == [DefaultRR class]);
+            [obj release];
+        }
+    }
+    return NULL;
+}
+
+static void *reader(void *arg __unused)
+{
+    while (!stop) {
+        for (int i = 0; i < VARCOUNT; i++) {
+            id obj = objc_loadWeakRetained(&vars[i]);
+            if (obj) {
+                testassert([obj class] == [DefaultRR class]);
+                [obj release];
+            }
+        }
+    }
+    return NULL;
+}
+
+int main()
+{
+    id var;
+
+    testprintf("Default RR\n");
+    DefaultRR *obj = [DefaultRR new];
+    objc_initWeak(&var, obj);
+    id loaded = objc_loadWeakRetained(&var);
+    testassert(loaded == obj);
+    testassert([loaded retainCount] == 2);
+    [loaded release];
+    [obj release];
+    testassert(DefaultDealloc == 1);
+    testassert(objc_loadWeakRetained(&var) == nil);
+    objc_destroyWeak(&var);
+
+    testprintf("Custom RR uses retainWeakReference\n");
+    TestRoot *root = [TestRoot new];
+    objc_initWeak(&var, root);
+    TestRootTryRetain = 0;
+    loaded = objc_loadWeakRetained(&var);
+    testassert(loaded == root);
+    testassert(TestRootTryRetain == 1);
+    [loaded release];
+    [root release];
+    testassert(objc_loadWeakRetained(&var) == nil);
+    objc_destroyWeak(&var);
+
+    testprintf("Concurrent loads versus dealloc and store\n");
+    pthread_t th[4];
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&th[i], NULL, reader, NULL);
+    }
+    DefaultDealloc = 0;
+    for (int c = 0; c < CYCLES; c++) {
+        DefaultRR *objs[2] = { [DefaultRR new], [DefaultRR new] };
+        for (int i = 0; i < VARCOUNT; i++) {
+            objc_storeWeak(&vars[i], objs[0]);
+        }
+        // Rebinding half the variables, then deallocating both objects.
+        for (int i = 0; i < VARCOUNT; i += 2) {
+            objc_storeWeak(&vars[i], objs[1]);
+        }
+        [objs[0] release];
+        [objs[1] release];
+    }
+    stop = 1;
+    for (int i = 0; i < 4; i++) {
+        pthread_join(th[i], NULL);
+    }
+    testassert(DefaultDealloc == CYCLES * 2);
+    for (int i = 0; i < VARCOUNT; i++) {
+        testassert(vars[i] == nil);
+        objc_destroyWeak(&vars[i]);
+    }
+
+    testprintf("Concurrent load, re-store, and release of the old value\n");
+    DefaultDealloc = 0;
+    restoring = 1;
+    pthread_t r[3];
+    pthread_create(&r[0], NULL, sharedReader, NULL);
+    pthread_create(&r[1], NULL, sharedReader, NULL);
+    pthread_create(&r[2], NULL, releaser, NULL);
+    restorer(NULL);
+    for (int i = 0; i < 3; i++) {
+        pthread_join(r[i], NULL);
+    }
+    testassert(DefaultDealloc == RESTORES + 1);
+    testassert(shared == nil);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,112 @@
+// TEST_CONFIG MEM=mrc
+// objc_moveWeakBatch and objc_copyWeakBatch behave like objc_moveWeak and
+// objc_copyWeak on each pair. Verbose runs print the time of one batch
+// move against the same moves made one at a time.
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/NSObject.h>
+#include <objc/objc-internal.h>
+
+// objc_loadWeak() without the autorelease, so release deallocates.
+static id loadWeak(id *location)
+{
+    id result = objc_loadWeakRetained(location);
+    [result release];
+    return result;
+}
+
+#define COUNT 100000
+#define OBJCOUNT 100
+
+static id *newWeakArray(NSObject **objs)
+{
+    id *vars = (id *)calloc(COUNT, sizeof(id));
+    for (int i = 0; i < COUNT; i++) {
+        objc_initWeak(&vars[i], (i % 7) ? objs[i % OBJCOUNT] : nil);
+    }
+    return vars;
+}
+
+int main()
+{
+    NSObject *objs[OBJCOUNT];
+    for (int i = 0; i < OBJCOUNT; i++) {
+        objs[i] = [NSObject new];
+    }
+
+    testprintf("Move\n");
+    id *src = newWeakArray(objs);
+    id *dst = (id *)malloc(COUNT * sizeof(id));
+    objc_moveWeakBatch(dst, src, COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        testassert(src[i] == nil);
+        testassert(loadWeak(&dst[i]) == ((i % 7) ? objs[i % OBJCOUNT] : nil));
+    }
+
+    testprintf("Copy\n");
+    id *copy = (id *)malloc(COUNT * sizeof(id));
+    objc_copyWeakBatch(copy, dst, COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        testassert(loadWeak(&copy[i]) == loadWeak(&dst[i]));
+    }
+
+    testprintf("Moved and copied variables are cleared by dealloc\n");
+    [objs[1] release];
+    for (int i = 0; i < COUNT; i++) {
+        if (i % OBJCOUNT == 1) {
+            testassert(dst[i] == nil);
+            testassert(copy[i] == nil);
+        }
+    }
+    objs[1] = [NSObject new];
+
+    testprintf("Custom RR referents\n");
+    TestRoot *root = [TestRoot new];
+    id rootSrc[2], rootDst[2], rootCopy[2];
+    objc_initWeak(&rootSrc[0], root);
+    objc_initWeak(&rootSrc[1], root);
+    objc_copyWeakBatch(rootCopy, rootSrc, 2);
+    objc_moveWeakBatch(rootDst, rootSrc, 2);
+    testassert(rootSrc[0] == nil  &&  rootSrc[1] == nil);
+    testassert(loadWeak(&rootDst[1]) == root);
+    testassert(loadWeak(&rootCopy[0]) == root);
+    [root release];
+    testassert(rootDst[0] == nil  &&  rootDst[1] == nil);
+    testassert(rootCopy[0] == nil  &&  rootCopy[1] == nil);
+
+    for (int i = 0; i < COUNT; i++) {
+        objc_destroyWeak(&dst[i]);
+        objc_destroyWeak(&copy[i]);
+    }
+    free(src);
+    free(dst);
+    free(copy);
+
+    testprintf("Timing: batch move versus objc_moveWeak\n");
+    uint64_t startTime, batchTime, singleTime;
+
+    src = newWeakArray(objs);
+    dst = (id *)malloc(COUNT * sizeof(id));
+    startTime = mach_absolute_time();
+    objc_moveWeakBatch(dst, src, COUNT);
+    batchTime = mach_absolute_time() - startTime;
+    for (int i = 0; i < COUNT; i++) objc_destroyWeak(&dst[i]);
+    free(src);
+
+    src = newWeakArray(objs);
+    startTime = mach_absolute_time();
+    for (int i = 0; i < COUNT; i++) objc_moveWeak(&dst[i], &src[i]);
+    singleTime = mach_absolute_time() - startTime;
+    for (int i = 0; i < COUNT; i++) objc_destroyWeak(&dst[i]);
+    free(src);
+    free(dst);
+
+    testprintf("time: batch %llu, single %llu\n", batchTime, singleTime);
+
+    for (int i = 0; i < OBJCOUNT; i++) {
+        [objs[i] release];
+    }
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,221 @@
+// TEST_CONFIG MEM=mrc
+// Weak variables of classes using weak cells share one cell per object.
+
+#include "test.h"
+#include "testroot.i"
+#include <objc/NSObject.h>
+#include <objc/objc-internal.h>
+
+// objc_loadWeak() without the autorelease, so release deallocates.
+static id loadWeak(id *location)
+{
+    id result = objc_loadWeakRetained(location);
+    [result release];
+    return result;
+}
+
+static int CellDealloc;
+
+@interface CellObject : NSObject @end
+@implementation CellObject
+-(void) dealloc {
+    OSAtomicIncrement32(&CellDealloc);
+    [super dealloc];
+}
+@end
+
+@interface CellSubclass : CellObject @end
+@implementation CellSubclass @end
+
+@interface CellRoot : TestRoot @end
+@implementation CellRoot @end
+
+// Releases the last reference to a weakly referenced object while 
+// loading through a cell. That dealloc waits out every weak reader.
+static id victim;
+@interface CellReleaser : CellRoot @end
+@implementation CellReleaser
+-(BOOL) retainWeakReference {
+    id v = victim;
+    victim = nil;
+    [v release];
+    return [super retainWeakReference];
+}
+@end
+
+#define VARCOUNT 10000
+static id vars[VARCOUNT];
+
+static void *reader(void *arg __unused)
+{
+    for (int i = 0; i < VARCOUNT; i++) {
+        id obj = objc_loadWeakRetained(&vars[i]);
+        if (obj) {
+            testassert([obj class] == [CellObject class]);
+            [obj release];
+        }
+    }
+    return NULL;
+}
+
+#define RACES 20000
+static id shared;
+
+static void *cellStorer(void *arg)
+{
+    for (int i = 0; i < RACES; i++) {
+        objc_storeWeak(&shared, (id)arg);
+        objc_storeWeak(&shared, nil);
+    }
+    return NULL;
+}
+
+static void *plainStorer(void *arg)
+{
+    for (int i = 0; i < RACES; i++) {
+        objc_storeWeak(&shared, (id)arg);
+        objc_storeWeak(&shared, nil);
+    }
+    return NULL;
+}
+
+int main()
+{
+    _class_setUsesWeakCells([CellObject class]);
+    _class_setUsesWeakCells([CellRoot class]);
+
+    testprintf("Many weak variables share one cell\n");
+    CellObject *obj = [CellObject new];
+    for (int i = 0; i < VARCOUNT; i++) {
+        objc_initWeak(&vars[i], obj);
+    }
+    testassert(vars[0] != obj);
+    testassert(vars[0] == vars[VARCOUNT-1]);
+    for (int i = 0; i < VARCOUNT; i += 1000) {
+        testassert(loadWeak(&vars[i]) == obj);
+    }
+    [obj release];
+    testassert(CellDealloc == 1);
+    for (int i = 0; i < VARCOUNT; i++) {
+        testassert(objc_loadWeakRetained(&vars[i]) == nil);
+        objc_destroyWeak(&vars[i]);
+    }
+
+    testprintf("Subclasses inherit weak cells\n");
+    id var = nil;
+    obj = [CellSubclass new];
+    objc_initWeak(&var, obj);
+    testassert(var != obj);
+    testassert(loadWeak(&var) == obj);
+
+    testprintf("Replacing a cell with a plain object and back\n");
+    NSObject *plain = [NSObject new];
+    objc_storeWeak(&var, plain);
+    testassert(var == plain);
+    testassert(loadWeak(&var) == plain);
+    objc_storeWeak(&var, obj);
+    testassert(var != obj);
+    testassert(loadWeak(&var) == obj);
+    [plain release];
+    testassert(loadWeak(&var) == obj);
+
+    testprintf("Copy and move\n");
+    id copy, moved;
+    objc_copyWeak(&copy, &var);
+    testassert(copy == var);
+    objc_moveWeak(&moved, &copy);
+    testassert(copy == nil);
+    testassert(loadWeak(&moved) == obj);
+    objc_destroyWeak(&moved);
+
+    testprintf("Dropping every variable frees the cell\n");
+    objc_storeWeak(&var, nil);
+    testassert(var == nil);
+    objc_storeWeak(&var, obj);
+    testassert(loadWeak(&var) == obj);
+    CellDealloc = 0;
+    [obj release];
+    testassert(CellDealloc == 1);
+    testassert(loadWeak(&var) == nil);
+    objc_destroyWeak(&var);
+
+    testprintf("Custom RR uses retainWeakReference through the cell\n");
+    CellRoot *root = [CellRoot new];
+    objc_initWeak(&var, root);
+    TestRootTryRetain = 0;
+    id loaded = objc_loadWeakRetained(&var);
+    testassert(loaded == root);
+    testassert(TestRootTryRetain == 1);
+    [loaded release];
+    [root release];
+    testassert(loadWeak(&var) == nil);
+    objc_destroyWeak(&var);
+
+    testprintf("retainWeakReference may deallocate a weakly referenced object\n");
+    id victimVar;
+    victim = [NSObject new];
+    objc_initWeak(&victimVar, victim);
+    CellReleaser *releaser = [CellReleaser new];
+    objc_initWeak(&var, releaser);
+    loaded = objc_loadWeakRetained(&var);
+    testassert(loaded == releaser);
+    testassert(victim == nil);
+    testassert(loadWeak(&victimVar) == nil);
+    [loaded release];
+    [releaser release];
+    testassert(loadWeak(&var) == nil);
+    objc_destroyWeak(&var);
+    objc_destroyWeak(&victimVar);
+
+    testprintf("Concurrent loads versus dealloc\n");
+    CellDealloc = 0;
+    for (int c = 0; c < 100; c++) {
+        obj = [CellObject new];
+        for (int i = 0; i < VARCOUNT; i++) {
+            objc_storeWeak(&vars[i], obj);
+        }
+        pthread_t th;
+        pthread_create(&th, NULL, reader, NULL);
+        [obj release];
+        pthread_join(th, NULL);
+    }
+    testassert(CellDealloc == 100);
+    for (int i = 0; i < VARCOUNT; i++) {
+        objc_destroyWeak(&vars[i]);
+    }
+
+    testprintf("Plain and cell stores racing on one variable\n");
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass) leak_mark();
+        CellDealloc = 0;
+        obj = [CellObject new];
+        plain = [NSObject new];
+        pthread_t th1, th2;
+        pthread_create(&th1, NULL, cellStorer, obj);
+        pthread_create(&th2, NULL, plainStorer, plain);
+        pthread_join(th1, NULL);
+        pthread_join(th2, NULL);
+        objc_storeWeak(&shared, nil);
+        [plain release];
+        [obj release];
+        testassert(CellDealloc == 1);
+    }
+    // A cell overwritten without its reference dropped would leak.
+    leak_check(0);
+
+    testprintf("Cells do not leak\n");
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass) leak_mark();
+        for (int c = 0; c < 100; c++) {
+            obj = [CellObject new];
+            objc_initWeak(&var, obj);
+            objc_destroyWeak(&var);
+            objc_initWeak(&var, obj);
+            [obj release];
+            objc_destroyWeak(&var);
+        }
+    }
+    leak_check(0);
+
+    succeed(__FILE__);
+}